@@ -7,6 +7,8 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cstdint>
+#include <cstddef>
 
 std::string readFileContents(std::string path) {
     std::ifstream in(path);
@@ -15,5 +17,13 @@ std::string readFileContents(std::string path) {
     return buffer.str();
 }
 
+// 64-bit FNV-1a, pass a previous result as hash to keep hashing more data
+constexpr uint64_t HashBytes(const char *data, size_t length, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
 #endif //PROJECT_BASE_COMMON_H
@@ -0,0 +1,76 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Walker's alias table, built with Vose's method: draws one of n items with a probability proportional to its
+// weight in constant time. Pick a slot uniformly, then keep it with its probability or take its alias instead.
+class AliasTable
+{
+public:
+    struct Entry {
+        float probability = 1.0f;   // of keeping the slot
+        uint32_t alias = 0;         // taken otherwise
+        float pdf = 0.0f;           // chance the item of this slot is drawn overall
+    };
+
+    // negative weights count as zero, all zero gives every item the same chance
+    void Build(const std::vector<float> &weights)
+    {
+        size_t n = weights.size();
+        entries.assign(n, Entry());
+        if (n == 0)
+            return;
+        double total = 0.0;
+        for (float weight : weights)
+            total += weight > 0.0f ? weight : 0.0f;
+
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            double weight = weights[i] > 0.0f ? weights[i] : 0.0f;
+            double pdf = total > 0.0 ? weight / total : 1.0 / (double) n;
+            entries[i].pdf = (float) pdf;
+            entries[i].alias = (uint32_t) i;
+            scaled[i] = pdf * (double) n;
+            (scaled[i] < 1.0 ? small : large).push_back((uint32_t) i);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            entries[s].probability = (float) scaled[s];
+            entries[s].alias = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // what is left is one up to rounding
+        for (uint32_t i : large)
+            entries[i].probability = 1.0f;
+        for (uint32_t i : small)
+            entries[i].probability = 1.0f;
+    }
+
+    // u and v uniform in [0, 1)
+    uint32_t Sample(float u, float v) const
+    {
+        uint32_t slot = (uint32_t) (u * (float) entries.size());
+        if (slot >= entries.size())
+            slot = (uint32_t) entries.size() - 1;
+        return v < entries[slot].probability ? slot : entries[slot].alias;
+    }
+
+    const std::vector<Entry> &Entries() const
+    {
+        return entries;
+    }
+
+private:
+    std::vector<Entry> entries;
+};
+
+#endif
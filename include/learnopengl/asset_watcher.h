@@ -0,0 +1,266 @@
+#ifndef ASSET_WATCHER_H
+#define ASSET_WATCHER_H
+
+#include <learnopengl/model.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Watches a resource directory with inotify and hot reloads the textures and models that change on disk.
+// Decoding and importing happen on a worker thread, the GL objects are swapped in Update() between frames.
+class AssetWatcher
+{
+public:
+    AssetWatcher(const std::string &root) : root(root)
+    {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            std::cout << "ERROR::ASSET_WATCHER:: inotify_init1 failed, hot reload disabled" << std::endl;
+            return;
+        }
+        addWatchRecursive(root);
+        worker = std::thread(&AssetWatcher::workerLoop, this);
+#endif
+    }
+
+    ~AssetWatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAdded.notify_all();
+        if (worker.joinable())
+            worker.join();
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    AssetWatcher(const AssetWatcher &) = delete;
+    AssetWatcher &operator=(const AssetWatcher &) = delete;
+
+    // models are reloaded when their obj file or any mtl file next to it changes
+    void Watch(Model &model)
+    {
+        models.push_back(&model);
+    }
+
+    // listeners get the path of every file that changed under the root, on the main thread inside Update()
+    void Listen(std::function<void(const std::string &path)> listener)
+    {
+        listeners.push_back(std::move(listener));
+    }
+
+    // model listeners get every model that was reloaded, on the main thread once its new meshes are in place
+    void ListenModels(std::function<void(Model &model)> listener)
+    {
+        modelListeners.push_back(std::move(listener));
+    }
+
+    // call once per frame from the render loop, before anything is drawn
+    void Update()
+    {
+#ifdef __linux__
+        if (fd < 0)
+            return;
+        readEvents();
+#endif
+        std::vector<Result> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.swap(results);
+        }
+        for (Result &result : done) {
+            if (result.model != nullptr) {
+                result.model->Upload(result.data);
+                std::cout << "Reloaded model " << result.path << std::endl;
+                for (auto &listener : modelListeners)
+                    listener(*result.model);
+            } else {
+                auto it = LoadedTextures().find(result.path);
+                if (it != LoadedTextures().end()) {
+                    // same texture name, so every mesh and model that references it sees the new pixels
+                    UploadTextureImage(it->second, result.image);
+                    std::cout << "Reloaded texture " << result.path << std::endl;
+                }
+            }
+        }
+    }
+
+private:
+    struct Job {
+        std::string path;
+        Model *model = nullptr;
+        std::set<std::string> knownTextures;
+    };
+
+    struct Result {
+        std::string path;
+        Model *model = nullptr;
+        TextureImage image;
+        ModelData data;
+    };
+
+    std::string root;
+    int fd = -1;
+    std::vector<std::pair<int, std::string>> watchDirs;
+    std::vector<Model *> models;
+    std::vector<std::function<void(const std::string &)>> listeners;
+    std::vector<std::function<void(Model &)>> modelListeners;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobAdded;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    bool stopping = false;
+
+    static std::string extension(const std::string &path)
+    {
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos)
+            return "";
+        std::string ext = path.substr(dot);
+        for (char &c : ext)
+            c = (char) tolower(c);
+        return ext;
+    }
+
+    // queues a job unless an identical one is still waiting, editors tend to write a file several times in a row
+    void enqueue(Job job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Job &queued : jobs)
+            if (queued.path == job.path && queued.model == job.model)
+                return;
+        jobs.push_back(std::move(job));
+        jobAdded.notify_one();
+    }
+
+    void fileChanged(const std::string &dir, const std::string &path)
+    {
+        for (auto &listener : listeners)
+            listener(path);
+        std::string ext = extension(path);
+        for (Model *model : models) {
+            if (path == model->path || (ext == ".mtl" && dir == model->directory)) {
+                Job job;
+                job.path = model->path;
+                job.model = model;
+                for (auto &texture : LoadedTextures())
+                    job.knownTextures.insert(texture.first);
+                enqueue(std::move(job));
+            }
+        }
+        for (auto &texture : LoadedTextures()) {
+            // packed textures are rebuilt when either of their two files changes
+            const string &name = texture.first;
+            size_t separator = name.find('|');
+            bool packedSource = separator != string::npos
+                                && (name.substr(0, separator) == path || name.substr(separator + 1) == path);
+            if (name == path || packedSource) {
+                Job job;
+                job.path = name;
+                enqueue(std::move(job));
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAdded.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            Result result;
+            result.path = job.path;
+            result.model = job.model;
+            if (job.model != nullptr)
+                result.data = Model::Import(job.path, &job.knownTextures, job.model->packSpecular);
+            else
+                result.image = LoadTextureImage(job.path);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+        }
+    }
+
+#ifdef __linux__
+    void addWatchRecursive(const std::string &dir)
+    {
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) {
+            std::cout << "ERROR::ASSET_WATCHER:: cannot watch " << dir << std::endl;
+            return;
+        }
+        watchDirs.emplace_back(wd, dir);
+
+        DIR *handle = opendir(dir.c_str());
+        if (handle == nullptr)
+            return;
+        while (dirent *entry = readdir(handle)) {
+            std::string name = entry->d_name;
+            if (entry->d_type == DT_DIR && name != "." && name != "..")
+                addWatchRecursive(dir + '/' + name);
+        }
+        closedir(handle);
+    }
+
+    void readEvents()
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                return;
+            for (char *ptr = buffer; ptr < buffer + length;) {
+                const inotify_event *event = (const inotify_event *) ptr;
+                ptr += sizeof(inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+
+                std::string dir;
+                for (auto &watched : watchDirs)
+                    if (watched.first == event->wd)
+                        dir = watched.second;
+                if (dir.empty())
+                    continue;
+
+                std::string path = dir + '/' + event->name;
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & IN_CREATE)
+                        addWatchRecursive(path);
+                } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    fileChanged(dir, path);
+                }
+            }
+        }
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+
+// Bounding volume hierarchy over triangles, for ray queries on the CPU. Nodes are split with the surface area
+// heuristic evaluated over a few bins per axis and stored depth first, so the first child of a node is the node
+// right after it. Queries only read the tree and may run on any number of threads at once.
+class TriangleBVH
+{
+public:
+    struct Hit {
+        float t = FLT_MAX;
+        unsigned int triangle = 0;   // index as passed to Build
+        float u = 0.0f;              // barycentric weights of the second and third vertex
+        float v = 0.0f;
+    };
+
+    // three positions per triangle
+    void Build(const std::vector<glm::vec3> &positions)
+    {
+        size_t count = positions.size() / 3;
+        triangles.resize(count);
+        order.resize(count);
+        std::vector<Bounds> bounds(count);
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3 &a = positions[3 * i], &b = positions[3 * i + 1], &c = positions[3 * i + 2];
+            triangles[i] = Triangle{a, b - a, c - a};
+            bounds[i].Grow(a);
+            bounds[i].Grow(b);
+            bounds[i].Grow(c);
+            order[i] = (uint32_t) i;
+        }
+        nodes.clear();
+        nodes.reserve(count * 2);
+        if (count == 0)
+            return;
+        build(bounds, 0, (uint32_t) count);
+
+        // triangles in leaf order, so a leaf reads one contiguous run
+        std::vector<Triangle> sorted(count);
+        for (size_t i = 0; i < count; i++)
+            sorted[i] = triangles[order[i]];
+        triangles.swap(sorted);
+    }
+
+    // the closest triangle the ray hits before tMax, both sides count
+    bool Intersect(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, Hit &hit) const
+    {
+        hit.t = tMax;
+        bool found = false;
+        traverse(origin, direction, hit, [&](uint32_t index, float t, float u, float v) {
+            hit.t = t;
+            hit.triangle = order[index];
+            hit.u = u;
+            hit.v = v;
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+    // whether anything lies on the ray before tMax, stops at the first triangle found
+    bool Occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const
+    {
+        Hit hit;
+        hit.t = tMax;
+        bool occluded = false;
+        traverse(origin, direction, hit, [&](uint32_t, float, float, float) {
+            occluded = true;
+            return true;
+        });
+        return occluded;
+    }
+
+    size_t TriangleCount() const
+    {
+        return triangles.size();
+    }
+
+private:
+    struct Bounds {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+
+        void Grow(const glm::vec3 &p)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        void Grow(const Bounds &b)
+        {
+            min = glm::min(min, b.min);
+            max = glm::max(max, b.max);
+        }
+
+        float Area() const
+        {
+            if (min.x > max.x)
+                return 0.0f;
+            glm::vec3 d = max - min;
+            return d.x * d.y + d.y * d.z + d.z * d.x;
+        }
+    };
+
+    // a leaf when count is non zero, its triangles start at first. An inner node's second child is at first.
+    struct Node {
+        glm::vec3 min;
+        uint32_t first;
+        glm::vec3 max;
+        uint32_t count;
+    };
+
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+    };
+
+    static const int BINS = 12;
+    static const uint32_t MAX_LEAF_TRIANGLES = 4;
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> order;
+
+    uint32_t build(const std::vector<Bounds> &bounds, uint32_t begin, uint32_t end)
+    {
+        uint32_t index = (uint32_t) nodes.size();
+        nodes.emplace_back();
+        Bounds box, centroids;
+        for (uint32_t i = begin; i < end; i++) {
+            box.Grow(bounds[order[i]]);
+            centroids.Grow((bounds[order[i]].min + bounds[order[i]].max) * 0.5f);
+        }
+        nodes[index].min = box.min;
+        nodes[index].max = box.max;
+
+        uint32_t count = end - begin;
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = (float) count * box.Area();
+        if (count > MAX_LEAF_TRIANGLES) {
+            for (int axis = 0; axis < 3; axis++) {
+                float lo = centroids.min[axis], extent = centroids.max[axis] - lo;
+                if (extent <= 0.0f)
+                    continue;
+                Bounds binBounds[BINS];
+                uint32_t binCounts[BINS] = {};
+                for (uint32_t i = begin; i < end; i++) {
+                    const Bounds &b = bounds[order[i]];
+                    int bin = binOf((b.min[axis] + b.max[axis]) * 0.5f, lo, extent);
+                    binBounds[bin].Grow(b);
+                    binCounts[bin]++;
+                }
+                // cost of splitting after each bin, swept from both ends
+                float rightCost[BINS];
+                Bounds right;
+                uint32_t rightCount = 0;
+                for (int bin = BINS - 1; bin > 0; bin--) {
+                    right.Grow(binBounds[bin]);
+                    rightCount += binCounts[bin];
+                    rightCost[bin] = (float) rightCount * right.Area();
+                }
+                Bounds left;
+                uint32_t leftCount = 0;
+                for (int bin = 0; bin < BINS - 1; bin++) {
+                    left.Grow(binBounds[bin]);
+                    leftCount += binCounts[bin];
+                    float cost = (float) leftCount * left.Area() + rightCost[bin + 1];
+                    if (leftCount > 0 && leftCount < count && cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = bin;
+                    }
+                }
+            }
+        }
+
+        if (bestAxis < 0) {
+            nodes[index].first = begin;
+            nodes[index].count = count;
+            return index;
+        }
+        float lo = centroids.min[bestAxis], extent = centroids.max[bestAxis] - lo;
+        uint32_t *middle = std::partition(order.data() + begin, order.data() + end, [&](uint32_t triangle) {
+            const Bounds &b = bounds[triangle];
+            return binOf((b.min[bestAxis] + b.max[bestAxis]) * 0.5f, lo, extent) <= bestSplit;
+        });
+        uint32_t split = (uint32_t) (middle - order.data());
+        build(bounds, begin, split);
+        uint32_t second = build(bounds, split, end);
+        nodes[index].first = second;
+        nodes[index].count = 0;
+        return index;
+    }
+
+    static int binOf(float centroid, float lo, float extent)
+    {
+        int bin = (int) ((centroid - lo) / extent * BINS);
+        return std::min(std::max(bin, 0), BINS - 1);
+    }
+
+    // distance at which the ray enters the node, FLT_MAX if it misses it before tMax
+    static float enter(const Node &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax)
+    {
+        glm::vec3 t0 = (node.min - origin) * inverseDirection;
+        glm::vec3 t1 = (node.max - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        float near = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float far = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+        return near <= far ? near : FLT_MAX;
+    }
+
+    // calls found(triangle, t, u, v) for hits closer than hit.t, nearer nodes first. found returns true to stop.
+    template<typename Found>
+    void traverse(const glm::vec3 &origin, const glm::vec3 &direction, const Hit &hit, Found found) const
+    {
+        if (nodes.empty())
+            return;
+        glm::vec3 inverseDirection = 1.0f / direction;
+        uint32_t stack[64];
+        int size = 0;
+        if (enter(nodes[0], origin, inverseDirection, hit.t) == FLT_MAX)
+            return;
+        stack[size++] = 0;
+        while (size > 0) {
+            const Node &node = nodes[stack[--size]];
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    float t, u, v;
+                    if (intersect(triangles[i], origin, direction, hit.t, t, u, v) && found(i, t, u, v))
+                        return;
+                }
+                continue;
+            }
+            uint32_t near = (uint32_t) (&node - nodes.data()) + 1, far = node.first;
+            float tNear = enter(nodes[near], origin, inverseDirection, hit.t);
+            float tFar = enter(nodes[far], origin, inverseDirection, hit.t);
+            if (tFar < tNear) {
+                std::swap(near, far);
+                std::swap(tNear, tFar);
+            }
+            if (tFar != FLT_MAX && size < 64)
+                stack[size++] = far;
+            if (tNear != FLT_MAX && size < 64)
+                stack[size++] = near;
+        }
+    }
+
+    // Moller-Trumbore
+    static bool intersect(const Triangle &triangle, const glm::vec3 &origin, const glm::vec3 &direction, float tMax,
+                          float &t, float &u, float &v)
+    {
+        glm::vec3 p = glm::cross(direction, triangle.e2);
+        float determinant = glm::dot(triangle.e1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - triangle.v0;
+        u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, triangle.e1);
+        v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        t = glm::dot(triangle.e2, q) * inverse;
+        return t > 0.0f && t < tMax;
+    }
+};
+
+#endif
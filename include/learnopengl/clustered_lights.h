@@ -0,0 +1,309 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/light_radius.h>
+#include <learnopengl/simd.h>
+#include <learnopengl/worker_pool.h>
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+// the view frustum is split into CLUSTER_TILES_X * CLUSTER_TILES_Y screen tiles and CLUSTER_SLICES exponential depth
+// slices, must match the defines in 2.model_lighting.fs
+const unsigned int CLUSTER_TILES_X = 16;
+const unsigned int CLUSTER_TILES_Y = 9;
+const unsigned int CLUSTER_SLICES = 24;
+const unsigned int CLUSTER_TILES = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+const unsigned int CLUSTER_COUNT = CLUSTER_TILES * CLUSTER_SLICES;
+
+// texture units the light buffers stay bound to
+const GLuint CLUSTER_LIGHT_DATA_UNIT = 9;
+const GLuint CLUSTER_RECORDS_UNIT = 10;
+const GLuint CLUSTER_INDICES_UNIT = 11;
+
+// texels of one light in the light data buffer, the std140 structs copied as they are
+const unsigned int POINT_LIGHT_TEXELS = sizeof(PointLightData) / sizeof(glm::vec4);
+const unsigned int SPOT_LIGHT_TEXELS = sizeof(SpotLightData) / sizeof(glm::vec4);
+
+// Clustered forward lighting. Every frame the app fills pointLights and spotLights with all active lights in world
+// space, Update() assigns them to the clusters their radius of influence reaches and uploads three texture buffers:
+// the lights themselves, one (offset, point count, spot count) record per cluster and the light list those
+// records point into. The assignment runs on a small thread pool, one depth slice at a time, and tests each
+// light's bounding sphere against four cluster boxes at once with SSE.
+class ClusteredLights
+{
+public:
+    std::vector<PointLightData> pointLights;
+    std::vector<SpotLightData> spotLights;
+
+    struct Stats {
+        unsigned int lights = 0;
+        unsigned int references = 0;       // entries in all cluster lists together
+        unsigned int busiestCluster = 0;   // most lights in one cluster
+        float assignMs = 0.0f;
+    };
+
+    ClusteredLights(unsigned int threads = std::thread::hardware_concurrency())
+        : pool(std::min(threads, CLUSTER_SLICES)), slices(CLUSTER_SLICES)
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLuint units[3] = {CLUSTER_LIGHT_DATA_UNIT, CLUSTER_RECORDS_UNIT, CLUSTER_INDICES_UNIT};
+        const GLenum formats[3] = {GL_RGBA32F, GL_RGBA32UI, GL_R32UI};
+        for (int i = 0; i < 3; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~ClusteredLights()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    ClusteredLights(const ClusteredLights &) = delete;
+    ClusteredLights &operator=(const ClusteredLights &) = delete;
+
+    // assigns the lights to clusters and uploads the buffers, frame gets the constants the shaders need to find
+    // the cluster of a fragment. width and height are the size of the framebuffer drawn to.
+    void Update(const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane,
+                int width, int height, FrameData &frame)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        float logDepthRange = std::log(farPlane / nearPlane);
+        frame.clusterTileSize = glm::vec2((float) width / CLUSTER_TILES_X, (float) height / CLUSTER_TILES_Y);
+        frame.clusterSliceScale = CLUSTER_SLICES / logDepthRange;
+        frame.clusterSliceBias = -(float) CLUSTER_SLICES * std::log(nearPlane) / logDepthRange;
+
+        if (projection != boundsProjection || nearPlane != boundsNear || farPlane != boundsFar)
+            buildClusterBounds(projection, nearPlane, farPlane);
+
+        // view space bounding spheres and the slices they overlap
+        lightBounds.clear();
+        lightTexels.clear();
+        for (const PointLightData &light : pointLights) {
+            addBounds(view, light.position, InfluenceRadius(light), nearPlane, farPlane);
+            appendTexels(&light, POINT_LIGHT_TEXELS);
+        }
+        pointBoundsCount = lightBounds.size();
+        for (const SpotLightData &light : spotLights) {
+            addBounds(view, light.position, InfluenceRadius(light), nearPlane, farPlane);
+            appendTexels(&light, SPOT_LIGHT_TEXELS);
+        }
+
+        pool.Run([this](unsigned int share) { assignSlices(share); });
+
+        // flatten the per slice lists into the record and index buffers
+        records.assign(CLUSTER_COUNT * 4, 0);
+        indices.clear();
+        stats = Stats();
+        stats.lights = (unsigned int) (pointLights.size() + spotLights.size());
+        for (unsigned int k = 0; k < CLUSTER_SLICES; k++) {
+            const Slice &slice = slices[k];
+            for (unsigned int t = 0; t < CLUSTER_TILES; t++) {
+                const std::vector<uint32_t> &list = slice.lights[t];
+                uint32_t *record = &records[(k * CLUSTER_TILES + t) * 4];
+                record[0] = (uint32_t) indices.size();
+                record[1] = slice.pointCount[t];
+                record[2] = (uint32_t) list.size() - slice.pointCount[t];
+                indices.insert(indices.end(), list.begin(), list.end());
+                stats.busiestCluster = std::max(stats.busiestCluster, (unsigned int) list.size());
+            }
+        }
+        stats.references = (unsigned int) indices.size();
+
+        upload(buffers[0], lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        upload(buffers[1], records.data(), records.size() * sizeof(uint32_t));
+        upload(buffers[2], indices.data(), indices.size() * sizeof(uint32_t));
+
+        stats.assignMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct LightBounds {
+        glm::vec3 center;   // view space
+        float radius;
+        uint32_t texel;     // where the light starts in the light data buffer
+        unsigned int firstSlice, lastSlice;
+    };
+
+    // view space boxes of the clusters of one depth slice as structure of arrays, and the lights found in each
+    struct Slice {
+        float minX[CLUSTER_TILES], minY[CLUSTER_TILES], minZ[CLUSTER_TILES];
+        float maxX[CLUSTER_TILES], maxY[CLUSTER_TILES], maxZ[CLUSTER_TILES];
+        std::vector<uint32_t> lights[CLUSTER_TILES];   // point lights first
+        uint32_t pointCount[CLUSTER_TILES];
+    };
+
+    GLuint buffers[3];
+    GLuint textures[3];
+
+    WorkerPool pool;
+
+    std::vector<Slice> slices;
+    glm::mat4 boundsProjection = glm::mat4(0.0f);
+    float boundsNear = 0.0f, boundsFar = 0.0f;
+    float sliceLogNear = 0.0f, sliceLogStep = 0.0f;
+
+    std::vector<LightBounds> lightBounds;
+    size_t pointBoundsCount = 0;
+    std::vector<glm::vec4> lightTexels;
+    std::vector<uint32_t> records;
+    std::vector<uint32_t> indices;
+    Stats stats;
+
+    void buildClusterBounds(const glm::mat4 &projection, float nearPlane, float farPlane)
+    {
+        boundsProjection = projection;
+        boundsNear = nearPlane;
+        boundsFar = farPlane;
+        sliceLogNear = std::log(nearPlane);
+        sliceLogStep = std::log(farPlane / nearPlane) / CLUSTER_SLICES;
+
+        // view space direction through each tile corner, scaled so that z = -1
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        auto cornerRay = [&](unsigned int x, unsigned int y) {
+            glm::vec4 p = inverseProjection * glm::vec4(-1.0f + 2.0f * x / CLUSTER_TILES_X,
+                                                        -1.0f + 2.0f * y / CLUSTER_TILES_Y, -1.0f, 1.0f);
+            glm::vec3 ray = glm::vec3(p) / p.w;
+            return ray / -ray.z;
+        };
+
+        for (unsigned int k = 0; k < CLUSTER_SLICES; k++) {
+            Slice &slice = slices[k];
+            float depths[2] = {std::exp(sliceLogNear + k * sliceLogStep), std::exp(sliceLogNear + (k + 1) * sliceLogStep)};
+            for (unsigned int y = 0; y < CLUSTER_TILES_Y; y++) {
+                for (unsigned int x = 0; x < CLUSTER_TILES_X; x++) {
+                    unsigned int t = y * CLUSTER_TILES_X + x;
+                    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+                    for (unsigned int corner = 0; corner < 4; corner++) {
+                        glm::vec3 ray = cornerRay(x + (corner & 1), y + (corner >> 1));
+                        for (float depth : depths) {
+                            lo = glm::min(lo, ray * depth);
+                            hi = glm::max(hi, ray * depth);
+                        }
+                    }
+                    slice.minX[t] = lo.x; slice.minY[t] = lo.y; slice.minZ[t] = lo.z;
+                    slice.maxX[t] = hi.x; slice.maxY[t] = hi.y; slice.maxZ[t] = hi.z;
+                }
+            }
+        }
+    }
+
+    void addBounds(const glm::mat4 &view, const glm::vec3 &position, float radius, float nearPlane, float farPlane)
+    {
+        LightBounds bounds;
+        bounds.center = glm::vec3(view * glm::vec4(position, 1.0f));
+        bounds.radius = std::min(radius, 2.0f * farPlane);
+        bounds.texel = (uint32_t) lightTexels.size();
+        // the slices between the nearest and farthest depth of the sphere
+        float nearest = std::max(-bounds.center.z - bounds.radius, nearPlane);
+        float farthest = std::min(-bounds.center.z + bounds.radius, farPlane);
+        if (nearest > farthest || bounds.radius <= 0.0f) {
+            bounds.firstSlice = 1;
+            bounds.lastSlice = 0;
+        } else {
+            bounds.firstSlice = sliceOf(nearest);
+            bounds.lastSlice = sliceOf(farthest);
+        }
+        lightBounds.push_back(bounds);
+    }
+
+    unsigned int sliceOf(float depth) const
+    {
+        int slice = (int) std::floor((std::log(depth) - sliceLogNear) / sliceLogStep);
+        return (unsigned int) std::max(0, std::min(slice, (int) CLUSTER_SLICES - 1));
+    }
+
+    template<typename T>
+    void appendTexels(const T *light, unsigned int texels)
+    {
+        size_t offset = lightTexels.size();
+        lightTexels.resize(offset + texels);
+        memcpy(static_cast<void *>(&lightTexels[offset]), light, texels * sizeof(glm::vec4));
+    }
+
+    static void upload(GLuint buffer, const void *data, size_t size)
+    {
+        // an empty buffer cannot back a texture, keep at least one texel
+        static const uint32_t zeros[4] = {0, 0, 0, 0};
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, size > 0 ? size : sizeof(zeros), size > 0 ? data : zeros, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void assignSlices(unsigned int share)
+    {
+        for (unsigned int k = share; k < CLUSTER_SLICES; k += pool.Threads()) {
+            Slice &slice = slices[k];
+            for (unsigned int t = 0; t < CLUSTER_TILES; t++)
+                slice.lights[t].clear();
+            for (size_t i = 0; i < lightBounds.size(); i++) {
+                if (i == pointBoundsCount)
+                    for (unsigned int t = 0; t < CLUSTER_TILES; t++)
+                        slice.pointCount[t] = (uint32_t) slice.lights[t].size();
+                const LightBounds &light = lightBounds[i];
+                if (k >= light.firstSlice && k <= light.lastSlice)
+                    assignLight(slice, light);
+            }
+            if (pointBoundsCount == lightBounds.size())
+                for (unsigned int t = 0; t < CLUSTER_TILES; t++)
+                    slice.pointCount[t] = (uint32_t) slice.lights[t].size();
+        }
+    }
+
+    // sphere against box: squared distance from the center to the box, clamped per axis
+    static void assignLight(Slice &slice, const LightBounds &light)
+    {
+        float radius2 = light.radius * light.radius;
+#ifdef LEARNOPENGL_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 cx = _mm_set1_ps(light.center.x), cy = _mm_set1_ps(light.center.y), cz = _mm_set1_ps(light.center.z);
+        const __m128 r2 = _mm_set1_ps(radius2);
+        for (unsigned int t = 0; t < CLUSTER_TILES; t += 4) {
+            __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(slice.minX + t), cx), _mm_sub_ps(cx, _mm_loadu_ps(slice.maxX + t))));
+            __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(slice.minY + t), cy), _mm_sub_ps(cy, _mm_loadu_ps(slice.maxY + t))));
+            __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(slice.minZ + t), cz), _mm_sub_ps(cz, _mm_loadu_ps(slice.maxZ + t))));
+            __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, r2));
+            for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+                if (mask & 1)
+                    slice.lights[t + lane].push_back(light.texel);
+        }
+#else
+        for (unsigned int t = 0; t < CLUSTER_TILES; t++) {
+            float dx = std::max(0.0f, std::max(slice.minX[t] - light.center.x, light.center.x - slice.maxX[t]));
+            float dy = std::max(0.0f, std::max(slice.minY[t] - light.center.y, light.center.y - slice.maxY[t]));
+            float dz = std::max(0.0f, std::max(slice.minZ[t] - light.center.z, light.center.z - slice.maxZ[t]));
+            if (dx * dx + dy * dy + dz * dz <= radius2)
+                slice.lights[t].push_back(light.texel);
+        }
+#endif
+    }
+};
+
+static_assert(CLUSTER_TILES % 4 == 0, "clusters are tested four at a time");
+
+#endif
@@ -0,0 +1,697 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/light_radius.h>
+#include <learnopengl/alias_table.h>
+#include <common.h>
+
+#include <vector>
+#include <iostream>
+#include <cfloat>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+// texture unit of the light buffer read by the lighting pass, the G-buffer itself is bound to units 0 to 2
+const GLuint DEFERRED_LIGHT_DATA_UNIT = 12;
+
+// the temporal cache reads last frame's color, normal and depth from units 3 to 5
+const GLuint TEMPORAL_HISTORY_UNIT = 3;
+// a pixel is lit from scratch at least once in this many frames even where the cache holds it
+const int TEMPORAL_REFRESH_PERIOD = 8;
+// the half resolution lighting is read back from units 3 and 4, after the temporal pass is done with them
+const GLuint HALF_LIGHTING_UNIT = 3;
+// the stochastic passes read the reservoirs, then the accumulated image, from unit 3 and last frame's normal and
+// depth from units 4 and 5 like the temporal cache
+const GLuint STOCHASTIC_UNIT = 3;
+// the stochastic image is averaged over at most this many frames where the surface stayed in view
+const int STOCHASTIC_ACCUMULATION_FRAMES = 16;
+
+// what a light volume adds, must match deferred_lighting.fs
+enum DeferredLightType {
+    DEFERRED_DIRECTIONAL = 0,   // the directional light and the ambient term, covers the whole screen
+    DEFERRED_POINT_LIGHT = 1,
+    DEFERRED_SPOT_LIGHT = 2
+};
+
+// optional passes of DeferredRenderer::Light(), each one is on when its shaders are given
+struct DeferredLightingPasses {
+    Shader *temporal = nullptr;         // temporal_reproject.fs
+    Shader *halfResolution = nullptr;   // deferred_lighting.fs with HALF_RESOLUTION
+    Shader *upsample = nullptr;         // deferred_upsample.fs
+    Shader *stochasticSample = nullptr;       // deferred_lighting.fs with STOCHASTIC 1
+    Shader *stochasticShade = nullptr;        // deferred_lighting.fs with STOCHASTIC 2
+    Shader *stochasticAccumulate = nullptr;   // stochastic_accumulate.fs
+};
+
+// Deferred shading. The opaque scene is drawn once into a G-buffer:
+//   attachment 0, RGBA8:   albedo, specular map .r
+//   attachment 1, RGBA16F: octahedral world normal, specular map .g (read by the .rgr light)
+//   depth and stencil:     world positions are rebuilt from depth in the lighting pass
+// Every light is then drawn as a quad covering only the screen rectangle of its radius of influence, so a pixel
+// pays for the lights that reach it instead of every light times the overdraw. All the quads go out in one
+// instanced draw and are added up in a single sampled color target. BeginForward() binds that target together
+// with the G-buffer depth for whatever cannot be deferred (glass, glowing lamps), Present() copies it to the window.
+//
+// Given a temporal shader, Light() first reuses last frame's lit image where it still fits: a full screen pass
+// reprojects every pixel into the previous frame, checks that the depth and normal there belong to the same
+// surface and copies the color over, marking the pixel in the stencil so no light volume touches it. The rest,
+// plus a rotating 1 in TEMPORAL_REFRESH_PERIOD pattern of pixels, is lit as usual. The lit image, the normals and
+// the depth are then kept for the next frame. Any change to the lights drops the whole history.
+//
+// At half resolution the light volumes add up only the light reaching the surface, diffuse and specular apart, in
+// a quarter of the pixels, lit at one G-buffer pixel out of each 2x2 block. A full screen pass then upsamples it
+// guided by the full resolution depth and normals and applies the full resolution albedo and specular maps.
+//
+// Stochastic lighting takes the place of the other passes and costs the same per pixel however many lights there
+// are. The point and spot lights on screen go into an alias table weighted by their power, appended to the light
+// buffer. A first full screen pass draws a few lights from it per pixel and keeps one by weighted reservoir
+// resampling against what each brings to the pixel, merged with the reservoir last frame left on the same surface.
+// A second pass merges in the reservoirs of a few neighbours and shades the directional light plus the one light
+// kept, weighted to stand for all of them. The noisy result is averaged over the frames the surface stayed in view.
+class DeferredRenderer
+{
+public:
+    struct Stats {
+        unsigned int volumes = 0;     // light quads drawn, the directional light included
+        float coverage = 0.0f;        // their area together in screens, the average number of lights per pixel
+        float reused = 0.0f;          // share of the screen the temporal cache filled, from a few frames ago
+        unsigned int sampled = 0;     // lights in the alias table of stochastic lighting
+    };
+
+    DeferredRenderer(int width, int height) : width(width), height(height)
+    {
+        glGenTextures(1, &albedoSpecular);
+        glBindTexture(GL_TEXTURE_2D, albedoSpecular);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        nearestFilter();
+        glGenTextures(1, &normal);
+        glBindTexture(GL_TEXTURE_2D, normal);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        nearestFilter();
+        glGenTextures(1, &depth);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+        nearestFilter();
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        nearestFilter();
+        glGenTextures(1, &historyColor);
+        glBindTexture(GL_TEXTURE_2D, historyColor);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        nearestFilter();
+        glGenTextures(1, &historyNormal);
+        glBindTexture(GL_TEXTURE_2D, historyNormal);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        nearestFilter();
+        glGenTextures(1, &historyDepth);
+        glBindTexture(GL_TEXTURE_2D, historyDepth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+        nearestFilter();
+        glGenTextures(1, &halfDiffuse);
+        glBindTexture(GL_TEXTURE_2D, halfDiffuse);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, halfWidth(), halfHeight(), 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        nearestFilter();
+        glGenTextures(1, &halfSpecular);
+        glBindTexture(GL_TEXTURE_2D, halfSpecular);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, halfWidth(), halfHeight(), 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        nearestFilter();
+        // the light index and weights must stay exact, the reservoirs are full floats
+        glGenTextures(2, reservoirs);
+        glGenTextures(2, accumulation);
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D, reservoirs[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+            nearestFilter();
+            glBindTexture(GL_TEXTURE_2D, accumulation[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+            nearestFilter();
+        }
+        glGenTextures(1, &shaded);
+        glBindTexture(GL_TEXTURE_2D, shaded);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        nearestFilter();
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &gBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        const GLenum attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, attachments);
+        checkFramebuffer("G-buffer");
+
+        // the lighting pass samples the depth texture, so it cannot be attached while the lights are drawn. It has
+        // a stencil of its own for the pixels the temporal cache filled.
+        glGenRenderbuffers(1, &lightingStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, lightingStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &lightingBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, lightingBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, lightingStencil);
+        checkFramebuffer("lighting");
+
+        // last frame for the temporal cache, only ever written by blits
+        glGenFramebuffers(1, &historyBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, historyBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyColor, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, historyNormal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, historyDepth, 0);
+        checkFramebuffer("history");
+
+        glGenFramebuffers(1, &halfBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, halfBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, halfDiffuse, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, halfSpecular, 0);
+        glDrawBuffers(2, attachments);
+        checkFramebuffer("half resolution");
+
+        // the sampling pass reads reservoirs[0] and writes reservoirs[1], the shading pass the other way around
+        glGenFramebuffers(1, &sampleBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, sampleBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reservoirs[1], 0);
+        checkFramebuffer("sampling");
+        glGenFramebuffers(1, &shadeBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, shadeBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, shaded, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, reservoirs[0], 0);
+        glDrawBuffers(2, attachments);
+        checkFramebuffer("shading");
+        // the accumulation ping-pongs, each frame writes the lit image and one accumulation reading the other
+        glGenFramebuffers(2, accumulateBuffers);
+        for (int i = 0; i < 2; i++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, accumulateBuffers[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, accumulation[i], 0);
+            glDrawBuffers(2, attachments);
+            checkFramebuffer("accumulation");
+        }
+
+        glGenFramebuffers(1, &forwardBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, forwardBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        checkFramebuffer("forward");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(1, &lightBuffer);
+        glGenTextures(1, &lightTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        glActiveTexture(GL_TEXTURE0 + DEFERRED_LIGHT_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // a unit quad stretched over each light's rectangle, one instance per light
+        const float corners[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+        glGenVertexArrays(1, &volumeVAO);
+        glGenBuffers(1, &cornerVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(volumeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *) 0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void *) offsetof(LightVolume, rect));
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribIPointer(2, 2, GL_INT, sizeof(LightVolume), (void *) offsetof(LightVolume, texel));
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // the full screen triangle of the temporal and upsampling passes makes its corners from gl_VertexID
+        glGenVertexArrays(1, &screenVAO);
+        glGenQueries(1, &reuseQuery);
+    }
+
+    ~DeferredRenderer()
+    {
+        glDeleteVertexArrays(1, &volumeVAO);
+        glDeleteVertexArrays(1, &screenVAO);
+        glDeleteQueries(1, &reuseQuery);
+        glDeleteBuffers(1, &cornerVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteTextures(1, &lightTexture);
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteFramebuffers(1, &gBuffer);
+        glDeleteFramebuffers(1, &lightingBuffer);
+        glDeleteFramebuffers(1, &forwardBuffer);
+        glDeleteFramebuffers(1, &historyBuffer);
+        glDeleteFramebuffers(1, &halfBuffer);
+        glDeleteFramebuffers(1, &sampleBuffer);
+        glDeleteFramebuffers(1, &shadeBuffer);
+        glDeleteFramebuffers(2, accumulateBuffers);
+        glDeleteRenderbuffers(1, &lightingStencil);
+        const GLuint textures[9] = {albedoSpecular, normal, depth, color, historyColor, historyNormal, historyDepth,
+                                    halfDiffuse, halfSpecular};
+        glDeleteTextures(9, textures);
+        glDeleteTextures(2, reservoirs);
+        glDeleteTextures(2, accumulation);
+        glDeleteTextures(1, &shaded);
+    }
+
+    DeferredRenderer(const DeferredRenderer &) = delete;
+    DeferredRenderer &operator=(const DeferredRenderer &) = delete;
+
+    // binds and clears the G-buffer, draw the opaque scene with the gbuffer shaders after this
+    void BeginGeometry()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        // the alpha channels hold specular maps, nothing may be blended into the G-buffer
+        glDisable(GL_BLEND);
+    }
+
+    // adds up every light over the G-buffer, pixels nothing was drawn to get the background color. The passes
+    // can take the pixels last frame still holds from there, and light the rest at half resolution, or sample the
+    // lights stochastically instead.
+    void Light(Shader &shader, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane,
+               const DirLightData &dirLight, const std::vector<PointLightData> &pointLights,
+               const std::vector<SpotLightData> &spotLights, const glm::vec3 &background,
+               const DeferredLightingPasses &passes = DeferredLightingPasses())
+    {
+        bool stochastic = passes.stochasticSample && passes.stochasticShade && passes.stochasticAccumulate;
+        Shader *temporalShader = stochastic ? nullptr : passes.temporal;
+        bool halfResolution = !stochastic && passes.halfResolution && passes.upsample;
+        lightTexels.clear();
+        volumes.clear();
+        sampledLights.clear();
+        sampledWeights.clear();
+        float reused = stats.reused;
+        stats = Stats();
+
+        addVolume(glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f), DEFERRED_DIRECTIONAL);
+        appendTexels(&dirLight, sizeof(DirLightData) / sizeof(glm::vec4));
+        for (const PointLightData &light : pointLights) {
+            glm::vec4 rect;
+            if (lightRect(view, projection, nearPlane, light.position, InfluenceRadius(light), rect)) {
+                addSample(lightPower(light), DEFERRED_POINT_LIGHT);
+                addVolume(rect, DEFERRED_POINT_LIGHT);
+            }
+            appendTexels(&light, POINT_LIGHT_TEXELS);
+        }
+        for (const SpotLightData &light : spotLights) {
+            glm::vec4 rect;
+            if (lightRect(view, projection, nearPlane, light.position, InfluenceRadius(light), rect)) {
+                // the cone's share of the sphere
+                addSample(lightPower(light) * (1.0f - light.outerCutOff) * 0.5f, DEFERRED_SPOT_LIGHT);
+                addVolume(rect, DEFERRED_SPOT_LIGHT);
+            }
+            appendTexels(&light, SPOT_LIGHT_TEXELS);
+        }
+        stats.volumes = (unsigned int) volumes.size();
+        uint64_t lightsHash = HashBytes((const char *) lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        int aliasOffset = (int) lightTexels.size();
+        if (stochastic)
+            appendAliasTable();
+        glm::mat4 viewProjection = projection * view;
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+        bool reuse = temporalShader && historyValid && lightsHash == historyLightsHash;
+        stats.reused = reuse ? readReuse(reused) : 0.0f;
+
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, lightTexels.size() * sizeof(glm::vec4), lightTexels.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, volumes.size() * sizeof(LightVolume), volumes.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, lightingBuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClearStencil(0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, albedoSpecular);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, normal);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glActiveTexture(GL_TEXTURE0);
+
+        if (reuse) {
+            glActiveTexture(GL_TEXTURE0 + TEMPORAL_HISTORY_UNIT);
+            glBindTexture(GL_TEXTURE_2D, historyColor);
+            glActiveTexture(GL_TEXTURE0 + TEMPORAL_HISTORY_UNIT + 1);
+            glBindTexture(GL_TEXTURE_2D, historyNormal);
+            glActiveTexture(GL_TEXTURE0 + TEMPORAL_HISTORY_UNIT + 2);
+            glBindTexture(GL_TEXTURE_2D, historyDepth);
+            glActiveTexture(GL_TEXTURE0);
+            // the pixels the temporal shader does not discard are taken and marked
+            glDisable(GL_BLEND);
+            glEnable(GL_STENCIL_TEST);
+            glStencilFunc(GL_ALWAYS, 1, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            temporalShader->use();
+            temporalShader->setMat4("inverseViewProjection"_u, inverseViewProjection);
+            temporalShader->setMat4("previousViewProjection"_u, historyViewProjection);
+            temporalShader->setMat4("previousInverseViewProjection"_u, glm::inverse(historyViewProjection));
+            temporalShader->setVec3("viewPos"_u, glm::vec3(glm::inverse(view)[3]));
+            temporalShader->setInt("refreshPeriod"_u, TEMPORAL_REFRESH_PERIOD);
+            temporalShader->setInt("refreshPhase"_u, frame % TEMPORAL_REFRESH_PERIOD);
+            bool query = !reusePending;
+            if (query)
+                glBeginQuery(GL_SAMPLES_PASSED, reuseQuery);
+            glBindVertexArray(screenVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            if (query) {
+                glEndQuery(GL_SAMPLES_PASSED);
+                reusePending = true;
+            }
+            // the lights only reach the rest
+            glStencilFunc(GL_EQUAL, 0, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        }
+
+        if (stochastic) {
+            stochasticLight(passes, inverseViewProjection, view, historyValid && lightsHash == historyLightsHash,
+                            aliasOffset, background);
+        } else if (halfResolution) {
+            // the light volumes into the half resolution targets, without the stencil of the full size pass
+            glDisable(GL_STENCIL_TEST);
+            glBindFramebuffer(GL_FRAMEBUFFER, halfBuffer);
+            glViewport(0, 0, halfWidth(), halfHeight());
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            passes.halfResolution->use();
+            passes.halfResolution->setMat4("inverseViewProjection"_u, inverseViewProjection);
+            glBindVertexArray(volumeVAO);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) volumes.size());
+
+            // back to full size, into the pixels the temporal cache left
+            glBindFramebuffer(GL_FRAMEBUFFER, lightingBuffer);
+            glViewport(0, 0, width, height);
+            if (reuse)
+                glEnable(GL_STENCIL_TEST);
+            glDisable(GL_BLEND);
+            glActiveTexture(GL_TEXTURE0 + HALF_LIGHTING_UNIT);
+            glBindTexture(GL_TEXTURE_2D, halfDiffuse);
+            glActiveTexture(GL_TEXTURE0 + HALF_LIGHTING_UNIT + 1);
+            glBindTexture(GL_TEXTURE_2D, halfSpecular);
+            glActiveTexture(GL_TEXTURE0);
+            passes.upsample->use();
+            passes.upsample->setVec2("depthParameters"_u, projection[3][2], projection[2][2]);
+            passes.upsample->setVec3("background"_u, background);
+            glBindVertexArray(screenVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEnable(GL_BLEND);
+        } else {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            shader.use();
+            shader.setMat4("inverseViewProjection"_u, inverseViewProjection);
+            shader.setVec3("background"_u, background);
+            glBindVertexArray(volumeVAO);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) volumes.size());
+        }
+        glBindVertexArray(0);
+        glDisable(GL_STENCIL_TEST);
+
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+
+        historyValid = temporalShader != nullptr || stochastic;
+        if (historyValid)
+            storeHistory(viewProjection, lightsHash);
+        frame++;
+    }
+
+    // the lit image with the G-buffer depth, for the passes drawn on top of it
+    void BeginForward()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, forwardBuffer);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+    }
+
+    // copies the finished image to the default framebuffer
+    void Present()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, forwardBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct LightVolume {
+        glm::vec4 rect;    // NDC: min x, min y, max x, max y
+        int32_t texel;     // first texel of the light in the light buffer
+        int32_t type;      // DeferredLightType
+    };
+
+    int width, height;
+    GLuint albedoSpecular = 0, normal = 0, depth = 0, color = 0;
+    GLuint gBuffer = 0, lightingBuffer = 0, forwardBuffer = 0, lightingStencil = 0;
+    GLuint lightBuffer = 0, lightTexture = 0;
+    GLuint volumeVAO = 0, cornerVBO = 0, instanceVBO = 0;
+    std::vector<glm::vec4> lightTexels;
+    std::vector<LightVolume> volumes;
+    Stats stats;
+
+    // the temporal cache
+    GLuint historyColor = 0, historyNormal = 0, historyDepth = 0, historyBuffer = 0;
+    GLuint screenVAO = 0;
+    GLuint reuseQuery = 0;
+
+    // the half resolution lighting
+    GLuint halfDiffuse = 0, halfSpecular = 0, halfBuffer = 0;
+
+    // the stochastic lighting, sampledLights holds texel * 4 + DeferredLightType of each light in the alias table
+    GLuint reservoirs[2] = {0, 0}, accumulation[2] = {0, 0}, shaded = 0;
+    GLuint sampleBuffer = 0, shadeBuffer = 0, accumulateBuffers[2] = {0, 0};
+    int accumulationTarget = 0;
+    std::vector<float> sampledWeights;
+    std::vector<int32_t> sampledLights;
+    AliasTable aliasTable;
+    bool reusePending = false;
+    bool historyValid = false;
+    glm::mat4 historyViewProjection = glm::mat4(1.0f);
+    uint64_t historyLightsHash = 0;
+    int frame = 0;
+
+    // the reservoirs, then the shading of the light they chose, then the average over the frames. Leaves the
+    // lighting buffer bound.
+    void stochasticLight(const DeferredLightingPasses &passes, const glm::mat4 &inverseViewProjection,
+                         const glm::mat4 &view, bool temporalReuse, int aliasOffset, const glm::vec3 &background)
+    {
+        glDisable(GL_BLEND);
+        glBindVertexArray(volumeVAO);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sampleBuffer);
+        glActiveTexture(GL_TEXTURE0 + STOCHASTIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, reservoirs[0]);
+        glActiveTexture(GL_TEXTURE0 + TEMPORAL_HISTORY_UNIT + 1);
+        glBindTexture(GL_TEXTURE_2D, historyNormal);
+        glActiveTexture(GL_TEXTURE0 + TEMPORAL_HISTORY_UNIT + 2);
+        glBindTexture(GL_TEXTURE_2D, historyDepth);
+        glActiveTexture(GL_TEXTURE0);
+        Shader &sample = *passes.stochasticSample;
+        sample.use();
+        sample.setMat4("inverseViewProjection"_u, inverseViewProjection);
+        sample.setMat4("previousViewProjection"_u, historyViewProjection);
+        sample.setMat4("previousInverseViewProjection"_u, glm::inverse(historyViewProjection));
+        sample.setBool("temporalReuse"_u, temporalReuse);
+        sample.setInt("aliasTable"_u, aliasOffset);
+        sample.setInt("lightCount"_u, (int) sampledLights.size());
+        sample.setInt("frame"_u, frame);
+        // only the directional light's volume, it covers the screen
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, 1);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, shadeBuffer);
+        glActiveTexture(GL_TEXTURE0 + STOCHASTIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, reservoirs[1]);
+        glActiveTexture(GL_TEXTURE0);
+        Shader &shade = *passes.stochasticShade;
+        shade.use();
+        shade.setMat4("inverseViewProjection"_u, inverseViewProjection);
+        shade.setVec3("background"_u, background);
+        shade.setInt("aliasTable"_u, aliasOffset);
+        shade.setInt("lightCount"_u, (int) sampledLights.size());
+        shade.setInt("frame"_u, frame);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, 1);
+
+        // into the lit image and the next accumulation, which is dropped when the lights changed
+        glBindFramebuffer(GL_FRAMEBUFFER, accumulateBuffers[accumulationTarget]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, shaded);
+        glActiveTexture(GL_TEXTURE0 + STOCHASTIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, accumulation[1 - accumulationTarget]);
+        glActiveTexture(GL_TEXTURE0);
+        Shader &accumulate = *passes.stochasticAccumulate;
+        accumulate.use();
+        accumulate.setMat4("inverseViewProjection"_u, inverseViewProjection);
+        accumulate.setMat4("previousViewProjection"_u, historyViewProjection);
+        accumulate.setMat4("previousInverseViewProjection"_u, glm::inverse(historyViewProjection));
+        accumulate.setVec3("viewPos"_u, glm::vec3(glm::inverse(view)[3]));
+        accumulate.setFloat("maxFrames"_u, temporalReuse ? (float) STOCHASTIC_ACCUMULATION_FRAMES : 1.0f);
+        glBindVertexArray(screenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        accumulationTarget = 1 - accumulationTarget;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, lightingBuffer);
+        glEnable(GL_BLEND);
+    }
+
+    // the alias table after the lights, one texel per entry: probability of keeping the slot, alias slot, the
+    // light's texel * 4 + type, probability of the entry
+    void appendAliasTable()
+    {
+        aliasTable.Build(sampledWeights);
+        const std::vector<AliasTable::Entry> &entries = aliasTable.Entries();
+        for (size_t i = 0; i < entries.size(); i++)
+            lightTexels.push_back(glm::vec4(entries[i].probability, (float) entries[i].alias,
+                                            (float) sampledLights[i], entries[i].pdf));
+        stats.sampled = (unsigned int) entries.size();
+    }
+
+    // called before the light's texels are appended, like addVolume
+    void addSample(float power, DeferredLightType type)
+    {
+        sampledLights.push_back((int32_t) lightTexels.size() * 4 + type);
+        sampledWeights.push_back(power);
+    }
+
+    // the luminance the light gives off, a light that reaches nothing gives none
+    template<typename Light>
+    static float lightPower(const Light &light)
+    {
+        if (InfluenceRadius(light) <= 0.0f)
+            return 0.0f;
+        return glm::dot(light.ambient + light.diffuse, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    // keeps this frame's lit image, normals and depth for the next one
+    void storeHistory(const glm::mat4 &viewProjection, uint64_t lightsHash)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, historyBuffer);
+        glDrawBuffer(GL_COLOR_ATTACHMENT1);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+                          GL_NEAREST);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, lightingBuffer);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        historyViewProjection = viewProjection;
+        historyLightsHash = lightsHash;
+    }
+
+    // the share of the screen the cache filled when the last query was issued, previous while it is in flight
+    float readReuse(float previous)
+    {
+        if (!reusePending)
+            return previous;
+        GLint available = 0;
+        glGetQueryObjectiv(reuseQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return previous;
+        GLuint samples = 0;
+        glGetQueryObjectuiv(reuseQuery, GL_QUERY_RESULT, &samples);
+        reusePending = false;
+        return (float) samples / ((float) width * (float) height);
+    }
+
+    int halfWidth() const
+    {
+        return (width + 1) / 2;
+    }
+
+    int halfHeight() const
+    {
+        return (height + 1) / 2;
+    }
+
+    static void nearestFilter()
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    static void checkFramebuffer(const char *name)
+    {
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Deferred " << name << " framebuffer is not complete!" << std::endl;
+    }
+
+    template<typename T>
+    void appendTexels(const T *light, unsigned int texels)
+    {
+        size_t offset = lightTexels.size();
+        lightTexels.resize(offset + texels);
+        memcpy(static_cast<void *>(&lightTexels[offset]), light, texels * sizeof(glm::vec4));
+    }
+
+    // called before the light's texels are appended, the volume points at them
+    void addVolume(const glm::vec4 &rect, DeferredLightType type)
+    {
+        LightVolume volume;
+        volume.rect = rect;
+        volume.texel = (int32_t) lightTexels.size();
+        volume.type = type;
+        volumes.push_back(volume);
+        stats.coverage += (rect.z - rect.x) * (rect.w - rect.y) / 4.0f;
+    }
+
+    // the NDC rectangle around a sphere of influence, false if the sphere is entirely off screen
+    static bool lightRect(const glm::mat4 &view, const glm::mat4 &projection, float nearPlane,
+                          const glm::vec3 &position, float radius, glm::vec4 &rect)
+    {
+        if (radius <= 0.0f)
+            return false;
+        glm::vec3 center = glm::vec3(view * glm::vec4(position, 1.0f));
+        float nearest = -center.z - radius;
+        float farthest = -center.z + radius;
+        if (farthest < nearPlane)
+            return false;
+        rect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+        // a sphere that reaches past the near plane cannot be projected, it gets the whole screen
+        if (nearest < nearPlane)
+            return true;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius,
+                             (corner & 4) ? radius : -radius);
+            glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+            minX = std::min(minX, clip.x / clip.w);
+            minY = std::min(minY, clip.y / clip.w);
+            maxX = std::max(maxX, clip.x / clip.w);
+            maxY = std::max(maxY, clip.y / clip.w);
+        }
+        rect = glm::vec4(std::max(minX, -1.0f), std::max(minY, -1.0f), std::min(maxX, 1.0f), std::min(maxY, 1.0f));
+        return rect.x < rect.z && rect.y < rect.w;
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/scene.h>
+#include <learnopengl/simd.h>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <cfloat>
+#include <cstdint>
+
+// View frustum culling of the scene's objects by their world space boxes (see Scene::Mins). The boxes go into a
+// bounding volume hierarchy with four children per node, each coordinate of the four child boxes in an array of its
+// own, so a node tests all its children against a plane at once. A child is either another node or one object.
+//
+// The tree is built by median splits when the number of objects changes and refitted when the last Scene::Update
+// moved or reloaded some, from their nodes up to the root, so static content costs nothing. A child that is wholly inside a plane is not
+// tested against that plane again further down, one inside all of them is visible with everything below it
+// without going further down.
+class FrustumCuller
+{
+public:
+    struct Stats {
+        unsigned int visible = 0;
+        unsigned int culled = 0;
+        unsigned int nodes = 0;     // nodes visited by the last Cull
+        float cullMs = 0.0f;
+        float updateMs = 0.0f;      // the last build or refit
+    };
+
+    // call after Scene::Update
+    void Update(const Scene &scene)
+    {
+        if (scene.Size() == objectCount && scene.Changed().empty())
+            return;
+        auto start = std::chrono::steady_clock::now();
+        if (scene.Size() != objectCount) {
+            build(scene);
+            for (size_t n = nodes.size(); n-- > 0;)
+                refitNode(scene, (uint32_t) n);
+        } else {
+            refit(scene);
+        }
+        stats.updateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // marks the objects whose box is at least partly inside the frustum of viewProjection
+    void Cull(const glm::mat4 &viewProjection)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::fill(visible.begin(), visible.end(), 0);
+        stats.visible = 0;
+        stats.nodes = 0;
+
+        // the rows of the matrix added and subtracted, -w <= x, y, z <= w
+        glm::vec4 planes[PLANES];
+        for (int axis = 0; axis < 3; axis++) {
+            glm::vec4 row(viewProjection[0][axis], viewProjection[1][axis], viewProjection[2][axis],
+                          viewProjection[3][axis]);
+            glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+            planes[2 * axis] = w + row;
+            planes[2 * axis + 1] = w - row;
+        }
+
+        if (!nodes.empty())
+            stack.push_back(Visit{0, ALL_PLANES});
+        while (!stack.empty()) {
+            Visit visit = stack.back();
+            stack.pop_back();
+            const Node &node = nodes[visit.node];
+            stats.nodes++;
+
+            // lanes outside a plane, and for each plane the lanes wholly inside it
+            int outside = 0;
+            int inside[PLANES] = {};
+            for (int p = 0; p < PLANES; p++)
+                if (visit.planes & (1u << p))
+                    testPlane(node, planes[p], outside, inside[p]);
+
+            for (int lane = 0; lane < 4; lane++) {
+                uint32_t child = node.child[lane];
+                if (child == EMPTY || (outside & (1 << lane)))
+                    continue;
+                uint32_t childPlanes = 0;
+                for (int p = 0; p < PLANES; p++)
+                    if ((visit.planes & (1u << p)) && !(inside[p] & (1 << lane)))
+                        childPlanes |= 1u << p;
+                if (child & OBJECT) {
+                    visible[child & ~OBJECT] = 1;
+                    stats.visible++;
+                } else if (childPlanes == 0) {
+                    // inside every plane, its objects are one run of order
+                    const Node &below = nodes[child];
+                    for (uint32_t i = below.first; i < below.first + below.count; i++)
+                        visible[order[i]] = 1;
+                    stats.visible += below.count;
+                } else {
+                    stack.push_back(Visit{child, childPlanes});
+                }
+            }
+        }
+        stats.culled = objectCount - stats.visible;
+        stats.cullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // one entry per scene object, non zero if the last Cull found it visible
+    const std::vector<uint8_t> &Visible() const
+    {
+        return visible;
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    static const int PLANES = 6;
+    static const uint32_t ALL_PLANES = (1u << PLANES) - 1;
+    // a child with this bit is an object index, without it a node index
+    static const uint32_t OBJECT = 1u << 31;
+    static const uint32_t EMPTY = ~0u;
+
+    // an empty lane has an inverted box, which lies outside every plane
+    struct Node {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        uint32_t child[4];
+        uint32_t first, count;   // the objects below, order[first, first + count)
+    };
+
+    struct Visit {
+        uint32_t node;
+        uint32_t planes;   // the planes the node is not wholly inside of
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> parents;       // of each node, the root's is EMPTY
+    std::vector<uint32_t> objectNodes;   // the node each object is a lane of
+    std::vector<uint32_t> order;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint8_t> visible;
+    std::vector<Visit> stack;
+    unsigned int objectCount = 0;
+    Stats stats;
+
+    // the farthest corner along the plane's normal decides whether the box is outside, the nearest whether it is
+    // wholly inside
+    static void testPlane(const Node &node, const glm::vec4 &plane, int &outside, int &inside)
+    {
+        const float *farX = plane.x >= 0.0f ? node.maxX : node.minX, *nearX = plane.x >= 0.0f ? node.minX : node.maxX;
+        const float *farY = plane.y >= 0.0f ? node.maxY : node.minY, *nearY = plane.y >= 0.0f ? node.minY : node.maxY;
+        const float *farZ = plane.z >= 0.0f ? node.maxZ : node.minZ, *nearZ = plane.z >= 0.0f ? node.minZ : node.maxZ;
+#ifdef LEARNOPENGL_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 a = _mm_set1_ps(plane.x), b = _mm_set1_ps(plane.y), c = _mm_set1_ps(plane.z);
+        const __m128 d = _mm_set1_ps(plane.w);
+        __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(farX)), _mm_mul_ps(b, _mm_loadu_ps(farY))),
+                                        _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(farZ)), d));
+        __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(nearX)), _mm_mul_ps(b, _mm_loadu_ps(nearY))),
+                                         _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(nearZ)), d));
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(farDistance, zero));
+        inside = _mm_movemask_ps(_mm_cmpge_ps(nearDistance, zero));
+#else
+        inside = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            if (plane.x * farX[lane] + plane.y * farY[lane] + plane.z * farZ[lane] + plane.w < 0.0f)
+                outside |= 1 << lane;
+            if (plane.x * nearX[lane] + plane.y * nearY[lane] + plane.z * nearZ[lane] + plane.w >= 0.0f)
+                inside |= 1 << lane;
+        }
+#endif
+    }
+
+    void build(const Scene &scene)
+    {
+        objectCount = scene.Size();
+        visible.assign(objectCount, 0);
+        order.resize(objectCount);
+        centroids.resize(objectCount);
+        for (uint32_t i = 0; i < objectCount; i++) {
+            order[i] = i;
+            centroids[i] = scene.Mins()[i] + scene.Maxs()[i];
+        }
+        objectNodes.resize(objectCount);
+        nodes.clear();
+        parents.clear();
+        nodes.reserve(objectCount / 2 + 1);
+        parents.reserve(objectCount / 2 + 1);
+        if (objectCount > 0)
+            buildNode(0, objectCount, EMPTY);
+    }
+
+    // the objects order[begin, end) in a node of their own. Up to four get a lane each, more are split in two at
+    // the median of the widest axis and each half again. Nodes come after their parent.
+    uint32_t buildNode(uint32_t begin, uint32_t end, uint32_t parent)
+    {
+        uint32_t index = (uint32_t) nodes.size();
+        nodes.emplace_back();
+        parents.push_back(parent);
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        int lane = 0;
+        if (end - begin <= 4) {
+            for (uint32_t i = begin; i < end; i++) {
+                nodes[index].child[lane++] = order[i] | OBJECT;
+                objectNodes[order[i]] = index;
+            }
+        } else {
+            uint32_t middle = split(begin, end);
+            uint32_t parts[5] = {begin, split(begin, middle), middle, split(middle, end), end};
+            for (int part = 0; part < 4; part++) {
+                uint32_t first = parts[part], last = parts[part + 1];
+                if (last - first == 1) {
+                    nodes[index].child[lane++] = order[first] | OBJECT;
+                    objectNodes[order[first]] = index;
+                } else {
+                    uint32_t child = buildNode(first, last, index);
+                    nodes[index].child[lane++] = child;
+                }
+            }
+        }
+        for (; lane < 4; lane++)
+            nodes[index].child[lane] = EMPTY;
+        return index;
+    }
+
+    // the end of the first half, at least one object goes to each
+    uint32_t split(uint32_t begin, uint32_t end)
+    {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (uint32_t i = begin; i < end; i++) {
+            lo = glm::min(lo, centroids[order[i]]);
+            hi = glm::max(hi, centroids[order[i]]);
+        }
+        glm::vec3 size = hi - lo;
+        int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+        uint32_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        return middle;
+    }
+
+    // the nodes of the changed objects and the ones above them. Children come after their parent, so taking the
+    // highest index first every child is done before its parent.
+    void refit(const Scene &scene)
+    {
+        std::priority_queue<uint32_t> dirty;
+        std::vector<uint8_t> queued(nodes.size(), 0);
+        for (unsigned int object : scene.Changed()) {
+            uint32_t node = objectNodes[object];
+            if (!queued[node]) {
+                queued[node] = 1;
+                dirty.push(node);
+            }
+        }
+        while (!dirty.empty()) {
+            uint32_t node = dirty.top();
+            dirty.pop();
+            refitNode(scene, node);
+            uint32_t parent = parents[node];
+            if (parent != EMPTY && !queued[parent]) {
+                queued[parent] = 1;
+                dirty.push(parent);
+            }
+        }
+    }
+
+    void refitNode(const Scene &scene, uint32_t index)
+    {
+        Node &node = nodes[index];
+        for (int lane = 0; lane < 4; lane++) {
+            glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+            uint32_t child = node.child[lane];
+            if (child == EMPTY) {
+            } else if (child & OBJECT) {
+                lo = scene.Mins()[child & ~OBJECT];
+                hi = scene.Maxs()[child & ~OBJECT];
+            } else {
+                const Node &below = nodes[child];
+                for (int i = 0; i < 4; i++) {
+                    lo = glm::min(lo, glm::vec3(below.minX[i], below.minY[i], below.minZ[i]));
+                    hi = glm::max(hi, glm::vec3(below.maxX[i], below.maxY[i], below.maxZ[i]));
+                }
+            }
+            node.minX[lane] = lo.x;
+            node.minY[lane] = lo.y;
+            node.minZ[lane] = lo.z;
+            node.maxX[lane] = hi.x;
+            node.maxY[lane] = hi.y;
+            node.maxZ[lane] = hi.z;
+        }
+    }
+};
+
+#endif
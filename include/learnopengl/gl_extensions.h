@@ -0,0 +1,85 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <cstring>
+
+// glad was generated for the plain GL 3.3 core profile, so entry points from newer
+// versions and extensions are loaded here when the driver provides them.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFN_glMaxShaderCompilerThreads)(GLuint count);
+typedef void (APIENTRYP PFN_glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFN_glProgramBinary)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFN_glProgramParameteri)(GLuint program, GLenum pname, GLint value);
+
+struct GLExtensions {
+    // GL 4.1 / ARB_get_program_binary
+    bool programBinary = false;
+    PFN_glGetProgramBinary GetProgramBinary = nullptr;
+    PFN_glProgramBinary ProgramBinary = nullptr;
+    PFN_glProgramParameteri ProgramParameteri = nullptr;
+    // KHR_parallel_shader_compile (or the ARB version), compile and link status can be polled without blocking
+    bool parallelShaderCompile = false;
+    PFN_glMaxShaderCompilerThreads MaxShaderCompilerThreads = nullptr;
+};
+
+inline GLExtensions &glExtensions()
+{
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool HasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, i);
+        if (extension != nullptr && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void LoadGLExtensions(GLADloadproc load)
+{
+    GLExtensions &ext = glExtensions();
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool gl41 = major > 4 || (major == 4 && minor >= 1);
+
+    if (gl41 || HasGLExtension("GL_ARB_get_program_binary")) {
+        ext.GetProgramBinary = (PFN_glGetProgramBinary) load("glGetProgramBinary");
+        ext.ProgramBinary = (PFN_glProgramBinary) load("glProgramBinary");
+        ext.ProgramParameteri = (PFN_glProgramParameteri) load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ext.programBinary = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && formats > 0;
+    }
+
+    if (HasGLExtension("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (PFN_glMaxShaderCompilerThreads) load("glMaxShaderCompilerThreadsKHR");
+    else if (HasGLExtension("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (PFN_glMaxShaderCompilerThreads) load("glMaxShaderCompilerThreadsARB");
+    if (ext.MaxShaderCompilerThreads) {
+        // let the driver pick how many threads to compile on
+        ext.MaxShaderCompilerThreads(0xFFFFFFFFu);
+        ext.parallelShaderCompile = true;
+    }
+}
+
+#endif
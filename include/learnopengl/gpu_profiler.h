@@ -0,0 +1,117 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// GPU time of the passes of a frame, measured with GL_TIME_ELAPSED queries. Begin() starts a pass and ends the one
+// before it (elapsed time queries cannot nest), EndFrame() closes the frame. Results are read a few frames later so
+// the CPU never waits for the GPU, and are smoothed so they can be read in the overlay.
+class GpuProfiler
+{
+public:
+    struct Timing {
+        std::string name;
+        float ms = 0.0f;
+    };
+
+    GpuProfiler() = default;
+
+    ~GpuProfiler()
+    {
+        for (Frame &frame : frames)
+            if (!frame.queries.empty())
+                glDeleteQueries((GLsizei) frame.queries.size(), frame.queries.data());
+    }
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    void Begin(const char *name)
+    {
+        End();
+        Frame &frame = frames[current];
+        if (frame.used == frame.queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+            frame.names.emplace_back();
+        }
+        frame.names[frame.used] = name;
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.used++]);
+        active = true;
+    }
+
+    void End()
+    {
+        if (!active)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        active = false;
+    }
+
+    void EndFrame()
+    {
+        End();
+        current = (current + 1) % FRAMES_IN_FLIGHT;
+        // the oldest frame is reused now, its results are read first. If the GPU is still behind they are dropped.
+        Frame &frame = frames[current];
+        if (frame.used > 0) {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+                read(frame);
+        }
+        frame.used = 0;
+    }
+
+    // passes of the last frame that could be read, in the order they were drawn
+    const std::vector<Timing> &Timings() const
+    {
+        return timings;
+    }
+
+    float TotalMs() const
+    {
+        float total = 0.0f;
+        for (const Timing &timing : timings)
+            total += timing.ms;
+        return total;
+    }
+
+private:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    struct Frame {
+        std::vector<GLuint> queries;
+        std::vector<const char *> names;
+        size_t used = 0;
+    };
+
+    Frame frames[FRAMES_IN_FLIGHT];
+    unsigned int current = 0;
+    bool active = false;
+    std::vector<Timing> timings;
+
+    void read(const Frame &frame)
+    {
+        // passes that were not drawn in this frame drop out, the others keep their average
+        std::vector<Timing> previous;
+        previous.swap(timings);
+        for (size_t i = 0; i < frame.used; i++) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &ns);
+            Timing timing;
+            timing.name = frame.names[i];
+            timing.ms = ns / 1.0e6f;
+            for (const Timing &old : previous)
+                if (old.name == timing.name)
+                    timing.ms = 0.9f * old.ms + 0.1f * timing.ms;
+            timings.push_back(timing);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef IRRADIANCE_VOLUME_H
+#define IRRADIANCE_VOLUME_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/lightmap_baker.h>
+#include <learnopengl/uniform_blocks.h>
+
+#include <vector>
+#include <algorithm>
+
+// the texture unit the probe grid is bound to for as long as it lives
+const GLuint IRRADIANCE_VOLUME_UNIT = 6;
+
+// RGBA texels that hold the 9 RGB coefficients of a probe, 27 floats and one unused
+const int PROBE_TEXELS = 7;
+
+// The irradiance probes of a LightmapBaker grid on the GPU. The probes keep one set of spherical harmonics per
+// layer, Update() adds the layers up with the weights of the lightmaps whenever a switch flips, so the shader reads
+// the sum for the lamps that are on. The texture is the grid stacked PROBE_TEXELS times along z, slab i holds
+// texel i of every probe, and hardware filtering blends the coefficients of the eight probes around a point.
+class IrradianceVolume
+{
+public:
+    IrradianceVolume() = default;
+
+    ~IrradianceVolume()
+    {
+        glDeleteTextures(1, &texture);
+    }
+
+    IrradianceVolume(const IrradianceVolume &) = delete;
+    IrradianceVolume &operator=(const IrradianceVolume &) = delete;
+
+    // takes the probes of a finished bake
+    void Set(const LightmapBaker &baker)
+    {
+        count = baker.ProbeCount();
+        coefficients = baker.ProbeCoefficients();
+        size_t probes = (size_t) count.x * count.y * count.z;
+        layers = probes ? (unsigned int) (coefficients.size() / (probes * PROBE_SH_COEFFICIENTS)) : 0;
+        if (layers == 0) {
+            Clear();
+            return;
+        }
+        if (texture == 0)
+            glGenTextures(1, &texture);
+        glActiveTexture(GL_TEXTURE0 + IRRADIANCE_VOLUME_UNIT);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, count.x, count.y, count.z * PROBE_TEXELS, 0, GL_RGBA, GL_FLOAT,
+                     nullptr);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+        uploaded = false;
+    }
+
+    // drops the probes until the next Set
+    void Clear()
+    {
+        coefficients.clear();
+        layers = 0;
+        uploaded = false;
+    }
+
+    // adds up the layers with the frame's lightmapWeights, the texture is only written when they changed
+    void Update(const glm::vec4 weights[MAX_LIGHTMAP_LAYERS / 4])
+    {
+        if (layers == 0)
+            return;
+        std::vector<float> current(layers);
+        for (unsigned int layer = 0; layer < layers; layer++)
+            current[layer] = weights[layer / 4][layer % 4];
+        if (uploaded && current == uploadedWeights)
+            return;
+
+        size_t probes = (size_t) count.x * count.y * count.z;
+        size_t slab = probes * 4;
+        std::vector<float> texels(slab * PROBE_TEXELS, 0.0f);
+        for (size_t probe = 0; probe < probes; probe++) {
+            float sum[PROBE_TEXELS * 4] = {};
+            const glm::vec3 *sh = &coefficients[probe * layers * PROBE_SH_COEFFICIENTS];
+            for (unsigned int layer = 0; layer < layers; layer++) {
+                if (current[layer] == 0.0f)
+                    continue;
+                for (unsigned int i = 0; i < PROBE_SH_COEFFICIENTS; i++)
+                    for (int c = 0; c < 3; c++)
+                        sum[i * 3 + c] += current[layer] * sh[layer * PROBE_SH_COEFFICIENTS + i][c];
+            }
+            for (int t = 0; t < PROBE_TEXELS; t++)
+                std::copy(sum + t * 4, sum + t * 4 + 4, texels.begin() + t * slab + probe * 4);
+        }
+        glActiveTexture(GL_TEXTURE0 + IRRADIANCE_VOLUME_UNIT);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, count.x, count.y, count.z * PROBE_TEXELS, GL_RGBA, GL_FLOAT,
+                        texels.data());
+        glActiveTexture(GL_TEXTURE0);
+        uploadedWeights.swap(current);
+        uploaded = true;
+    }
+
+    // the grid holds probes and is bound
+    bool Ready() const
+    {
+        return uploaded;
+    }
+
+private:
+    GLuint texture = 0;
+    glm::ivec3 count = glm::ivec3(0);
+    unsigned int layers = 0;
+    std::vector<glm::vec3> coefficients;
+    std::vector<float> uploadedWeights;
+    bool uploaded = false;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef LIGHT_RADIUS_H
+#define LIGHT_RADIUS_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// a light is out of reach once it adds less than one 8 bit step
+const float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+// distance at which the attenuation times the light's brightest channel drops below LIGHT_CUTOFF
+inline float LightRadius(float constant, float linear, float quadratic, float intensity)
+{
+    float c = constant - intensity / LIGHT_CUTOFF;
+    if (c >= 0.0f)
+        return 0.0f;
+    if (quadratic > 0.0f)
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+    if (linear > 0.0f)
+        return -c / linear;
+    return FLT_MAX;
+}
+
+inline float MaxChannel(const glm::vec3 &color)
+{
+    return std::max(color.x, std::max(color.y, color.z));
+}
+
+// Gives a PointLightData or SpotLightData a finite radius of influence. The shaders multiply the attenuation
+// with the window (1 - (distance / radius)^4)^2, which reaches exactly zero at the radius, so a light culled by
+// its radius is a light that adds nothing. An inverseRadius of 0 leaves the light unbounded.
+template<typename Light>
+void SetLightRadius(Light &light)
+{
+    float intensity = MaxChannel(light.ambient) + MaxChannel(light.diffuse) + MaxChannel(light.specular);
+    float radius = LightRadius(light.constant, light.linear, light.quadratic, intensity);
+    light.inverseRadius = radius == FLT_MAX ? 0.0f : radius > 0.0f ? 1.0f / radius : FLT_MAX;
+}
+
+// the radius SetLightRadius gave the light, FLT_MAX for an unbounded one
+template<typename Light>
+float InfluenceRadius(const Light &light)
+{
+    return light.inverseRadius > 0.0f ? 1.0f / light.inverseRadius : FLT_MAX;
+}
+
+#endif
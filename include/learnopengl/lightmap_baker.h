@@ -0,0 +1,721 @@
+#ifndef LIGHTMAP_BAKER_H
+#define LIGHTMAP_BAKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/uniform_blocks.h>
+#include <common.h>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+// the texture unit the lightmap of the surface being drawn is bound to
+const GLuint LIGHTMAP_UNIT = 7;
+
+// finished bakes, keyed by a hash of everything they were baked from like the program cache
+const char *const LIGHTMAP_CACHE_DIR = "lightmap_cache";
+const uint32_t LIGHTMAP_CACHE_VERSION = 2;
+
+// rays start this far off the surface so they do not hit the triangle they leave
+const float LIGHTMAP_RAY_OFFSET = 1e-3f;
+const float LIGHTMAP_RAY_LENGTH = 1e4f;
+
+// coefficients of the L2 spherical harmonics a probe stores per layer
+const unsigned int PROBE_SH_COEFFICIENTS = 9;
+
+struct LightmapSettings {
+    int samples = 64;   // indirect paths per texel
+    int bounces = 2;
+    int probeSamples = 256;   // directions per irradiance probe
+};
+
+// Bakes static lights into lightmaps on the CPU. The scene is given as triangles in world space, the ones that
+// belong to a lightmapped surface carry the coordinates of its texels. Every light is baked into one layer of the
+// lightmaps, lights that are switched together share a layer, so the layers can be added up in the shader in any
+// combination. A texel holds the light that falls on it the way 2.model_lighting.fs computes it, ambient and
+// diffuse with the light's attenuation and hard shadows, plus the light that reaches it over diffuse bounces off
+// the rest of the scene. The surface's own albedo is left out, the shader multiplies its diffuse map in.
+//
+// A grid of irradiance probes can be baked along with the maps for objects that have no lightmap. A probe holds,
+// per layer, the L2 spherical harmonics of the irradiance at its center: the light bounced off the scene towards
+// it convolved with the cosine lobe, plus the lights' ambient terms, which do not depend on the direction.
+//
+// Start() bakes on a pool of threads that take one row of texels at a time and query a shared TriangleBVH, the
+// paths of a texel are traced once for all layers, the probes of a grid row are one more row of work.
+// Update() uploads the maps once every row is done. A bake is
+// stored in LIGHTMAP_CACHE_DIR and loaded from there as long as nothing it was baked from has changed.
+class LightmapBaker
+{
+public:
+    struct Stats {
+        unsigned int surfaces = 0;
+        unsigned int layers = 0;
+        unsigned int texels = 0;       // covered by the surfaces' triangles
+        unsigned int probes = 0;
+        unsigned int triangles = 0;
+        unsigned int threads = 0;
+        float progress = 0.0f;         // of the rows of texels, from 0 to 1
+        float seconds = 0.0f;          // how long the bake took
+        bool cached = false;           // the maps were loaded from the cache instead
+    };
+
+    LightmapBaker(unsigned int threads = std::thread::hardware_concurrency())
+        : threadCount(std::max(1u, threads))
+    {
+    }
+
+    ~LightmapBaker()
+    {
+        Clear();
+    }
+
+    LightmapBaker(const LightmapBaker &) = delete;
+    LightmapBaker &operator=(const LightmapBaker &) = delete;
+
+    // a lightmap of resolution x resolution texels, triangles are added to it with AddGeometry
+    unsigned int AddSurface(int resolution)
+    {
+        surfaces.emplace_back();
+        surfaces.back().resolution = resolution;
+        return (unsigned int) surfaces.size() - 1;
+    }
+
+    // triangles that block and reflect light, with model placing the vertices in the world. Given a surface they
+    // are lightmapped too, the LightmapCoords of the vertices say where their texels are.
+    void AddGeometry(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                     const glm::mat4 &model, const glm::vec3 &albedo, int surface = -1)
+    {
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (size_t j = 0; j < 3; j++) {
+                const Vertex &vertex = vertices[indices[i + j]];
+                positions.push_back(glm::vec3(model * glm::vec4(vertex.Position, 1.0f)));
+                glm::vec3 normal = normalMatrix * vertex.Normal;
+                float length = glm::length(normal);
+                normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f));
+                coords.push_back(vertex.LightmapCoords);
+            }
+            albedos.push_back(albedo);
+            surfaceOf.push_back(surface);
+        }
+    }
+
+    // count probes spread over the box from min to max, each in the middle of its cell so none sits on the box's
+    // faces. The grid is baked with the next Start().
+    void SetProbeGrid(const glm::vec3 &min, const glm::vec3 &max, const glm::ivec3 &count)
+    {
+        probeMin = min;
+        probeMax = max;
+        probeCount = glm::max(count, glm::ivec3(0));
+    }
+
+    // a light baked into the given layer, its shadowMap and altSpecularSwizzle do not matter here
+    void AddLight(const PointLightData &light, unsigned int layer)
+    {
+        Light baked = {};
+        baked.position = light.position;
+        baked.ambient = light.ambient;
+        baked.diffuse = light.diffuse;
+        baked.constant = light.constant;
+        baked.linear = light.linear;
+        baked.quadratic = light.quadratic;
+        baked.inverseRadius = light.inverseRadius;
+        baked.layer = layer;
+        lights.push_back(baked);
+    }
+
+    void AddLight(const SpotLightData &light, unsigned int layer)
+    {
+        Light baked = {};
+        baked.position = light.position;
+        baked.direction = glm::normalize(light.direction);
+        baked.ambient = light.ambient;
+        baked.diffuse = light.diffuse;
+        baked.constant = light.constant;
+        baked.linear = light.linear;
+        baked.quadratic = light.quadratic;
+        baked.inverseRadius = light.inverseRadius;
+        baked.cutOff = light.cutOff;
+        baked.outerCutOff = light.outerCutOff;
+        baked.spot = 1;
+        baked.layer = layer;
+        lights.push_back(baked);
+    }
+
+    // bakes everything added so far, in the background unless the cache has the result
+    void Start(const LightmapSettings &settings = LightmapSettings())
+    {
+        cancel();
+        for (Surface &surface : surfaces) {
+            glDeleteTextures(1, &surface.texture);
+            surface.texture = 0;
+        }
+        this->settings = settings;
+        layers = 0;
+        for (const Light &light : lights)
+            layers = std::max(layers, light.layer + 1);
+        layers = std::min(std::max(layers, 1u), MAX_LIGHTMAP_LAYERS);
+        stats = Stats();
+        stats.surfaces = (unsigned int) surfaces.size();
+        stats.layers = layers;
+        stats.triangles = (unsigned int) albedos.size();
+        stats.threads = threadCount;
+        stats.probes = (unsigned int) (probeCount.x * probeCount.y * probeCount.z);
+
+        rowStarts.clear();
+        totalRows = 0;
+        for (unsigned int s = 0; s < surfaces.size(); s++) {
+            rasterize(s);
+            rowStarts.push_back(totalRows);
+            totalRows += (unsigned int) surfaces[s].resolution;
+            for (const Texel &texel : surfaces[s].texels)
+                stats.texels += texel.covered ? 1 : 0;
+        }
+        surfaceRows = totalRows;
+        probes.assign((size_t) stats.probes * layers * PROBE_SH_COEFFICIENTS, glm::vec3(0.0f));
+        if (stats.probes > 0)
+            totalRows += (unsigned int) (probeCount.y * probeCount.z);
+        key = inputKey();
+        nextRow = 0;
+        rowsDone = 0;
+        bakeSeconds = 0.0f;
+        if (loadCache()) {
+            stats.cached = true;
+            rowsDone = totalRows;
+            finished = true;
+            return;
+        }
+
+        bvh.Build(positions);
+        started = std::chrono::steady_clock::now();
+        if (totalRows == 0) {
+            finish();
+            return;
+        }
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&LightmapBaker::workerLoop, this);
+    }
+
+    // stops a bake in progress, frees the maps and forgets every surface, triangle and light
+    void Clear()
+    {
+        cancel();
+        for (Surface &surface : surfaces)
+            glDeleteTextures(1, &surface.texture);
+        surfaces.clear();
+        positions.clear();
+        normals.clear();
+        coords.clear();
+        albedos.clear();
+        surfaceOf.clear();
+        lights.clear();
+        probes.clear();
+        probeCount = glm::ivec3(0);
+        stats = Stats();
+    }
+
+    // uploads the maps once the bake is done, call once per frame. True in the frame they become ready.
+    bool Update()
+    {
+        if (uploaded || !finished)
+            return false;
+        joinWorkers();
+        for (Surface &surface : surfaces) {
+            glGenTextures(1, &surface.texture);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, surface.texture);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB16F, surface.resolution, surface.resolution, layers, 0,
+                         GL_RGB, GL_FLOAT, surface.light.data());
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            // the GL copy is all that is needed from now on
+            std::vector<glm::vec3>().swap(surface.light);
+            std::vector<Texel>().swap(surface.texels);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        uploaded = true;
+        return true;
+    }
+
+    // the maps are uploaded and can be bound
+    bool Ready() const
+    {
+        return uploaded;
+    }
+
+    void Bind(unsigned int surface) const
+    {
+        glActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, surfaces[surface].texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    glm::ivec3 ProbeCount() const
+    {
+        return probeCount;
+    }
+
+    // the baked probes once Ready(), probe after probe along x, then y, then z. A probe has the
+    // PROBE_SH_COEFFICIENTS of its first layer, then the ones of the next layer and so on.
+    const std::vector<glm::vec3> &ProbeCoefficients() const
+    {
+        return probes;
+    }
+
+    Stats GetStats() const
+    {
+        Stats current = stats;
+        current.progress = totalRows ? (float) rowsDone.load() / (float) totalRows : 1.0f;
+        if (finished)
+            current.seconds = bakeSeconds;
+        else if (!workers.empty())
+            current.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - started).count();
+        return current;
+    }
+
+private:
+    struct Light {
+        glm::vec3 position;
+        glm::vec3 direction;
+        glm::vec3 ambient;
+        glm::vec3 diffuse;
+        float constant, linear, quadratic, inverseRadius;
+        float cutOff, outerCutOff;
+        uint32_t spot;
+        uint32_t layer;
+    };
+
+    struct Texel {
+        glm::vec3 position;
+        glm::vec3 normal;
+        bool covered = false;
+    };
+
+    struct Surface {
+        int resolution = 0;
+        std::vector<Texel> texels;
+        std::vector<glm::vec3> light;   // layers * resolution * resolution, one layer after the other
+        GLuint texture = 0;
+    };
+
+    // texels the unlit border around a chart is filled with, so filtering never reads outside it
+    static const int DILATE_TEXELS = 2;
+
+    unsigned int threadCount;
+    LightmapSettings settings;
+    unsigned int layers = 1;
+
+    // three entries per triangle in positions, normals and coords
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> coords;
+    std::vector<glm::vec3> albedos;
+    std::vector<int> surfaceOf;
+    std::vector<Light> lights;
+    std::vector<Surface> surfaces;
+    TriangleBVH bvh;
+    glm::vec3 probeMin = glm::vec3(0.0f);
+    glm::vec3 probeMax = glm::vec3(0.0f);
+    glm::ivec3 probeCount = glm::ivec3(0);
+    std::vector<glm::vec3> probes;
+
+    std::vector<std::thread> workers;
+    std::vector<unsigned int> rowStarts;
+    unsigned int totalRows = 0;
+    unsigned int surfaceRows = 0;   // the rows after these are rows of probes
+    std::atomic<unsigned int> nextRow{0};
+    std::atomic<unsigned int> rowsDone{0};
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> finished{false};
+    std::atomic<float> bakeSeconds{0.0f};
+    bool uploaded = false;
+    uint64_t key = 0;
+    std::chrono::steady_clock::time_point started;
+    Stats stats;
+
+    void cancel()
+    {
+        cancelled = true;
+        joinWorkers();
+        cancelled = false;
+        finished = false;
+        uploaded = false;
+    }
+
+    void joinWorkers()
+    {
+        for (std::thread &worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    // finds the triangle and the point on it each texel center of the surface lies on
+    void rasterize(unsigned int s)
+    {
+        Surface &surface = surfaces[s];
+        int resolution = surface.resolution;
+        surface.texels.assign((size_t) resolution * resolution, Texel());
+        surface.light.assign((size_t) resolution * resolution * layers, glm::vec3(0.0f));
+        for (size_t t = 0; t < surfaceOf.size(); t++) {
+            if (surfaceOf[t] != (int) s)
+                continue;
+            glm::vec2 a = coords[3 * t] * (float) resolution;
+            glm::vec2 b = coords[3 * t + 1] * (float) resolution;
+            glm::vec2 c = coords[3 * t + 2] * (float) resolution;
+            float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+            if (std::abs(area) < 1e-12f)
+                continue;
+            int x0 = std::max(0, (int) std::floor(std::min(a.x, std::min(b.x, c.x))));
+            int y0 = std::max(0, (int) std::floor(std::min(a.y, std::min(b.y, c.y))));
+            int x1 = std::min(resolution - 1, (int) std::ceil(std::max(a.x, std::max(b.x, c.x))));
+            int y1 = std::min(resolution - 1, (int) std::ceil(std::max(a.y, std::max(b.y, c.y))));
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++) {
+                    glm::vec2 p((float) x + 0.5f, (float) y + 0.5f);
+                    // barycentric weights of b and c
+                    float wb = ((p.x - a.x) * (c.y - a.y) - (c.x - a.x) * (p.y - a.y)) / area;
+                    float wc = ((b.x - a.x) * (p.y - a.y) - (p.x - a.x) * (b.y - a.y)) / area;
+                    if (wb < 0.0f || wc < 0.0f || wb + wc > 1.0f)
+                        continue;
+                    Texel &texel = surface.texels[(size_t) y * resolution + x];
+                    float wa = 1.0f - wb - wc;
+                    texel.position = wa * positions[3 * t] + wb * positions[3 * t + 1] + wc * positions[3 * t + 2];
+                    texel.normal = glm::normalize(wa * normals[3 * t] + wb * normals[3 * t + 1]
+                                                  + wc * normals[3 * t + 2]);
+                    texel.covered = true;
+                }
+        }
+    }
+
+    void workerLoop()
+    {
+        std::vector<glm::vec3> sums(layers);
+        for (;;) {
+            unsigned int row = nextRow++;
+            if (row >= totalRows || cancelled)
+                return;
+            if (row >= surfaceRows) {
+                bakeProbeRow(row - surfaceRows);
+                if (++rowsDone == totalRows)
+                    finish();
+                continue;
+            }
+            unsigned int s = (unsigned int) (std::upper_bound(rowStarts.begin(), rowStarts.end(), row)
+                                             - rowStarts.begin()) - 1;
+            Surface &surface = surfaces[s];
+            int y = (int) (row - rowStarts[s]);
+            size_t layerSize = (size_t) surface.resolution * surface.resolution;
+            for (int x = 0; x < surface.resolution; x++) {
+                size_t index = (size_t) y * surface.resolution + x;
+                const Texel &texel = surface.texels[index];
+                if (!texel.covered)
+                    continue;
+                bakeTexel(texel, (uint32_t) (index * 2654435761u) ^ (s * 40503u), sums);
+                for (unsigned int layer = 0; layer < layers; layer++)
+                    surface.light[layer * layerSize + index] = sums[layer];
+            }
+            if (++rowsDone == totalRows)
+                finish();
+        }
+    }
+
+    // the light of every layer at the texel: the lights themselves, then paths that bounce off the scene
+    void bakeTexel(const Texel &texel, uint32_t seed, std::vector<glm::vec3> &sums) const
+    {
+        std::fill(sums.begin(), sums.end(), glm::vec3(0.0f));
+        for (const Light &light : lights)
+            if (light.layer < layers)
+                sums[light.layer] += direct(light, texel.position, texel.normal, true);
+
+        if (settings.samples <= 0 || settings.bounces <= 0)
+            return;
+        // with cosine weighted directions the mean of the light coming back is the irradiance in the shader's units
+        float weight = 1.0f / (float) settings.samples;
+        uint32_t state = seed;
+        glm::vec3 origin = texel.position + texel.normal * LIGHTMAP_RAY_OFFSET;
+        for (int sample = 0; sample < settings.samples; sample++) {
+            glm::vec3 direction = cosineDirection(texel.normal, random(state), random(state));
+            trace(origin, direction, glm::vec3(weight), state, sums);
+        }
+    }
+
+    // adds the light that comes back along the ray over settings.bounces diffuse bounces to sums, scaled by
+    // throughput and the albedo of every surface on the way
+    void trace(glm::vec3 origin, glm::vec3 direction, glm::vec3 throughput, uint32_t &state,
+               std::vector<glm::vec3> &sums) const
+    {
+        for (int bounce = 0; bounce < settings.bounces; bounce++) {
+            TriangleBVH::Hit hit;
+            if (!bvh.Intersect(origin, direction, LIGHTMAP_RAY_LENGTH, hit))
+                return;
+            size_t t = hit.triangle;
+            glm::vec3 position = origin + direction * hit.t;
+            glm::vec3 normal = glm::normalize((1.0f - hit.u - hit.v) * normals[3 * t] + hit.u * normals[3 * t + 1]
+                                              + hit.v * normals[3 * t + 2]);
+            if (glm::dot(normal, direction) > 0.0f)
+                normal = -normal;
+            throughput *= albedos[t];
+            // the ambient terms stand in for bounced light already, they are not bounced again
+            for (const Light &light : lights)
+                if (light.layer < layers)
+                    sums[light.layer] += throughput * direct(light, position, normal, false);
+            if (bounce + 1 < settings.bounces) {
+                origin = position + normal * LIGHTMAP_RAY_OFFSET;
+                direction = cosineDirection(normal, random(state), random(state));
+            }
+        }
+    }
+
+    // the probes of one row of the grid along x
+    void bakeProbeRow(unsigned int row)
+    {
+        int y = (int) row % probeCount.y, z = (int) row / probeCount.y;
+        std::vector<glm::vec3> radiance(layers);
+        for (int x = 0; x < probeCount.x; x++) {
+            size_t index = ((size_t) z * probeCount.y + y) * probeCount.x + x;
+            glm::vec3 position = probeMin + (glm::vec3(x, y, z) + 0.5f) / glm::vec3(probeCount) * (probeMax - probeMin);
+            bakeProbe(position, (uint32_t) (index * 2654435761u) ^ 0x9e3779b9u, radiance,
+                      &probes[index * layers * PROBE_SH_COEFFICIENTS]);
+        }
+    }
+
+    // projects the light coming in from a spread of directions onto the spherical harmonics, then turns the
+    // radiance into irradiance by convolving every band with the cosine lobe. The lobe is divided by pi like the
+    // texels, so the irradiance in a direction is what the shader multiplies the diffuse map with.
+    void bakeProbe(const glm::vec3 &position, uint32_t seed, std::vector<glm::vec3> &radiance, glm::vec3 *sh) const
+    {
+        int samples = std::max(settings.probeSamples, 1);
+        float weight = 12.5663706144f / (float) samples;   // the solid angle of each direction
+        uint32_t state = seed;
+        float basis[PROBE_SH_COEFFICIENTS];
+        for (int sample = 0; sample < samples; sample++) {
+            // a Fibonacci spiral covers the sphere evenly without clumps
+            float z = 1.0f - (2.0f * (float) sample + 1.0f) / (float) samples;
+            float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float phi = 2.39996322973f * (float) sample;
+            glm::vec3 direction(r * std::cos(phi), r * std::sin(phi), z);
+            std::fill(radiance.begin(), radiance.end(), glm::vec3(0.0f));
+            trace(position, direction, glm::vec3(1.0f), state, radiance);
+            shBasis(direction, basis);
+            for (unsigned int layer = 0; layer < layers; layer++)
+                for (unsigned int i = 0; i < PROBE_SH_COEFFICIENTS; i++)
+                    sh[layer * PROBE_SH_COEFFICIENTS + i] += radiance[layer] * (basis[i] * weight);
+        }
+        // the cosine lobe's bands over pi: 1, 2/3 and 1/4
+        const float band[PROBE_SH_COEFFICIENTS] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f,
+                                                   0.25f, 0.25f, 0.25f};
+        for (unsigned int layer = 0; layer < layers; layer++)
+            for (unsigned int i = 0; i < PROBE_SH_COEFFICIENTS; i++)
+                sh[layer * PROBE_SH_COEFFICIENTS + i] *= band[i];
+        // the same in every direction, so only the constant basis function carries it
+        for (const Light &light : lights)
+            if (light.layer < layers)
+                sh[light.layer * PROBE_SH_COEFFICIENTS] += light.ambient * (attenuation(light, position) / 0.282095f);
+    }
+
+    // the real spherical harmonics up to l = 2, in the order the shader evaluates them
+    static void shBasis(const glm::vec3 &d, float *basis)
+    {
+        basis[0] = 0.282095f;
+        basis[1] = 0.488603f * d.y;
+        basis[2] = 0.488603f * d.z;
+        basis[3] = 0.488603f * d.x;
+        basis[4] = 1.092548f * d.x * d.y;
+        basis[5] = 1.092548f * d.y * d.z;
+        basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+        basis[7] = 1.092548f * d.x * d.z;
+        basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+    }
+
+    // 2.model_lighting.fs without the specular term, shadowed by the scene instead of a shadow map
+    glm::vec3 direct(const Light &light, const glm::vec3 &position, const glm::vec3 &normal, bool ambient) const
+    {
+        float attenuation = this->attenuation(light, position);
+        if (attenuation <= 0.0f)
+            return glm::vec3(0.0f);
+        glm::vec3 toLight = light.position - position;
+        float distance = glm::length(toLight);
+        glm::vec3 lightDir = toLight / distance;
+        glm::vec3 result = ambient ? light.ambient * attenuation : glm::vec3(0.0f);
+        float diff = glm::dot(normal, lightDir);
+        glm::vec3 origin = position + normal * LIGHTMAP_RAY_OFFSET;
+        if (diff > 0.0f && !bvh.Occluded(origin, lightDir, distance - 2.0f * LIGHTMAP_RAY_OFFSET))
+            result += light.diffuse * diff * attenuation;
+        return result;
+    }
+
+    // the distance attenuation with the radius window, and the spot cone for spot lights
+    static float attenuation(const Light &light, const glm::vec3 &position)
+    {
+        glm::vec3 toLight = light.position - position;
+        float distance = glm::length(toLight);
+        if (distance <= LIGHTMAP_RAY_OFFSET)
+            return 0.0f;
+        float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+        float x = distance * light.inverseRadius;
+        float window = glm::clamp(1.0f - x * x * x * x, 0.0f, 1.0f);
+        attenuation *= window * window;
+        if (light.spot) {
+            float theta = glm::dot(toLight / distance, -light.direction);
+            attenuation *= glm::clamp((theta - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0f, 1.0f);
+        }
+        return attenuation;
+    }
+
+    // run by the worker that finishes the last row
+    void finish()
+    {
+        for (Surface &surface : surfaces)
+            dilate(surface);
+        saveCache();
+        bakeSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - started).count();
+        finished = true;
+    }
+
+    // spreads the texels at the edge of each chart outwards
+    void dilate(Surface &surface) const
+    {
+        int resolution = surface.resolution;
+        size_t layerSize = (size_t) resolution * resolution;
+        std::vector<char> filled(layerSize), next;
+        for (size_t i = 0; i < layerSize; i++)
+            filled[i] = surface.texels[i].covered;
+        for (int pass = 0; pass < DILATE_TEXELS; pass++) {
+            next = filled;
+            for (int y = 0; y < resolution; y++)
+                for (int x = 0; x < resolution; x++) {
+                    size_t index = (size_t) y * resolution + x;
+                    if (filled[index])
+                        continue;
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= resolution || ny >= resolution)
+                                continue;
+                            size_t neighbour = (size_t) ny * resolution + nx;
+                            if (!filled[neighbour])
+                                continue;
+                            for (size_t offset = 0; offset < surface.light.size(); offset += layerSize)
+                                surface.light[offset + index] += surface.light[offset + neighbour];
+                            count++;
+                        }
+                    if (count == 0)
+                        continue;
+                    for (size_t offset = 0; offset < surface.light.size(); offset += layerSize)
+                        surface.light[offset + index] /= (float) count;
+                    next[index] = 1;
+                }
+            filled.swap(next);
+        }
+    }
+
+    static float random(uint32_t &state)
+    {
+        // PCG hash
+        state = state * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        word = (word >> 22u) ^ word;
+        return (float) (word >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // a direction around normal with a density proportional to the cosine of the angle to it
+    static glm::vec3 cosineDirection(const glm::vec3 &normal, float u1, float u2)
+    {
+        float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + normal.z);
+        float b = normal.x * normal.y * a;
+        glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+        glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+        float r = std::sqrt(u1), phi = 6.28318530718f * u2;
+        return tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + normal * std::sqrt(1.0f - u1);
+    }
+
+    uint64_t inputKey() const
+    {
+        uint64_t hash = HashBytes((const char *) &LIGHTMAP_CACHE_VERSION, sizeof(LIGHTMAP_CACHE_VERSION));
+        hash = HashBytes((const char *) positions.data(), positions.size() * sizeof(glm::vec3), hash);
+        hash = HashBytes((const char *) normals.data(), normals.size() * sizeof(glm::vec3), hash);
+        hash = HashBytes((const char *) coords.data(), coords.size() * sizeof(glm::vec2), hash);
+        hash = HashBytes((const char *) albedos.data(), albedos.size() * sizeof(glm::vec3), hash);
+        hash = HashBytes((const char *) surfaceOf.data(), surfaceOf.size() * sizeof(int), hash);
+        hash = HashBytes((const char *) lights.data(), lights.size() * sizeof(Light), hash);
+        for (const Surface &surface : surfaces)
+            hash = HashBytes((const char *) &surface.resolution, sizeof(int), hash);
+        hash = HashBytes((const char *) &probeMin, sizeof(probeMin), hash);
+        hash = HashBytes((const char *) &probeMax, sizeof(probeMax), hash);
+        hash = HashBytes((const char *) &probeCount, sizeof(probeCount), hash);
+        hash = HashBytes((const char *) &settings, sizeof(settings), hash);
+        return HashBytes((const char *) &layers, sizeof(layers), hash);
+    }
+
+    std::string cachePath() const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+        return std::string(LIGHTMAP_CACHE_DIR) + "/" + name;
+    }
+
+    struct CacheHeader {
+        char magic[4];
+        uint32_t surfaces;
+        uint32_t layers;
+        uint32_t probes;
+        uint64_t key;
+    };
+
+    bool loadCache()
+    {
+        std::ifstream in(cachePath(), std::ios::binary);
+        if (!in)
+            return false;
+        CacheHeader header;
+        if (!in.read((char *) &header, sizeof(header)) || memcmp(header.magic, "LMAP", 4) != 0
+            || header.key != key || header.surfaces != surfaces.size() || header.layers != layers
+            || header.probes != stats.probes)
+            return false;
+        for (Surface &surface : surfaces)
+            if (!in.read((char *) surface.light.data(), surface.light.size() * sizeof(glm::vec3)))
+                return false;
+        return (bool) in.read((char *) probes.data(), probes.size() * sizeof(glm::vec3));
+    }
+
+    void saveCache() const
+    {
+        mkdir(LIGHTMAP_CACHE_DIR, 0755);
+        // write to a temporary file first so a crash never leaves a truncated entry behind
+        std::string path = cachePath();
+        std::string temporary = path + ".tmp";
+        {
+            CacheHeader header = {{'L', 'M', 'A', 'P'}, (uint32_t) surfaces.size(), layers, stats.probes, key};
+            std::ofstream out(temporary, std::ios::binary);
+            out.write((const char *) &header, sizeof(header));
+            for (const Surface &surface : surfaces)
+                out.write((const char *) surface.light.data(), surface.light.size() * sizeof(glm::vec3));
+            out.write((const char *) probes.data(), probes.size() * sizeof(glm::vec3));
+            if (!out) {
+                std::cout << "ERROR::LIGHTMAP_BAKER:: cannot write " << temporary << std::endl;
+                return;
+            }
+        }
+        std::rename(temporary.c_str(), path.c_str());
+    }
+};
+
+#endif
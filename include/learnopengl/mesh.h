@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
 
 #include <string>
 #include <vector>
@@ -23,6 +24,8 @@ struct Vertex {
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
+    // lightmap coordinates, the second texture coordinate set of the model file
+    glm::vec2 LightmapCoords;
 };
 
 
@@ -31,6 +34,8 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    // a diffuse texture with the specular map in its alpha, path is then the full PackedTextureName
+    bool packedSpecular = false;
 };
 
 class Mesh {
@@ -42,29 +47,33 @@ public:
 
     unsigned int VAO;
     std::string glslIdentifierPrefix;
+    unsigned int features = 0;   // MaterialFeature bits, selects the shader variant the mesh is drawn with
+    bool hasLightmapCoords = false;   // the model file gave the vertices a second texture coordinate set
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        SetShaderTextureNamePrefix("");
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // sets the prefix of the sampler uniform names (e.g. "material.") and hashes the names once
+    void SetShaderTextureNamePrefix(const std::string &prefix)
     {
-        // bind appropriate textures
+        glslIdentifierPrefix = prefix;
+        samplerNames.clear();
+        features = 0;
+        // retrieve texture number (the N in diffuse_textureN)
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
             if(name == "texture_diffuse")
@@ -75,9 +84,32 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
+            if(textures[i].packedSpecular)
+                features |= HAS_SPECULAR_MAP | PACKED_SPECULAR;
+            else if(name == "texture_specular")
+                features |= HAS_SPECULAR_MAP;
+            else if(name == "texture_normal")
+                features |= HAS_NORMAL_MAP;
+            string uniform = glslIdentifierPrefix + name + number;
+            samplerNames.push_back(UniformName{HashUniformName(uniform.data(), uniform.size())});
+        }
+    }
+
+    // the sampler uniform of each texture, as Draw sets them
+    const vector<UniformName> &SamplerNames() const
+    {
+        return samplerNames;
+    }
 
+    // render the mesh
+    void Draw(Shader &shader)
+    {
+        // bind appropriate textures
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
+            shader.setInt(samplerNames[i], i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
@@ -93,9 +125,19 @@ public:
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // frees the buffer objects, meshes are copied around by value so this is not done in a destructor
+    void Release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
 private:
     // render data
     unsigned int VBO, EBO;
+    vector<UniformName> samplerNames;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -132,6 +174,9 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // vertex lightmap coords
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
 
         glBindVertexArray(0);
     }
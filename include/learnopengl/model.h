@@ -18,11 +18,42 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <memory>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
 using namespace std;
 
+// decoded pixels of a texture file; decoding touches no GL state so it may run on a worker thread
+struct TextureImage {
+    int width = 0, height = 0, nrComponents = 0;
+    shared_ptr<unsigned char> data;
+};
+
+TextureImage LoadTextureImage(const string &filename);
+TextureImage PackSpecularImage(const TextureImage &diffuse, const TextureImage &specular);
+string PackedTextureName(const string &diffuseFile, const string &specularFile);
+unsigned int PackedTextureFromFiles(const char *diffusePath, const char *specularPath, const string &directory);
+void UploadTextureImage(unsigned int textureID, const TextureImage &image);
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+map<string, unsigned int> &LoadedTextures();
+
+// CPU side result of importing a model file, produced without a GL context
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;   // type and path only, ids are resolved on upload
+    bool hasLightmapCoords = false;
+};
 
+struct ModelData {
+    string directory;
+    vector<MeshData> meshes;
+    map<string, TextureImage> images;   // pre-decoded textures by full path, see Model::Import
+    vector<glm::vec3> occluder;         // see Model::occluder
+    bool valid = false;
+};
 
 
 class Model
@@ -32,12 +63,25 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
+    string path;
     bool gammaCorrection;
+    bool packSpecular;   // import option, see Import
+    // bounding sphere of all meshes in model space, updated on every upload
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    // the box the sphere is taken around
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    // boxes inside the meshes as a list of triangles in model space, what the CPU occlusion culler draws (see
+    // OcclusionCuller and buildOccluder)
+    vector<glm::vec3> occluder;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, bool packSpecular = false)
+        : path(path), gammaCorrection(gamma), packSpecular(packSpecular)
     {
-        loadModel(path);
+        ModelData data = Import(path, nullptr, packSpecular);
+        Upload(data);
     }
 
     // draws the model, and thus all its meshes
@@ -47,15 +91,46 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws every mesh with the variant matching its material features, the object's index into the
+    // transform buffer (see ObjectTransforms) is set on each program that gets used
+    void Draw(ShaderVariants &variants, ShaderVariantKey key, unsigned int objectIndex)
+    {
+        Shader *current = nullptr;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Shader &shader = variants.Get(key.With(meshes[i].features));
+            if (&shader != current) {
+                shader.use();
+                shader.setInt("objectIndex"_u, (int) objectIndex);
+                current = &shader;
+            }
+            meshes[i].Draw(shader);
+        }
+    }
+
+    // every mesh can be lightmapped, see LightmapBaker
+    bool HasLightmapCoords() const
+    {
+        for (const Mesh &mesh : meshes)
+            if (!mesh.hasLightmapCoords)
+                return false;
+        return !meshes.empty();
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
+        glslIdentifierPrefix = prefix;
         for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+            mesh.SetShaderTextureNamePrefix(prefix);
         }
     }
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // reads the model file with ASSIMP. Touches no GL state, so the asset watcher runs it on its worker thread.
+    // textures whose full path is not in knownTextures are decoded here as well, so Upload never has to hit the disk.
+    // With packSpecular a mesh's grayscale specular map is moved into the alpha of its diffuse texture, so the
+    // lighting shader fetches one texture instead of two.
+    static ModelData Import(string const &path, const set<string> *knownTextures = nullptr, bool packSpecular = false)
     {
+        ModelData data;
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -63,17 +138,259 @@ private:
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return data;
         }
         // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        data.directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, data);
+        buildOccluder(data);
+        if (packSpecular)
+            packSpecularMaps(data);
+
+        if (knownTextures != nullptr) {
+            for (const MeshData &mesh : data.meshes)
+                for (const Texture &texture : mesh.textures) {
+                    if (texture.packedSpecular)
+                        continue; // always decoded by packSpecularMaps
+                    string filename = data.directory + '/' + texture.path;
+                    if (!knownTextures->count(filename) && !data.images.count(filename))
+                        data.images[filename] = LoadTextureImage(filename);
+                }
+        }
+        data.valid = true;
+        return data;
+    }
+
+    // creates the GL objects for imported data and swaps them in place of the current meshes.
+    // textures are shared through LoadedTextures(), so a reload keeps both that cache and textures_loaded consistent.
+    void Upload(ModelData &data)
+    {
+        if (!data.valid)
+            return;
+
+        for (auto &image : data.images) {
+            unsigned int &textureID = LoadedTextures()[image.first];
+            if (textureID == 0)
+                glGenTextures(1, &textureID);
+            UploadTextureImage(textureID, image.second);
+        }
+
+        for (Mesh &mesh : meshes)
+            mesh.Release();
+        meshes.clear();
+        textures_loaded.clear();
+        directory = data.directory;
+
+        for (MeshData &mesh : data.meshes) {
+            for (Texture &texture : mesh.textures) {
+                // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
+                bool skip = false;
+                for(unsigned int j = 0; j < textures_loaded.size(); j++)
+                {
+                    if(textures_loaded[j].path == texture.path)
+                    {
+                        texture.id = textures_loaded[j].id;
+                        skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+                        break;
+                    }
+                }
+                if(!skip && texture.packedSpecular)
+                {   // packed textures were decoded by Import and uploaded above
+                    texture.id = LoadedTextures()[texture.path];
+                    textures_loaded.push_back(texture);
+                }
+                else if(!skip)
+                {   // if texture hasn't been loaded already, load it
+                    texture.id = TextureFromFile(texture.path.c_str(), this->directory);
+                    textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                }
+            }
+            meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), std::move(mesh.textures)));
+            meshes.back().SetShaderTextureNamePrefix(glslIdentifierPrefix);
+            meshes.back().hasLightmapCoords = mesh.hasLightmapCoords;
+        }
+        occluder = std::move(data.occluder);
+        computeBounds();
+    }
+
+private:
+    std::string glslIdentifierPrefix;
+
+    // a sphere around the center of the bounding box, loose but cheap to test against lights
+    void computeBounds()
+    {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (const Mesh &mesh : meshes)
+            for (const Vertex &vertex : mesh.vertices) {
+                lo = glm::min(lo, vertex.Position);
+                hi = glm::max(hi, vertex.Position);
+            }
+        if (lo.x > hi.x) {
+            boundsCenter = boundsMin = boundsMax = glm::vec3(0.0f);
+            boundsRadius = 0.0f;
+            return;
+        }
+        boundsMin = lo;
+        boundsMax = hi;
+        boundsCenter = (lo + hi) * 0.5f;
+        boundsRadius = 0.0f;
+        for (const Mesh &mesh : meshes)
+            for (const Vertex &vertex : mesh.vertices)
+                boundsRadius = std::max(boundsRadius, glm::distance(vertex.Position, boundsCenter));
+    }
+
+    // The occluder is made of boxes that lie wholly inside the model, so it never hides anything the model does not.
+    // The model's box is cut into cubic cells, OCCLUDER_GRID along its longest side, and every cell the plane of a
+    // triangle passes through within the triangle's box is marked as surface, which marks at least every cell the
+    // triangle touches. The cells that cannot be reached from the border without crossing a marked one are inside a
+    // closed surface, they are merged into boxes along runs of cells. A model that is open or thinner than a couple
+    // of cells has no inside and gets no occluder.
+    static const int OCCLUDER_GRID = 32;
+
+    static void buildOccluder(ModelData &data)
+    {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (const MeshData &mesh : data.meshes)
+            for (const Vertex &vertex : mesh.vertices) {
+                lo = glm::min(lo, vertex.Position);
+                hi = glm::max(hi, vertex.Position);
+            }
+        data.occluder.clear();
+        float cell = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z)) / OCCLUDER_GRID;
+        if (lo.x > hi.x || cell <= 0.0f)
+            return;
+        // a border of free cells all around, where the outside starts
+        glm::vec3 origin = lo - glm::vec3(cell);
+        glm::ivec3 size;
+        for (int axis = 0; axis < 3; axis++)
+            size[axis] = (int) std::ceil((hi[axis] - lo[axis]) / cell) + 2;
+        auto at = [&size](int x, int y, int z) { return ((size_t) z * size.y + y) * size.x + x; };
+        enum : uint8_t { FREE, SURFACE, OUTSIDE };
+        vector<uint8_t> cells((size_t) size.x * size.y * size.z, FREE);
+
+        for (const MeshData &mesh : data.meshes)
+            for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+                const glm::vec3 &a = mesh.vertices[mesh.indices[i]].Position;
+                const glm::vec3 &b = mesh.vertices[mesh.indices[i + 1]].Position;
+                const glm::vec3 &c = mesh.vertices[mesh.indices[i + 2]].Position;
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                // a little more than half a cell along the normal, against rounding
+                float reach = 0.51f * cell * (std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z));
+                glm::ivec3 first, last;
+                for (int axis = 0; axis < 3; axis++) {
+                    float low = std::min(a[axis], std::min(b[axis], c[axis])) - origin[axis];
+                    float high = std::max(a[axis], std::max(b[axis], c[axis])) - origin[axis];
+                    first[axis] = std::max(0, (int) std::floor(low / cell - 0.01f));
+                    last[axis] = std::min(size[axis] - 1, (int) std::floor(high / cell + 0.01f));
+                }
+                for (int z = first.z; z <= last.z; z++)
+                    for (int y = first.y; y <= last.y; y++)
+                        for (int x = first.x; x <= last.x; x++) {
+                            glm::vec3 center = origin + (glm::vec3((float) x, (float) y, (float) z) + 0.5f) * cell;
+                            if (std::fabs(glm::dot(normal, center - a)) <= reach)
+                                cells[at(x, y, z)] = SURFACE;
+                        }
+            }
+
+        // the outside spreads from the border through the free cells
+        vector<glm::ivec3> stack;
+        for (int z = 0; z < size.z; z++)
+            for (int y = 0; y < size.y; y++)
+                for (int x = 0; x < size.x; x++)
+                    if ((x == 0 || y == 0 || z == 0 || x == size.x - 1 || y == size.y - 1 || z == size.z - 1)
+                        && cells[at(x, y, z)] == FREE) {
+                        cells[at(x, y, z)] = OUTSIDE;
+                        stack.push_back(glm::ivec3(x, y, z));
+                    }
+        const glm::ivec3 steps[6] = {glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 1, 0),
+                                     glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)};
+        while (!stack.empty()) {
+            glm::ivec3 current = stack.back();
+            stack.pop_back();
+            for (const glm::ivec3 &step : steps) {
+                glm::ivec3 next = current + step;
+                if (next.x < 0 || next.y < 0 || next.z < 0 || next.x >= size.x || next.y >= size.y
+                    || next.z >= size.z || cells[at(next.x, next.y, next.z)] != FREE)
+                    continue;
+                cells[at(next.x, next.y, next.z)] = OUTSIDE;
+                stack.push_back(next);
+            }
+        }
+
+        // the free cells left are inside, each box grows along x, then y, then z while every cell it takes is inside
+        auto inside = [&](int x0, int x1, int y0, int y1, int z0, int z1) {
+            for (int z = z0; z <= z1; z++)
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++)
+                        if (cells[at(x, y, z)] != FREE)
+                            return false;
+            return true;
+        };
+        for (int z = 0; z < size.z; z++)
+            for (int y = 0; y < size.y; y++)
+                for (int x = 0; x < size.x; x++) {
+                    if (cells[at(x, y, z)] != FREE)
+                        continue;
+                    int x1 = x, y1 = y, z1 = z;
+                    while (x1 + 1 < size.x && inside(x1 + 1, x1 + 1, y, y, z, z))
+                        x1++;
+                    while (y1 + 1 < size.y && inside(x, x1, y1 + 1, y1 + 1, z, z))
+                        y1++;
+                    while (z1 + 1 < size.z && inside(x, x1, y, y1, z1 + 1, z1 + 1))
+                        z1++;
+                    for (int bz = z; bz <= z1; bz++)
+                        for (int by = y; by <= y1; by++)
+                            for (int bx = x; bx <= x1; bx++)
+                                cells[at(bx, by, bz)] = OUTSIDE;
+                    addOccluderBox(data.occluder, origin + glm::vec3((float) x, (float) y, (float) z) * cell,
+                                   origin + glm::vec3((float) (x1 + 1), (float) (y1 + 1), (float) (z1 + 1)) * cell);
+                }
+    }
+
+    // the twelve triangles of a box
+    static void addOccluderBox(vector<glm::vec3> &triangles, const glm::vec3 &lo, const glm::vec3 &hi)
+    {
+        const int faces[6][4] = {{0, 2, 6, 4}, {1, 5, 7, 3}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 6, 7, 5}};
+        for (const int *face : faces)
+            for (int corner : {face[0], face[1], face[2], face[0], face[2], face[3]})
+                triangles.push_back(glm::vec3(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                                              corner & 4 ? hi.z : lo.z));
+    }
+
+    // replaces the diffuse and specular texture of every mesh that has one of each with a packed texture,
+    // meshes whose specular map cannot be packed keep both
+    static void packSpecularMaps(ModelData &data)
+    {
+        for (MeshData &mesh : data.meshes) {
+            auto diffuse = mesh.textures.end(), specular = mesh.textures.end();
+            for (auto it = mesh.textures.begin(); it != mesh.textures.end(); ++it) {
+                if (it->type == "texture_diffuse" && diffuse == mesh.textures.end())
+                    diffuse = it;
+                else if (it->type == "texture_specular" && specular == mesh.textures.end())
+                    specular = it;
+            }
+            if (diffuse == mesh.textures.end() || specular == mesh.textures.end())
+                continue;
+
+            string name = PackedTextureName(data.directory + '/' + diffuse->path, data.directory + '/' + specular->path);
+            auto image = data.images.find(name);
+            if (image == data.images.end())
+                image = data.images.emplace(name, LoadTextureImage(name)).first;
+            if (!image->second.data)
+                continue;
+            diffuse->path = name;
+            diffuse->packedSpecular = true;
+            mesh.textures.erase(specular);
+        }
+        // pairs that could not be packed are loaded as two textures by Upload
+        for (auto it = data.images.begin(); it != data.images.end();)
+            it = it->second.data ? std::next(it) : data.images.erase(it);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(aiNode *node, const aiScene *scene, ModelData &data)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,22 +398,24 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<Texture> &textures = data.textures;
+        data.hasLightmapCoords = mesh->mTextureCoords[1] != nullptr;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -138,6 +457,11 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            // a second set is taken to be a lightmap unwrap, see LightmapBaker
+            if(mesh->mTextureCoords[1])
+                vertex.LightmapCoords = glm::vec2(mesh->mTextureCoords[1][i].x, mesh->mTextureCoords[1][i].y);
+            else
+                vertex.LightmapCoords = glm::vec2(0.0f, 0.0f);
 
             vertices.push_back(vertex);
 
@@ -178,82 +502,147 @@ private:
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // collects the type and path of all material textures of a given type, they are loaded later in Upload.
+    static vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// every texture loaded so far by its full path, shared by all models so a file is only ever uploaded once
+map<string, unsigned int> &LoadedTextures()
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    static map<string, unsigned int> textures;
+    return textures;
+}
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+// key in LoadedTextures of a diffuse texture with a specular map packed into its alpha, LoadTextureImage
+// builds the packed image when it is given such a name
+string PackedTextureName(const string &diffuseFile, const string &specularFile)
+{
+    return diffuseFile + '|' + specularFile;
+}
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+// rgb of the diffuse image and the specular map in alpha. Only grayscale specular maps of the same size are packed,
+// the lighting shaders read a colored one as .rgr for ALT_SPECULAR_SWIZZLE. Returns an empty image otherwise.
+TextureImage PackSpecularImage(const TextureImage &diffuse, const TextureImage &specular)
+{
+    TextureImage packed;
+    if (!diffuse.data || !specular.data || diffuse.width != specular.width || diffuse.height != specular.height
+        || diffuse.nrComponents == 2 || specular.nrComponents == 2)
+        return packed;
+    size_t pixels = (size_t) diffuse.width * diffuse.height;
+    const unsigned char *d = diffuse.data.get(), *s = specular.data.get();
+    if (specular.nrComponents >= 3) {
+        for (size_t i = 0; i < pixels; i++) {
+            const unsigned char *p = s + i * specular.nrComponents;
+            if (p[0] != p[1] || p[0] != p[2])
+                return packed;
+        }
     }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+
+    packed.width = diffuse.width;
+    packed.height = diffuse.height;
+    packed.nrComponents = 4;
+    packed.data = shared_ptr<unsigned char>(new unsigned char[pixels * 4], std::default_delete<unsigned char[]>());
+    unsigned char *out = packed.data.get();
+    for (size_t i = 0; i < pixels; i++) {
+        const unsigned char *p = d + i * diffuse.nrComponents;
+        out[i * 4 + 0] = p[0];
+        out[i * 4 + 1] = diffuse.nrComponents >= 3 ? p[1] : p[0];
+        out[i * 4 + 2] = diffuse.nrComponents >= 3 ? p[2] : p[0];
+        out[i * 4 + 3] = s[i * specular.nrComponents];
+    }
+    return packed;
+}
+
+TextureImage LoadTextureImage(const string &filename)
+{
+    size_t separator = filename.find('|');
+    if (separator != string::npos) {
+        string diffuseFile = filename.substr(0, separator), specularFile = filename.substr(separator + 1);
+        TextureImage packed = PackSpecularImage(LoadTextureImage(diffuseFile), LoadTextureImage(specularFile));
+        if (!packed.data)
+            std::cout << "Specular map not packed, it is not a grayscale image the size of " << diffuseFile << ": " << specularFile << std::endl;
+        return packed;
     }
 
+    TextureImage image;
+    unsigned char *data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    if (data)
+        image.data = shared_ptr<unsigned char>(data, stbi_image_free);
+    else
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
+    return image;
+}
+
+void UploadTextureImage(unsigned int textureID, const TextureImage &image)
+{
+    if (!image.data)
+        return;
+
+    GLenum format = GL_RGB;
+    if (image.nrComponents == 1)
+        format = GL_RED;
+    else if (image.nrComponents == 3)
+        format = GL_RGB;
+    else if (image.nrComponents == 4)
+        format = GL_RGBA;
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// loads a diffuse texture with the specular map packed into its alpha, 0 if the specular map cannot be packed
+unsigned int PackedTextureFromFiles(const char *diffusePath, const char *specularPath, const string &directory)
+{
+    string name = PackedTextureName(directory + '/' + diffusePath, directory + '/' + specularPath);
+    auto it = LoadedTextures().find(name);
+    if (it != LoadedTextures().end())
+        return it->second;
+
+    TextureImage image = LoadTextureImage(name);
+    if (!image.data)
+        return 0;
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    UploadTextureImage(textureID, image);
+    LoadedTextures()[name] = textureID;
+    return textureID;
+}
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    string filename = string(path);
+    filename = directory + '/' + filename;
+
+    unsigned int &textureID = LoadedTextures()[filename];
+    if (textureID != 0)
+        return textureID;
+
+    glGenTextures(1, &textureID);
+    UploadTextureImage(textureID, LoadTextureImage(filename));
     return textureID;
 }
 #endif
@@ -0,0 +1,223 @@
+#ifndef OBJECT_LIGHTS_H
+#define OBJECT_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/light_radius.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/object_transforms.h>
+
+#include <common.h>
+
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <algorithm>
+
+// Packs lights into a Lights block: the first ones that fit at the front of each array, unused slots made to add
+// nothing in case a variant with more lights is drawn in their place. With ALT_SPECULAR_SWIZZLE the shaders read
+// the last active point light as .rgr, so that light goes last. The returned key selects the variant that loops
+// over exactly the packed lights. The directional light is left as it is.
+inline ShaderVariantKey PackLights(LightsData &lights, const std::vector<PointLightData> &pointLights,
+                                   const std::vector<SpotLightData> &spotLights)
+{
+    ShaderVariantKey key;
+    key.pointLights = 0;
+    key.spotLights = 0;
+    key.features = 0;
+    memset(static_cast<void *>(lights.pointLights), 0, sizeof(lights.pointLights));
+    memset(static_cast<void *>(lights.spotLights), 0, sizeof(lights.spotLights));
+    for (PointLightData &light : lights.pointLights)
+        light.constant = 1.0f;
+    for (SpotLightData &light : lights.spotLights) {
+        light.constant = 1.0f;
+        light.cutOff = 1.0f;
+    }
+    const PointLightData *altLight = nullptr;
+    for (const PointLightData &light : pointLights)
+        if (light.altSpecularSwizzle != 0.0f)
+            altLight = &light;
+    unsigned int regularSlots = NR_POINT_LIGHTS - (altLight ? 1 : 0);
+    for (const PointLightData &light : pointLights)
+        if (&light != altLight && key.pointLights < regularSlots)
+            lights.pointLights[key.pointLights++] = light;
+    if (altLight) {
+        lights.pointLights[key.pointLights++] = *altLight;
+        key.features |= ALT_SPECULAR_SWIZZLE;
+    }
+    for (const SpotLightData &light : spotLights)
+        if (key.spotLights < NR_SPOT_LIGHTS)
+            lights.spotLights[key.spotLights++] = light;
+    return key;
+}
+
+// Per-object light lists. Update() intersects the radius of influence of every light (see SetLightRadius) with
+// the bounding sphere of each object and packs the lights that reach it into a Lights block of the object's own.
+// All the blocks share one uniform buffer, Bind() points the Lights binding at an object's block before it is
+// drawn and returns the key of the variant for its lights. Objects reached by the same lights share one block. An object reached by more lights than the block holds
+// keeps the ones that are brightest at its bounds.
+class ObjectLights
+{
+public:
+    struct Stats {
+        unsigned int objects = 0;
+        unsigned int blocks = 0;       // different lists
+        unsigned int references = 0;   // lights in all lists together
+        unsigned int dropped = 0;      // lights that reached an object but did not fit in its block
+    };
+
+    ObjectLights(GLuint binding) : binding(binding)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(LightsData) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &buffer);
+    }
+
+    ~ObjectLights()
+    {
+        glDeleteBuffers(1, &buffer);
+    }
+
+    ObjectLights(const ObjectLights &) = delete;
+    ObjectLights &operator=(const ObjectLights &) = delete;
+
+    // the model space bounding sphere of an object, index as in ObjectTransforms
+    void SetBounds(unsigned int index, const glm::vec3 &center, float radius)
+    {
+        if (index >= objects.size())
+            objects.resize(index + 1);
+        objects[index].center = center;
+        objects[index].radius = radius;
+    }
+
+    // builds the list of every object, call after the lights and transforms of the frame are final
+    void Update(const ObjectTransforms &transforms, const DirLightData &dirLight,
+                const std::vector<PointLightData> &pointLights, const std::vector<SpotLightData> &spotLights)
+    {
+        stats = Stats();
+        stats.objects = (unsigned int) objects.size();
+        blocks.clear();
+        blockIndices.clear();
+        for (size_t i = 0; i < objects.size(); i++) {
+            Object &object = objects[i];
+            // world space bounds, the radius grows with the largest scale of the model matrix
+            const glm::mat4 &model = transforms.Model((unsigned int) i);
+            glm::vec3 center = glm::vec3(model * glm::vec4(object.center, 1.0f));
+            float scale = std::max(glm::length(glm::vec3(model[0])),
+                                   std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+            float radius = object.radius * scale;
+
+            select(pointLights, center, radius, NR_POINT_LIGHTS, points);
+            select(spotLights, center, radius, NR_SPOT_LIGHTS, spots);
+            LightsData lights;
+            lights.dirLight = dirLight;
+            object.key = PackLights(lights, points, spots);
+            stats.references += object.key.pointLights + object.key.spotLights;
+
+            // the same packed lights are the same block, found by the hash of their bytes
+            uint64_t hash = HashBytes((const char *) &lights, sizeof(LightsData));
+            object.block = ~0u;
+            auto range = blockIndices.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+                if (memcmp(&blocks[it->second * stride], &lights, sizeof(LightsData)) == 0)
+                    object.block = it->second;
+            if (object.block == ~0u) {
+                object.block = (unsigned int) (blocks.size() / stride);
+                blockIndices.emplace(hash, object.block);
+                blocks.resize(blocks.size() + stride);
+                memcpy(&blocks[object.block * stride], &lights, sizeof(LightsData));
+            }
+        }
+        stats.blocks = (unsigned int) (blocks.size() / stride);
+
+        if (blocks == uploaded)
+            return;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (blocks.size() != uploaded.size())
+            glBufferData(GL_UNIFORM_BUFFER, blocks.size(), blocks.data(), GL_DYNAMIC_DRAW);
+        else
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, blocks.size(), blocks.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploaded = blocks;
+    }
+
+    // the key of the variant for the object's lights, without binding anything
+    ShaderVariantKey Key(unsigned int index) const
+    {
+        return objects[index].key;
+    }
+
+    // the block the object's lights are in, objects with the same block make the same binding
+    unsigned int Block(unsigned int index) const
+    {
+        return objects[index].block;
+    }
+
+    // attaches the object's Lights block, draw the object with the returned key
+    ShaderVariantKey Bind(unsigned int index) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, objects[index].block * stride, sizeof(LightsData));
+        return objects[index].key;
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Object {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        ShaderVariantKey key;
+        unsigned int block = 0;
+    };
+
+    GLuint binding;
+    GLuint buffer = 0;
+    size_t stride = 0;
+    std::vector<Object> objects;
+    std::vector<unsigned char> blocks;
+    std::vector<unsigned char> uploaded;
+    std::unordered_multimap<uint64_t, unsigned int> blockIndices;
+    std::vector<PointLightData> points;
+    std::vector<SpotLightData> spots;
+    std::vector<std::pair<float, size_t>> candidates;
+    Stats stats;
+
+    // the lights whose radius reaches the sphere, the brightest at its surface first if there are more than fit
+    template<typename Light>
+    void select(const std::vector<Light> &lights, const glm::vec3 &center, float radius, unsigned int capacity,
+                std::vector<Light> &selected)
+    {
+        candidates.clear();
+        for (size_t i = 0; i < lights.size(); i++) {
+            const Light &light = lights[i];
+            float distance = glm::distance(center, light.position);
+            if (distance >= radius + InfluenceRadius(light))
+                continue;
+            float d = std::max(0.0f, distance - radius);
+            float intensity = MaxChannel(light.ambient) + MaxChannel(light.diffuse) + MaxChannel(light.specular);
+            float brightness = intensity / (light.constant + light.linear * d + light.quadratic * d * d);
+            candidates.push_back(std::make_pair(-brightness, i));
+        }
+        if (candidates.size() > capacity) {
+            stats.dropped += (unsigned int) candidates.size() - capacity;
+            std::partial_sort(candidates.begin(), candidates.begin() + capacity, candidates.end());
+            candidates.resize(capacity);
+            // keep the order of the light list, it decides which slot each light gets
+            std::sort(candidates.begin(), candidates.end(),
+                      [](const std::pair<float, size_t> &a, const std::pair<float, size_t> &b) {
+                          return a.second < b.second;
+                      });
+        }
+        selected.clear();
+        for (const std::pair<float, size_t> &candidate : candidates)
+            selected.push_back(lights[candidate.second]);
+    }
+};
+
+#endif
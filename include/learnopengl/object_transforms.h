@@ -0,0 +1,110 @@
+#ifndef OBJECT_TRANSFORMS_H
+#define OBJECT_TRANSFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// texture unit the transform buffer stays bound to, material textures use the units below it
+const GLuint OBJECT_TRANSFORMS_UNIT = 8;
+
+// texels per object in the buffer: model (4 columns), normal matrix (3 columns) and model-view-projection (4 columns).
+// Must match OBJECT_TEXELS in the vertex shaders.
+const unsigned int OBJECT_TRANSFORM_TEXELS = 11;
+
+// Transforms of every object in the scene, kept in an RGBA32F texture buffer that the vertex shaders read with
+// texelFetch(objectTransforms, objectIndex * OBJECT_TEXELS + n). The model and normal matrices are computed once
+// when an object is added or moved, the MVPs are recomputed only when the camera changes.
+class ObjectTransforms
+{
+public:
+    ObjectTransforms()
+    {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+    }
+
+    ~ObjectTransforms()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    ObjectTransforms(const ObjectTransforms &) = delete;
+    ObjectTransforms &operator=(const ObjectTransforms &) = delete;
+
+    // returns the index the object is drawn with
+    unsigned int Add(const glm::mat4 &model)
+    {
+        objects.emplace_back();
+        Set((unsigned int) objects.size() - 1, model);
+        return (unsigned int) objects.size() - 1;
+    }
+
+    void Set(unsigned int index, const glm::mat4 &model)
+    {
+        Object &object = objects[index];
+        object.model = model;
+        // a flattened object (the glass panes are scaled to zero depth) has no inverse, it is never lit either
+        glm::mat3 upper = glm::mat3(model);
+        object.normal = glm::determinant(upper) != 0.0f ? glm::transpose(glm::inverse(upper)) : glm::mat3(1.0f);
+        dirty = true;
+    }
+
+    const glm::mat4 &Model(unsigned int index) const
+    {
+        return objects[index].model;
+    }
+
+    // call after the camera has moved and before anything is drawn, the buffer is written only if something changed
+    void Update(const glm::mat4 &viewProjection)
+    {
+        if (!dirty && viewProjection == uploadedViewProjection)
+            return;
+        texels.resize(objects.size() * OBJECT_TRANSFORM_TEXELS);
+        for (size_t i = 0; i < objects.size(); i++) {
+            const Object &object = objects[i];
+            glm::vec4 *out = &texels[i * OBJECT_TRANSFORM_TEXELS];
+            glm::mat4 mvp = viewProjection * object.model;
+            for (int c = 0; c < 4; c++)
+                out[c] = object.model[c];
+            for (int c = 0; c < 3; c++)
+                out[4 + c] = glm::vec4(object.normal[c], 0.0f);
+            for (int c = 0; c < 4; c++)
+                out[7 + c] = mvp[c];
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (objects.size() != capacity) {
+            // the texture has to be pointed at the buffer again once its storage is reallocated
+            capacity = objects.size();
+            glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), texels.data(), GL_DYNAMIC_DRAW);
+            glActiveTexture(GL_TEXTURE0 + OBJECT_TRANSFORMS_UNIT);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+            glActiveTexture(GL_TEXTURE0);
+        } else {
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, texels.size() * sizeof(glm::vec4), texels.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        uploadedViewProjection = viewProjection;
+        dirty = false;
+    }
+
+private:
+    struct Object {
+        glm::mat4 model;
+        glm::mat3 normal;
+    };
+
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    size_t capacity = 0;
+    std::vector<Object> objects;
+    std::vector<glm::vec4> texels;
+    glm::mat4 uploadedViewProjection = glm::mat4(0.0f);
+    bool dirty = true;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/scene.h>
+#include <learnopengl/simd.h>
+#include <learnopengl/worker_pool.h>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <thread>
+
+// the software depth buffer, in OCCLUSION_TILES_X * OCCLUSION_TILES_Y tiles that are rasterized in parallel
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+const int OCCLUSION_TILES_X = 4;
+const int OCCLUSION_TILES_Y = 4;
+
+// Occlusion culling on the CPU, without reading anything back from the GPU. A few occluders, triangle lists in model
+// space that lie inside what they stand for (see Model::occluder), are drawn into a small depth buffer: the triangles are transformed, clipped
+// against the near plane and sorted into the tiles they touch on the calling thread, then each thread rasterizes
+// its share of the tiles, four pixels at a time. The hierarchy above the depth buffer keeps the farthest depth of
+// every 2x2 block, so an object is hidden when the nearest corner of its box lies behind the farthest depth of the
+// texels its box covers on the level where that is at most 8x8 texels.
+//
+// Coverage is conservative: a triangle writes only the pixels it covers whole, with the farthest depth it has in
+// them, so no pixel is ever nearer or more covered than the occluders really make it.
+class OcclusionCuller
+{
+public:
+    struct Stats {
+        unsigned int occluders = 0;
+        unsigned int triangles = 0;   // drawn after clipping
+        unsigned int tested = 0;
+        unsigned int occluded = 0;
+        float rasterMs = 0.0f;
+        float testMs = 0.0f;
+    };
+
+    OcclusionCuller(unsigned int threads = std::thread::hardware_concurrency())
+        : pool(std::min(threads, (unsigned int) TILES))
+    {
+        int width = OCCLUSION_WIDTH, height = OCCLUSION_HEIGHT;
+        while (width >= 1 && height >= 1) {
+            levels.push_back(Level{width, height, std::vector<float>((size_t) width * height, 1.0f)});
+            if (width == 1 || height == 1)
+                break;
+            width /= 2;
+            height /= 2;
+        }
+    }
+
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    // object is the scene object whose world matrix places the triangles, three corners each. The list is read on
+    // every Render, so it may change in place (a reloaded model).
+    void AddOccluder(unsigned int object, const std::vector<glm::vec3> *triangles)
+    {
+        occluders.push_back(Occluder{object, triangles});
+    }
+
+    // draws the occluders and builds the hierarchy
+    void Render(const glm::mat4 &viewProjection, const Scene &scene)
+    {
+        auto start = std::chrono::steady_clock::now();
+        triangles.clear();
+        for (std::vector<uint32_t> &bin : bins)
+            bin.clear();
+        for (const Occluder &occluder : occluders) {
+            glm::mat4 clip = viewProjection * scene.Worlds()[occluder.object];
+            const std::vector<glm::vec3> &corners = *occluder.triangles;
+            for (size_t i = 0; i + 2 < corners.size(); i += 3)
+                addTriangle(clip * glm::vec4(corners[i], 1.0f), clip * glm::vec4(corners[i + 1], 1.0f),
+                            clip * glm::vec4(corners[i + 2], 1.0f));
+        }
+
+        pool.Run([this](unsigned int share) { rasterizeTiles(share); });
+
+        for (size_t l = 1; l < levels.size(); l++) {
+            const Level &below = levels[l - 1];
+            Level &level = levels[l];
+            for (int y = 0; y < level.height; y++)
+                for (int x = 0; x < level.width; x++) {
+                    const float *row = &below.depth[(size_t) (2 * y) * below.width + 2 * x];
+                    level.depth[(size_t) y * level.width + x] = std::max(std::max(row[0], row[1]),
+                                                                         std::max(row[below.width],
+                                                                                  row[below.width + 1]));
+                }
+        }
+        stats.occluders = (unsigned int) occluders.size();
+        stats.triangles = (unsigned int) triangles.size();
+        stats.rasterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // tests the box of every object candidates marks (all of them without it) against the last Render
+    void Cull(const glm::mat4 &viewProjection, const Scene &scene, const std::vector<uint8_t> *candidates)
+    {
+        auto start = std::chrono::steady_clock::now();
+        visible.assign(scene.Size(), 0);
+        stats.tested = 0;
+        stats.occluded = 0;
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            if (candidates && !(*candidates)[i])
+                continue;
+            stats.tested++;
+            if (occluded(viewProjection, scene.Mins()[i], scene.Maxs()[i]))
+                stats.occluded++;
+            else
+                visible[i] = 1;
+        }
+        stats.testMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // one entry per scene object, non zero if the last Cull did not find it hidden
+    const std::vector<uint8_t> &Visible() const
+    {
+        return visible;
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    static const int TILES = OCCLUSION_TILES_X * OCCLUSION_TILES_Y;
+    static const int TILE_WIDTH = OCCLUSION_WIDTH / OCCLUSION_TILES_X;
+    static const int TILE_HEIGHT = OCCLUSION_HEIGHT / OCCLUSION_TILES_Y;
+    // the boxes' depth is moved this much towards the camera, against rounding
+    static constexpr float DEPTH_BIAS = 1e-4f;
+
+    struct Occluder {
+        unsigned int object;
+        const std::vector<glm::vec3> *triangles;
+    };
+
+    // screen space corners in pixels, wound counterclockwise, and the plane of the depth across the screen
+    struct Triangle {
+        glm::vec2 a, b, c;
+        float depth, depthX, depthY;   // at a, and per pixel right and up
+    };
+
+    struct Level {
+        int width, height;
+        std::vector<float> depth;   // [0, 1], 1 where nothing was drawn
+    };
+
+    std::vector<Occluder> occluders;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> bins[TILES];   // the triangles touching each tile
+    std::vector<Level> levels;
+    std::vector<uint8_t> visible;
+    Stats stats;
+
+    WorkerPool pool;
+
+    // clips against the near plane, z >= -w, which leaves one or two triangles
+    void addTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+    {
+        const glm::vec4 corners[3] = {a, b, c};
+        glm::vec4 clipped[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++) {
+            const glm::vec4 &p = corners[i], &q = corners[(i + 1) % 3];
+            float dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f)
+                clipped[count++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                clipped[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+        for (int i = 2; i < count; i++)
+            addScreenTriangle(clipped[0], clipped[i - 1], clipped[i]);
+    }
+
+    void addScreenTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+    {
+        if (a.w <= 0.0f || b.w <= 0.0f || c.w <= 0.0f)
+            return;
+        glm::vec3 p[3] = {toScreen(a), toScreen(b), toScreen(c)};
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (std::fabs(area) < 1e-8f)
+            return;
+        // both sides are drawn
+        if (area < 0.0f) {
+            std::swap(p[1], p[2]);
+            area = -area;
+        }
+        float minX = std::min(p[0].x, std::min(p[1].x, p[2].x)), maxX = std::max(p[0].x, std::max(p[1].x, p[2].x));
+        float minY = std::min(p[0].y, std::min(p[1].y, p[2].y)), maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+        if (maxX < 0.0f || maxY < 0.0f || minX > OCCLUSION_WIDTH || minY > OCCLUSION_HEIGHT)
+            return;
+
+        Triangle triangle;
+        triangle.a = glm::vec2(p[0].x, p[0].y);
+        triangle.b = glm::vec2(p[1].x, p[1].y);
+        triangle.c = glm::vec2(p[2].x, p[2].y);
+        glm::vec3 ab = p[1] - p[0], ac = p[2] - p[0];
+        triangle.depth = p[0].z;
+        triangle.depthX = (ab.z * ac.y - ac.z * ab.y) / area;
+        triangle.depthY = (ac.z * ab.x - ab.z * ac.x) / area;
+        uint32_t index = (uint32_t) triangles.size();
+        triangles.push_back(triangle);
+
+        int firstX = std::max(0, (int) minX / TILE_WIDTH);
+        int lastX = std::min(OCCLUSION_TILES_X - 1, (int) maxX / TILE_WIDTH);
+        int firstY = std::max(0, (int) minY / TILE_HEIGHT);
+        int lastY = std::min(OCCLUSION_TILES_Y - 1, (int) maxY / TILE_HEIGHT);
+        for (int y = firstY; y <= lastY; y++)
+            for (int x = firstX; x <= lastX; x++)
+                bins[y * OCCLUSION_TILES_X + x].push_back(index);
+    }
+
+    // pixels from the bottom left corner, depth in [0, 1]
+    static glm::vec3 toScreen(const glm::vec4 &clip)
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * OCCLUSION_WIDTH, (ndc.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+                         ndc.z * 0.5f + 0.5f);
+    }
+
+    void rasterizeTiles(unsigned int share)
+    {
+        std::vector<float> &depth = levels[0].depth;
+        for (unsigned int tile = share; tile < (unsigned int) TILES; tile += pool.Threads()) {
+            int tileX = (int) tile % OCCLUSION_TILES_X * TILE_WIDTH;
+            int tileY = (int) tile / OCCLUSION_TILES_X * TILE_HEIGHT;
+            for (int y = tileY; y < tileY + TILE_HEIGHT; y++)
+                std::fill(depth.begin() + (size_t) y * OCCLUSION_WIDTH + tileX,
+                          depth.begin() + (size_t) y * OCCLUSION_WIDTH + tileX + TILE_WIDTH, 1.0f);
+            for (uint32_t index : bins[tile])
+                rasterize(triangles[index], tileX, tileY, depth.data());
+        }
+    }
+
+    // the edge functions of the triangle are positive inside, each row of the triangle's box within the tile is
+    // walked four pixels at a time. The edges are moved in by half a pixel along each axis, so a pixel center passes
+    // only when the whole pixel is inside, and the depth is taken at the farthest corner of the pixel.
+    static void rasterize(const Triangle &triangle, int tileX, int tileY, float *depth)
+    {
+        const glm::vec2 corners[3] = {triangle.a, triangle.b, triangle.c};
+        float minX = std::min(corners[0].x, std::min(corners[1].x, corners[2].x));
+        float maxX = std::max(corners[0].x, std::max(corners[1].x, corners[2].x));
+        float minY = std::min(corners[0].y, std::min(corners[1].y, corners[2].y));
+        float maxY = std::max(corners[0].y, std::max(corners[1].y, corners[2].y));
+        int x0 = std::max(tileX, (int) std::floor(minX)) & ~3;
+        int x1 = std::min(tileX + TILE_WIDTH - 1, (int) std::ceil(maxX));
+        int y0 = std::max(tileY, (int) std::floor(minY));
+        int y1 = std::min(tileY + TILE_HEIGHT - 1, (int) std::ceil(maxY));
+
+        // edge i runs from corner i to the next one: e(x, y) = stepX * x + stepY * y + offset
+        float stepX[3], stepY[3], offset[3];
+        for (int i = 0; i < 3; i++) {
+            const glm::vec2 &p = corners[i], &q = corners[(i + 1) % 3];
+            stepX[i] = p.y - q.y;
+            stepY[i] = q.x - p.x;
+            offset[i] = -(stepX[i] * p.x + stepY[i] * p.y) - 0.5f * (std::fabs(stepX[i]) + std::fabs(stepY[i]));
+        }
+        float depthOffset = triangle.depth - triangle.depthX * triangle.a.x - triangle.depthY * triangle.a.y
+                            + 0.5f * (std::fabs(triangle.depthX) + std::fabs(triangle.depthY));
+
+#ifdef LEARNOPENGL_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 e0x = _mm_set1_ps(stepX[0]), e1x = _mm_set1_ps(stepX[1]), e2x = _mm_set1_ps(stepX[2]);
+        const __m128 zx = _mm_set1_ps(triangle.depthX);
+        for (int y = y0; y <= y1; y++) {
+            float py = (float) y + 0.5f;
+            const __m128 e0y = _mm_set1_ps(stepY[0] * py + offset[0]);
+            const __m128 e1y = _mm_set1_ps(stepY[1] * py + offset[1]);
+            const __m128 e2y = _mm_set1_ps(stepY[2] * py + offset[2]);
+            const __m128 zy = _mm_set1_ps(triangle.depthY * py + depthOffset);
+            float *row = depth + (size_t) y * OCCLUSION_WIDTH;
+            for (int x = x0; x <= x1; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float) x), lanes);
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e0x, px), e0y), zero),
+                                           _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e1x, px), e1y), zero),
+                                                      _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e2x, px), e2y), zero)));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(zx, px), zy));
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++) {
+            float py = (float) y + 0.5f;
+            float *row = depth + (size_t) y * OCCLUSION_WIDTH;
+            for (int x = x0; x <= x1; x++) {
+                float px = (float) x + 0.5f;
+                bool inside = true;
+                for (int i = 0; i < 3; i++)
+                    inside = inside && stepX[i] * px + stepY[i] * py + offset[i] >= 0.0f;
+                if (inside)
+                    row[x] = std::min(row[x], triangle.depthX * px + triangle.depthY * py + depthOffset);
+            }
+        }
+#endif
+    }
+
+    // a box reaching behind the camera or off the screen is never hidden
+    bool occluded(const glm::mat4 &viewProjection, const glm::vec3 &lo, const glm::vec3 &hi) const
+    {
+        glm::vec3 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                                                        corner & 4 ? hi.z : lo.z, 1.0f);
+            if (clip.z < -clip.w || clip.w <= 0.0f)
+                return false;
+            glm::vec3 screen = toScreen(clip);
+            screenMin = glm::min(screenMin, screen);
+            screenMax = glm::max(screenMax, screen);
+        }
+        if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x > OCCLUSION_WIDTH
+            || screenMin.y > OCCLUSION_HEIGHT)
+            return false;
+        int x0 = std::max(0, (int) std::floor(screenMin.x)), x1 = std::min(OCCLUSION_WIDTH - 1, (int) screenMax.x);
+        int y0 = std::max(0, (int) std::floor(screenMin.y)), y1 = std::min(OCCLUSION_HEIGHT - 1, (int) screenMax.y);
+        size_t l = 0;
+        while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 7 || (y1 >> l) - (y0 >> l) > 7))
+            l++;
+        const Level &level = levels[l];
+        float nearest = screenMin.z - DEPTH_BIAS;
+        for (int y = y0 >> l; y <= std::min(level.height - 1, y1 >> (int) l); y++)
+            for (int x = x0 >> l; x <= std::min(level.width - 1, x1 >> (int) l); x++)
+                if (level.depth[(size_t) y * level.width + x] >= nearest)
+                    return false;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/scene.h>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+
+// how many frames an object that was found visible is drawn without a condition before it is tested again
+const unsigned int OCCLUSION_QUERY_INTERVAL = 8;
+
+// Occlusion culling on the GPU. After the opaque pass the bounding box of an object is drawn against its depth in a
+// GL_ANY_SAMPLES_PASSED query, and the object's draws of the next frame are made under conditional rendering on
+// that query, so the GPU drops them if no sample of the box passed. Nothing waits for a result: conditional rendering
+// uses GL_QUERY_NO_WAIT, which draws when the result is not in yet, and results are read on the CPU only once they
+// are available.
+//
+// The results read keep the number of queries down. A hidden object is tested every frame, so it is drawn again one
+// frame after it is uncovered. A visible one is drawn without a condition and tested again every
+// OCCLUSION_QUERY_INTERVAL frames, the objects spread over the frames. An object whose box reaches the near plane is
+// drawn and not tested.
+class OcclusionQueries
+{
+public:
+    struct Stats {
+        unsigned int queries = 0;       // boxes drawn
+        unsigned int conditional = 0;   // objects drawn under a condition
+        unsigned int hidden = 0;        // objects a result read this frame found hidden
+        float queryPixels = 0.0f;       // screen area of the boxes drawn for the queries
+        float hiddenPixels = 0.0f;      // screen area of the boxes of the hidden objects, about the fragments saved
+    };
+
+    OcclusionQueries()
+    {
+        // the unit cube, scaled to each box in the vertex shader
+        std::vector<float> corners;
+        const int faces[6][4] = {{0, 2, 6, 4}, {1, 5, 7, 3}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 6, 7, 5}};
+        for (const int *face : faces)
+            for (int corner : {face[0], face[1], face[2], face[0], face[2], face[3]}) {
+                corners.push_back((float) (corner & 1));
+                corners.push_back((float) ((corner >> 1) & 1));
+                corners.push_back((float) ((corner >> 2) & 1));
+            }
+        glGenVertexArrays(1, &cubeVAO);
+        glGenBuffers(1, &cubeVBO);
+        glBindVertexArray(cubeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(float), corners.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
+        glBindVertexArray(0);
+    }
+
+    ~OcclusionQueries()
+    {
+        for (const Object &object : objects)
+            glDeleteQueries(1, &object.query);
+        glDeleteBuffers(1, &cubeVBO);
+        glDeleteVertexArrays(1, &cubeVAO);
+    }
+
+    OcclusionQueries(const OcclusionQueries &) = delete;
+    OcclusionQueries &operator=(const OcclusionQueries &) = delete;
+
+    // reads the results that are in and picks the condition of every object's draws this frame. candidates marks
+    // the objects that are drawn, all of them without it. width and height are the size of the framebuffer.
+    void Begin(const Scene &scene, const glm::mat4 &viewProjection, const std::vector<uint8_t> *candidates,
+               int width, int height)
+    {
+        frame++;
+        stats = Stats();
+        while (objects.size() < scene.Size()) {
+            objects.emplace_back();
+            glGenQueries(1, &objects.back().query);
+        }
+        conditions.assign(scene.Size(), 0);
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            Object &object = objects[i];
+            if (object.pending) {
+                GLuint available = 0;
+                glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    GLuint passed = 0;
+                    glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &passed);
+                    object.pending = false;
+                    object.hidden = passed == 0 && !object.stale;
+                    if (object.stale) {
+                        object.stale = false;
+                        object.nextQuery = frame;
+                    } else if (!object.hidden)
+                        object.nextQuery = frame + OCCLUSION_QUERY_INTERVAL - (frame + i) % OCCLUSION_QUERY_INTERVAL;
+                }
+            }
+            object.drawn = !candidates || (*candidates)[i];
+            if (!object.drawn) {
+                // a result from before it left the view says nothing about where it comes back, it is drawn then
+                // without a condition and tested at once. A query still in flight is dropped when it is read.
+                object.hidden = false;
+                object.stale = object.pending;
+                object.nextQuery = frame;
+                continue;
+            }
+            object.pixels = screenArea(viewProjection, scene.Mins()[i], scene.Maxs()[i], width, height);
+            if (object.pixels < 0.0f) {
+                object.hidden = false;
+                continue;
+            }
+            if ((object.pending && !object.stale) || object.hidden) {
+                conditions[i] = object.query;
+                stats.conditional++;
+            }
+            if (object.hidden && !object.pending) {
+                stats.hidden++;
+                stats.hiddenPixels += object.pixels;
+            }
+        }
+    }
+
+    // the query of each object to draw it under, 0 to draw it unconditionally
+    const std::vector<GLuint> &Conditions() const
+    {
+        return conditions;
+    }
+
+    // draws the boxes of the objects that are due into the bound framebuffer, after the opaque pass. boxShader
+    // places its unit cube between boxMin and boxMax.
+    void Issue(const Scene &scene, Shader &boxShader)
+    {
+        boxShader.use();
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+        glDisable(GL_CULL_FACE);
+        glBindVertexArray(cubeVAO);
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            Object &object = objects[i];
+            bool due = object.hidden || frame >= object.nextQuery;
+            if (!object.drawn || object.pending || object.pixels < 0.0f || !due)
+                continue;
+            // a little larger, so a box lying on the object's own surface is not lost to depth precision
+            glm::vec3 margin = (scene.Maxs()[i] - scene.Mins()[i]) * 0.01f + glm::vec3(0.01f);
+            boxShader.setVec3("boxMin"_u, scene.Mins()[i] - margin);
+            boxShader.setVec3("boxMax"_u, scene.Maxs()[i] + margin);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, object.query);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            object.pending = true;
+            stats.queries++;
+            stats.queryPixels += object.pixels;
+        }
+        glBindVertexArray(0);
+        glEnable(GL_CULL_FACE);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Object {
+        GLuint query = 0;
+        bool pending = false;        // issued, the result has not been read
+        bool hidden = false;         // by the last result read
+        bool stale = false;          // the pending query was issued before the object left the view
+        bool drawn = false;          // this frame
+        unsigned int nextQuery = 0;  // frame the object is tested again while it is visible
+        float pixels = 0.0f;         // screen area of the box this frame, negative if it reaches the near plane
+    };
+
+    GLuint cubeVAO = 0, cubeVBO = 0;
+    std::vector<Object> objects;
+    std::vector<GLuint> conditions;
+    unsigned int frame = 0;
+    Stats stats;
+
+    // pixels covered by the screen rectangle of the box, negative if a corner is in front of the near plane
+    static float screenArea(const glm::mat4 &viewProjection, const glm::vec3 &lo, const glm::vec3 &hi, int width,
+                            int height)
+    {
+        glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                                                        corner & 4 ? hi.z : lo.z, 1.0f);
+            if (clip.z < -clip.w || clip.w <= 0.0f)
+                return -1.0f;
+            glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            screenMin = glm::min(screenMin, ndc);
+            screenMax = glm::max(screenMax, ndc);
+        }
+        glm::vec2 size = glm::clamp(screenMax, -1.0f, 1.0f) - glm::clamp(screenMin, -1.0f, 1.0f);
+        return std::max(0.0f, size.x) * std::max(0.0f, size.y) * 0.25f * (float) width * (float) height;
+    }
+};
+
+#endif
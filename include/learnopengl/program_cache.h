@@ -0,0 +1,129 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <learnopengl/gl_extensions.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <common.h>
+
+#include <sys/stat.h>
+
+// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+// Entries are keyed by a hash of the shader sources, their defines and the driver strings,
+// so a driver update or an edited shader simply misses and the program is compiled again.
+
+const char *const PROGRAM_CACHE_DIR = "shader_cache";
+
+inline uint64_t ProgramCacheKey(const std::vector<std::string> &parts)
+{
+    uint64_t hash = HashBytes("", 0);
+    for (const std::string &part : parts) {
+        hash = HashBytes(part.data(), part.size(), hash);
+        hash = HashBytes("\0", 1, hash);
+    }
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+        const char *value = (const char *) glGetString(name);
+        if (value != nullptr)
+            hash = HashBytes(value, strlen(value), hash);
+    }
+    return hash;
+}
+
+inline std::string ProgramCachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+    return std::string(PROGRAM_CACHE_DIR) + "/" + name;
+}
+
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t format;
+    uint32_t length;
+};
+
+// returns a linked program created from the cached binary, or 0 if there is no usable entry
+inline GLuint LoadProgramBinary(uint64_t key)
+{
+    GLExtensions &ext = glExtensions();
+    if (!ext.programBinary)
+        return 0;
+
+    std::ifstream in(ProgramCachePath(key), std::ios::binary);
+    if (!in)
+        return 0;
+    ProgramBinaryHeader header;
+    if (!in.read((char *) &header, sizeof(header)) || memcmp(header.magic, "PBIN", 4) != 0)
+        return 0;
+    // a truncated or corrupt file must not ask for more than it holds
+    std::streampos start = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff remaining = in.tellg() - start;
+    in.seekg(start);
+    if (header.length == 0 || !in || remaining < 0 || (uint64_t) remaining != header.length)
+        return 0;
+    std::vector<char> binary(header.length);
+    if (!in.read(binary.data(), binary.size()))
+        return 0;
+
+    GLuint program = glCreateProgram();
+    ext.ProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // format mismatch or the driver rejected the blob, the caller compiles from source and overwrites it
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// asks the driver to keep the binary around, call before glLinkProgram
+inline void PrepareProgramBinary(GLuint program)
+{
+    GLExtensions &ext = glExtensions();
+    if (ext.programBinary)
+        ext.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+inline void SaveProgramBinary(GLuint program, uint64_t key)
+{
+    GLExtensions &ext = glExtensions();
+    if (!ext.programBinary)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    ProgramBinaryHeader header = {{'P', 'B', 'I', 'N'}, 0, 0};
+    GLsizei written = 0;
+    GLenum format = 0;
+    ext.GetProgramBinary(program, length, &written, &format, binary.data());
+    header.format = format;
+    header.length = (uint32_t) written;
+
+    mkdir(PROGRAM_CACHE_DIR, 0755);
+    // write to a temporary file first so a crash never leaves a truncated entry behind
+    std::string path = ProgramCachePath(key);
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write((const char *) &header, sizeof(header));
+        out.write(binary.data(), written);
+        if (!out) {
+            std::cout << "ERROR::PROGRAM_CACHE:: cannot write " << temporary << std::endl;
+            return;
+        }
+    }
+    std::rename(temporary.c_str(), path.c_str());
+}
+
+#endif
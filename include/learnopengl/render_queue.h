@@ -0,0 +1,379 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/mesh.h>
+#include <common.h>
+
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <algorithm>
+#include <cstdint>
+
+// the passes of a frame in the order they are drawn, the top bits of every sort key
+enum RenderPass {
+    RENDER_OPAQUE = 0,        // front to back
+    RENDER_GLOWING = 1,       // the lamps that are switched on, front to back
+    RENDER_TRANSPARENT = 2    // back to front, blended
+};
+
+// the vertex attribute an instanced draw reads the object index of each instance from, aInstanceObject in the shaders
+const GLuint INSTANCE_OBJECT_LOCATION = 6;
+
+// The draws of a frame, collected first and submitted in the order of a 64 bit sort key instead of the order they
+// were added, so each change of state is made as few times as possible:
+//   bits 62-63 pass, then for opaque passes
+//   bits 48-61 program, bit 47 culling, bits 32-46 texture set, bits 24-31 vertex array, bits 8-23 depth front to back
+// while transparent draws keep bits 38-61 for the depth back to front, in front of program and texture set.
+// Submitting keeps track of the program, the culling, the vertex array, the textures of each unit and the object
+// the light bindings were made for, and only touches what is different from the draw before. The same walk over
+// the draws in the order they were added is counted without drawing, for the stats.
+//
+// Each run of draws that differ only in their object, the same mesh of a model placed more than once or the walls
+// that share a material, is drawn as one instanced draw if the objects make the same bindings (see Submit). The objects of the
+// instances go into an instance buffer read through INSTANCE_OBJECT_LOCATION, so the draw calls of a pass follow the
+// number of different meshes instead of the number of objects.
+class RenderQueue
+{
+public:
+    RenderQueue() = default;
+
+    ~RenderQueue()
+    {
+        if (instanceBuffer)
+            glDeleteBuffers(1, &instanceBuffer);
+    }
+
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue &operator=(const RenderQueue &) = delete;
+
+    // units a draw can bind textures to, the ones above are bound for the whole frame (see IRRADIANCE_VOLUME_UNIT)
+    static const unsigned int MAX_TEXTURE_UNITS = 6;
+
+    struct StateChanges {
+        unsigned int programs = 0;
+        unsigned int textures = 0;
+        unsigned int vertexArrays = 0;
+        unsigned int culling = 0;
+        unsigned int objects = 0;   // calls to the object binding callback
+        unsigned int drawCalls = 0;
+        unsigned int instanced = 0; // draw calls of more than one instance
+    };
+
+    struct Stats {
+        unsigned int draws = 0;
+        StateChanges sorted;        // as submitted
+        StateChanges unsorted;      // had the draws gone out in the order they were added
+    };
+
+    // drops the last frame's draws, depth is measured from eye and scaled by farPlane into the key
+    void Begin(const glm::vec3 &eye, float farPlane)
+    {
+        items.clear();
+        textures.clear();
+        sorted = false;
+        this->eye = eye;
+        this->farPlane = farPlane;
+        stats = Stats();
+    }
+
+    // a mesh with its own textures, bound to units 0 and up under the sampler names of the mesh
+    void Add(RenderPass pass, Shader &shader, const Mesh &mesh, unsigned int object, const glm::vec3 &position,
+             bool twoSided)
+    {
+        Item item = makeItem(pass, shader, object, twoSided);
+        item.vertexArray = mesh.VAO;
+        item.count = (GLsizei) mesh.indices.size();
+        item.indexed = true;
+        item.samplers = mesh.SamplerNames().data();
+        for (const Texture &texture : mesh.textures)
+            textures.push_back(texture.id);
+        push(item, position);
+    }
+
+    // vertices drawn as triangles from a vertex array, with textures bound to units 0 and up whose samplers the
+    // program has set already
+    void Add(RenderPass pass, Shader &shader, GLuint vertexArray, GLsizei vertices,
+             std::initializer_list<GLuint> unitTextures, unsigned int object, const glm::vec3 &position, bool twoSided)
+    {
+        Item item = makeItem(pass, shader, object, twoSided);
+        item.vertexArray = vertexArray;
+        item.count = vertices;
+        item.indexed = false;
+        item.samplers = nullptr;
+        textures.insert(textures.end(), unitTextures.begin(), unitTextures.end());
+        push(item, position);
+    }
+
+    // draws the pass, bindObject(object) is called before the first draw of an object whose bindings differ from
+    // the last one's. bindings has an entry per object, objects with the same entry make the same bindings; without
+    // it every object's are its own. Sets objectIndex on the programs, -1 for instanced draws, whose objects all have
+    // the same bindings. Sorts the queue the first time it is called after Begin. With conditions, each draw is made
+    // under conditional rendering on the query of its object unless that is 0 (see OcclusionQueries), such a draw
+    // is never instanced.
+    void Submit(RenderPass pass, const std::function<void(unsigned int)> &bindObject = nullptr,
+                const std::vector<GLuint> *conditions = nullptr, const std::vector<uint32_t> *bindings = nullptr)
+    {
+        if (!sorted) {
+            sort();
+            // each pass on its own, in the order its draws were added
+            for (int unsortedPass = RENDER_OPAQUE; unsortedPass <= RENDER_TRANSPARENT; unsortedPass++) {
+                std::vector<uint32_t> submitted;
+                for (uint32_t i = 0; i < items.size(); i++)
+                    if (items[i].pass == unsortedPass)
+                        submitted.push_back(i);
+                walk(submitted, 0, submitted.size(), nullptr, nullptr, nullptr, false, stats.unsorted);
+            }
+            stats.draws = (unsigned int) items.size();
+            sorted = true;
+        }
+        // the run of the pass in the sorted order
+        size_t begin = 0;
+        while (begin < order.size() && items[order[begin]].pass < pass)
+            begin++;
+        size_t end = begin;
+        while (end < order.size() && items[order[end]].pass == pass)
+            end++;
+        // without bindings each object binds its own state, so two objects are never drawn as one
+        const std::vector<uint32_t> *objectBindings = bindObject ? bindings : nullptr;
+        gatherInstances(begin, end, !bindObject || bindings, conditions, objectBindings);
+        walk(order, begin, end, bindObject, conditions, objectBindings, true, stats.sorted);
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Item {
+        uint64_t key;
+        Shader *shader;
+        RenderPass pass;
+        GLuint vertexArray;
+        GLsizei count;
+        bool indexed;
+        bool twoSided;
+        unsigned int object;
+        uint32_t firstTexture;
+        uint32_t textureCount;
+        const UniformName *samplers;   // one per texture, null if the program has its samplers set
+    };
+
+    struct Run {
+        uint32_t length;          // draws from here on that are drawn as one
+        uint32_t firstInstance;   // of their objects in the instance buffer
+    };
+
+    std::vector<Item> items;
+    std::vector<GLuint> textures;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> scratch;
+    std::vector<Run> runs;             // by position in order, at the start of each run of the pass submitted
+    std::vector<uint32_t> instances;
+    GLuint instanceBuffer = 0;
+    bool sorted = false;
+    glm::vec3 eye = glm::vec3(0.0f);
+    float farPlane = 100.0f;
+    Stats stats;
+
+    Item makeItem(RenderPass pass, Shader &shader, unsigned int object, bool twoSided) const
+    {
+        Item item;
+        item.shader = &shader;
+        item.pass = pass;
+        item.twoSided = twoSided;
+        item.object = object;
+        item.firstTexture = (uint32_t) textures.size();
+        return item;
+    }
+
+    void push(Item &item, const glm::vec3 &position)
+    {
+        item.textureCount = std::min((uint32_t) textures.size() - item.firstTexture, (uint32_t) MAX_TEXTURE_UNITS);
+        uint64_t textureSet = HashBytes((const char *) (textures.data() + item.firstTexture),
+                                        item.textureCount * sizeof(GLuint)) & 0x7FFF;
+        float distance = glm::clamp(glm::length(position - eye) / farPlane, 0.0f, 1.0f);
+        uint64_t depth = (uint64_t) (distance * (float) 0xFFFFFF);
+        uint64_t program = item.shader->ID & 0x3FFF;
+        item.key = (uint64_t) item.pass << 62;
+        if (item.pass == RENDER_TRANSPARENT)
+            item.key |= (0xFFFFFF - depth) << 38 | program << 24 | textureSet << 8;
+        else
+            item.key |= program << 48 | (uint64_t) item.twoSided << 47 | textureSet << 32
+                        | (uint64_t) (item.vertexArray & 0xFF) << 24 | (depth >> 8) << 8;
+        items.push_back(item);
+    }
+
+    // least significant digit radix sort of the item indices by key, a byte at a time. A byte that is the same in
+    // every key is skipped.
+    void sort()
+    {
+        size_t count = items.size();
+        order.resize(count);
+        scratch.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            order[i] = i;
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t histogram[256] = {};
+            for (uint32_t index : order)
+                histogram[(items[index].key >> shift) & 0xFF]++;
+            if (count == 0 || histogram[(items[order[0]].key >> shift) & 0xFF] == count)
+                continue;
+            size_t offset = 0;
+            for (size_t &bucket : histogram) {
+                size_t size = bucket;
+                bucket = offset;
+                offset += size;
+            }
+            for (uint32_t index : order)
+                scratch[histogram[(items[index].key >> shift) & 0xFF]++] = index;
+            order.swap(scratch);
+        }
+    }
+
+    // the same but for the object, so the two can be drawn as instances of one draw
+    bool sameDraw(const Item &a, const Item &b, const std::vector<GLuint> *conditions,
+                  const std::vector<uint32_t> *bindings) const
+    {
+        if (a.shader != b.shader || a.vertexArray != b.vertexArray || a.count != b.count || a.indexed != b.indexed
+            || a.twoSided != b.twoSided || a.textureCount != b.textureCount || a.samplers != b.samplers)
+            return false;
+        if (bindings && (*bindings)[a.object] != (*bindings)[b.object])
+            return false;
+        // conditional rendering takes the query of one object
+        if (conditions && ((*conditions)[a.object] || (*conditions)[b.object]))
+            return false;
+        return std::equal(textures.begin() + a.firstTexture, textures.begin() + a.firstTexture + a.textureCount,
+                          textures.begin() + b.firstTexture);
+    }
+
+    // splits order[begin, end) into runs, of single draws unless merge is set, and uploads the objects of the runs
+    // of more than one draw to the instance buffer
+    void gatherInstances(size_t begin, size_t end, bool merge, const std::vector<GLuint> *conditions,
+                         const std::vector<uint32_t> *bindings)
+    {
+        runs.resize(order.size());
+        instances.clear();
+        for (size_t i = begin; i < end;) {
+            size_t next = i + 1;
+            while (merge && next < end && sameDraw(items[order[i]], items[order[next]], conditions, bindings))
+                next++;
+            runs[i].length = (uint32_t) (next - i);
+            runs[i].firstInstance = (uint32_t) instances.size();
+            if (next - i > 1)
+                for (size_t j = i; j < next; j++)
+                    instances.push_back(items[order[j]].object);
+            i = next;
+        }
+        if (instances.empty())
+            return;
+        if (!instanceBuffer)
+            glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(uint32_t), instances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // goes over the draws in sequence, counting every change of state and making it if draw is set. Drawing takes
+    // the runs of gatherInstances.
+    void walk(const std::vector<uint32_t> &sequence, size_t begin, size_t end,
+              const std::function<void(unsigned int)> &bindObject, const std::vector<GLuint> *conditions,
+              const std::vector<uint32_t> *bindings, bool draw, StateChanges &changes) const
+    {
+        Shader *program = nullptr;
+        GLuint vertexArray = 0;
+        int culling = -1;
+        // the object whose bindings were made last, or their entry in bindings
+        uint64_t binding = ~0ull;
+        GLuint bound[MAX_TEXTURE_UNITS] = {};
+        for (size_t i = begin; i < end; i++) {
+            const Item &item = items[sequence[i]];
+            if (item.shader != program) {
+                program = item.shader;
+                changes.programs++;
+                if (draw)
+                    program->use();
+            }
+            if ((int) item.twoSided != culling) {
+                culling = item.twoSided;
+                changes.culling++;
+                if (draw) {
+                    if (item.twoSided)
+                        glDisable(GL_CULL_FACE);
+                    else
+                        glEnable(GL_CULL_FACE);
+                }
+            }
+            uint64_t itemBinding = bindings ? (*bindings)[item.object] : item.object;
+            if (itemBinding != binding) {
+                binding = itemBinding;
+                changes.objects++;
+                if (draw && bindObject)
+                    bindObject(item.object);
+            }
+            for (uint32_t unit = 0; unit < item.textureCount; unit++) {
+                GLuint texture = textures[item.firstTexture + unit];
+                if (draw && item.samplers)
+                    program->setInt(item.samplers[unit], (int) unit);
+                if (bound[unit] == texture)
+                    continue;
+                bound[unit] = texture;
+                changes.textures++;
+                if (draw) {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                }
+            }
+            if (item.vertexArray != vertexArray) {
+                vertexArray = item.vertexArray;
+                changes.vertexArrays++;
+                if (draw)
+                    glBindVertexArray(vertexArray);
+            }
+            changes.drawCalls++;
+            if (!draw)
+                continue;
+            const Run &run = runs[i];
+            if (run.length > 1) {
+                // the vertex array reads the objects of this run for the one draw, then forgets them again
+                changes.instanced++;
+                program->setInt("objectIndex"_u, -1);
+                glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+                glEnableVertexAttribArray(INSTANCE_OBJECT_LOCATION);
+                glVertexAttribIPointer(INSTANCE_OBJECT_LOCATION, 1, GL_UNSIGNED_INT, sizeof(uint32_t),
+                                       (void *) (run.firstInstance * sizeof(uint32_t)));
+                glVertexAttribDivisor(INSTANCE_OBJECT_LOCATION, 1);
+                if (item.indexed)
+                    glDrawElementsInstanced(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, 0, (GLsizei) run.length);
+                else
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, item.count, (GLsizei) run.length);
+                glDisableVertexAttribArray(INSTANCE_OBJECT_LOCATION);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                if (!bindings)
+                    binding = items[sequence[i + run.length - 1]].object;
+                i += run.length - 1;
+                continue;
+            }
+            program->setInt("objectIndex"_u, (int) item.object);
+            GLuint condition = conditions ? (*conditions)[item.object] : 0;
+            if (condition)
+                glBeginConditionalRender(condition, GL_QUERY_NO_WAIT);
+            if (item.indexed)
+                glDrawElements(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, 0);
+            else
+                glDrawArrays(GL_TRIANGLES, 0, item.count);
+            if (condition)
+                glEndConditionalRender();
+        }
+        if (draw) {
+            glBindVertexArray(0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+    }
+};
+
+#endif
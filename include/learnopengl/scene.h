@@ -0,0 +1,253 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/object_transforms.h>
+
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+
+// what the render loop does with an object, see Scene
+enum SceneFlags : uint32_t {
+    SCENE_DYNAMIC = 1 << 0,         // may be moved after it is added, only these are ever looked at again
+    SCENE_TWO_SIDED = 1 << 1,       // drawn without back face culling
+    SCENE_OPAQUE = 1 << 2,          // drawn with the lighting or G-buffer shaders
+    SCENE_GLOWING = 1 << 3,         // drawn with the light shader instead, for a lamp that is switched on
+    SCENE_CASTS_SHADOWS = 1 << 4,   // drawn into the shadow maps while it does not glow
+    SCENE_SWITCHED = 1 << 5         // SCENE_GLOWING flips at run time, so it is left out of what is baked
+};
+
+// translated, then turned by each (degrees, axis) in order, then scaled, as a glm::translate/rotate/scale chain
+inline glm::mat4 PlaceObject(const glm::vec3 &position, std::initializer_list<std::pair<float, glm::vec3>> turns,
+                             const glm::vec3 &scale = glm::vec3(1.0f))
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+    for (const std::pair<float, glm::vec3> &turn : turns)
+        model = glm::rotate(model, glm::radians(turn.first), glm::normalize(turn.second));
+    return glm::scale(model, scale);
+}
+
+// The objects of the scene as parallel arrays, one entry per object in each, so a pass over the scene reads only
+// the arrays it needs front to back. Object i is object i of the ObjectTransforms too, everything drawn with an
+// objectIndex has to be added here. World matrices are computed once when an object is added and written to the
+// transforms then; afterwards only SCENE_DYNAMIC objects that were moved are written again, by Update().
+//
+// An object without a model (a quad the caller draws itself) keeps the bounds it was given, its box is the box around
+// the sphere. The bounds of the others follow their model, which may be reloaded in place: Reload() marks the objects
+// of a reloaded model and the next Update() takes their new bounds.
+class Scene
+{
+public:
+    struct Stats {
+        unsigned int objects = 0;
+        unsigned int dynamic = 0;
+        unsigned int moved = 0;   // dynamic objects written to the transforms by the last Update
+    };
+
+    explicit Scene(ObjectTransforms &transforms) : transforms(transforms)
+    {
+    }
+
+    Scene(const Scene &) = delete;
+    Scene &operator=(const Scene &) = delete;
+
+    // returns the index of the object, model may be null. center and radius are the model space bounding sphere
+    // of an object without a model. Adding objects changes every index list handed out (see Changed).
+    unsigned int Add(Model *model, const glm::mat4 &world, uint32_t objectFlags,
+                     const glm::vec3 &center = glm::vec3(0.0f), float radius = 0.0f)
+    {
+        unsigned int index = transforms.Add(world);
+        if (index != models.size())
+            std::cout << "ERROR::SCENE:: Object " << index << " was added to the transforms outside the scene"
+                      << std::endl;
+        models.push_back(model);
+        worlds.push_back(world);
+        objectFlags &= ~(MOVED | RELOADED);
+        flags.push_back(objectFlags);
+        localCenters.push_back(model ? model->boundsCenter : center);
+        localRadii.push_back(model ? model->boundsRadius : radius);
+        localMins.push_back(model ? model->boundsMin : center - glm::vec3(radius));
+        localMaxs.push_back(model ? model->boundsMax : center + glm::vec3(radius));
+        centers.emplace_back();
+        radii.emplace_back();
+        mins.emplace_back();
+        maxs.emplace_back();
+        updateBounds(index);
+        return index;
+    }
+
+    // only for SCENE_DYNAMIC objects, the transforms get the new matrix on the next Update
+    void Move(unsigned int index, const glm::mat4 &world)
+    {
+        if (!(flags[index] & SCENE_DYNAMIC)) {
+            std::cout << "ERROR::SCENE:: Object " << index << " is static and cannot be moved" << std::endl;
+            return;
+        }
+        worlds[index] = world;
+        if (!(flags[index] & MOVED)) {
+            flags[index] |= MOVED;
+            moved.push_back(index);
+        }
+    }
+
+    // the model was reloaded in place, the objects drawn with it get its new bounds on the next Update
+    void Reload(const Model &model)
+    {
+        for (unsigned int index = 0; index < models.size(); index++) {
+            if (models[index] == &model && !(flags[index] & RELOADED)) {
+                flags[index] |= RELOADED;
+                reloaded.push_back(index);
+            }
+        }
+    }
+
+    void SetFlag(unsigned int index, SceneFlags flag, bool on)
+    {
+        flags[index] = on ? flags[index] | flag : flags[index] & ~(uint32_t) flag;
+    }
+
+    // writes the moved objects to the transforms and brings the bounds up to date, call before
+    // ObjectTransforms::Update
+    void Update()
+    {
+        stats.moved = (unsigned int) moved.size();
+        changed.clear();
+        for (unsigned int index : moved) {
+            transforms.Set(index, worlds[index]);
+            flags[index] &= ~MOVED;
+            updateBounds(index);
+            changed.push_back(index);
+        }
+        moved.clear();
+        // a reloaded model brings new bounds
+        for (unsigned int index : reloaded) {
+            const Model &model = *models[index];
+            flags[index] &= ~RELOADED;
+            localCenters[index] = model.boundsCenter;
+            localRadii[index] = model.boundsRadius;
+            localMins[index] = model.boundsMin;
+            localMaxs[index] = model.boundsMax;
+            updateBounds(index);
+            if (std::find(changed.begin(), changed.end(), index) == changed.end())
+                changed.push_back(index);
+        }
+        reloaded.clear();
+        stats.objects = (unsigned int) models.size();
+        stats.dynamic = (unsigned int) std::count_if(flags.begin(), flags.end(), [](uint32_t objectFlags) {
+            return (objectFlags & SCENE_DYNAMIC) != 0;
+        });
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int) models.size();
+    }
+
+    const std::vector<Model *> &Models() const
+    {
+        return models;
+    }
+
+    // SceneFlags of each object
+    const std::vector<uint32_t> &Flags() const
+    {
+        return flags;
+    }
+
+    const std::vector<glm::mat4> &Worlds() const
+    {
+        return worlds;
+    }
+
+    // model space bounding spheres
+    const std::vector<glm::vec3> &LocalCenters() const
+    {
+        return localCenters;
+    }
+
+    const std::vector<float> &LocalRadii() const
+    {
+        return localRadii;
+    }
+
+    // world space bounding spheres
+    const std::vector<glm::vec3> &Centers() const
+    {
+        return centers;
+    }
+
+    const std::vector<float> &Radii() const
+    {
+        return radii;
+    }
+
+    // world space bounding boxes
+    const std::vector<glm::vec3> &Mins() const
+    {
+        return mins;
+    }
+
+    const std::vector<glm::vec3> &Maxs() const
+    {
+        return maxs;
+    }
+
+    // the objects whose world bounds the last Update changed, moved or reloaded
+    const std::vector<unsigned int> &Changed() const
+    {
+        return changed;
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    // mark an object waiting in the moved or reloaded list, never set by callers
+    static const uint32_t MOVED = 1u << 31;
+    static const uint32_t RELOADED = 1u << 30;
+
+    ObjectTransforms &transforms;
+    std::vector<Model *> models;
+    std::vector<uint32_t> flags;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::vec3> localCenters;
+    std::vector<float> localRadii;
+    std::vector<glm::vec3> centers;
+    std::vector<float> radii;
+    std::vector<glm::vec3> localMins;
+    std::vector<glm::vec3> localMaxs;
+    std::vector<glm::vec3> mins;
+    std::vector<glm::vec3> maxs;
+    std::vector<unsigned int> moved;
+    std::vector<unsigned int> reloaded;
+    std::vector<unsigned int> changed;
+    Stats stats;
+
+    // the radius grows with the largest scale of the world matrix, the box is the box around the turned box
+    void updateBounds(unsigned int index)
+    {
+        const glm::mat4 &world = worlds[index];
+        centers[index] = glm::vec3(world * glm::vec4(localCenters[index], 1.0f));
+        float scale = std::max(glm::length(glm::vec3(world[0])),
+                               std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        radii[index] = localRadii[index] * scale;
+
+        glm::vec3 boxCenter = glm::vec3(world * glm::vec4((localMins[index] + localMaxs[index]) * 0.5f, 1.0f));
+        glm::vec3 halfSize = (localMaxs[index] - localMins[index]) * 0.5f;
+        glm::vec3 extent = glm::abs(glm::vec3(world[0])) * halfSize.x + glm::abs(glm::vec3(world[1])) * halfSize.y
+                           + glm::abs(glm::vec3(world[2])) * halfSize.z;
+        mins[index] = boxCenter - extent;
+        maxs[index] = boxCenter + extent;
+    }
+};
+
+#endif
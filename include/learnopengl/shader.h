@@ -8,20 +8,103 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <algorithm>
 #include <common.h>
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/program_cache.h>
+
+// hash of a uniform name, constexpr so names written as "name"_u are hashed at compile time
+constexpr uint64_t HashUniformName(const char *str, size_t length)
+{
+    return HashBytes(str, length);
+}
+
+// a uniform name that has already been hashed, e.g. "pointLights[2].diffuse"_u
+struct UniformName {
+    uint64_t hash;
+};
+
+constexpr UniformName operator "" _u(const char *str, size_t length)
+{
+    return UniformName{HashUniformName(str, length)};
+}
+
+// uniform blocks shared by all programs, each one is attached to a fixed binding point
+enum UniformBlockBinding {
+    FRAME_DATA_BINDING = 0,
+    LIGHTS_BINDING = 1,
+    SHADOWS_BINDING = 2
+};
+
+// glUniform* calls made and avoided by the shadow copies in Shader, summed over all programs
+struct UniformStats {
+    unsigned int issued = 0;
+    unsigned int skipped = 0;   // the program already had the value
+    unsigned int missing = 0;   // the program has no such uniform, nothing to skip
+};
+
+// counters of the frame being drawn and of the last finished one, see EndUniformStatsFrame
+inline UniformStats &CurrentUniformStats()
+{
+    static UniformStats stats;
+    return stats;
+}
+
+inline UniformStats &LastFrameUniformStats()
+{
+    static UniformStats stats;
+    return stats;
+}
+
+// call once at the end of every frame
+inline void EndUniformStatsFrame()
+{
+    LastFrameUniformStats() = CurrentUniformStats();
+    CurrentUniformStats() = UniformStats();
+}
+
+// a uniform location resolved once up front, see Shader::uniform
+struct Uniform {
+    int location = -1;
+};
+
 class Shader
 {
 public:
-    unsigned int ID;
-    // constructor generates the shader on the fly
+    unsigned int ID = 0;
+    // constructor generates the shader on the fly, defines are inserted after the #version line of every stage.
+    // With async the program is only submitted to the driver, it becomes usable once Poll() has seen it link.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::string &defines = "", bool async = false)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath),
+          geometryPath(geometryPath != nullptr ? geometryPath : ""), defines(defines)
     {
-        std::string vertexPathString(vertexPath);
-        std::string fragmentPathString(fragmentPath);
+        Build();
+        if (!async)
+            Poll(true);
+    }
 
-        vertexPath = vertexPathString.c_str();
-        fragmentPath= fragmentPathString.c_str();
+    ~Shader()
+    {
+        discardPending();
+        if (ID != 0)
+            glDeleteProgram(ID);
+    }
+
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
+    // (re)reads the sources and starts compiling them. The current program stays in use until the new one
+    // has linked, a program that fails to build is thrown away and the old one is kept.
+    // ------------------------------------------------------------------------
+    void Build()
+    {
+        discardPending();
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -49,10 +132,8 @@ public:
             vertexCode = vShaderStream.str();
             fragmentCode = fShaderStream.str();			
             // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
+            if(!geometryPath.empty())
             {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
                 gShaderFile.open(geometryPath);
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
@@ -64,114 +145,416 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        vertexCode = injectDefines(vertexCode, defines);
+        fragmentCode = injectDefines(fragmentCode, defines);
+        if(!geometryPath.empty())
+            geometryCode = injectDefines(geometryCode, defines);
+        // 2. reuse the program binary if this driver has already linked these sources
+        pending.cacheKey = ProgramCacheKey({vertexCode, fragmentCode, geometryCode});
+        pending.program = LoadProgramBinary(pending.cacheKey);
+        if (pending.program != 0)
+        {
+            pending.fromCache = true;
+            return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 3. compile shaders, nothing here waits for the driver, the results are checked in Poll()
         // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        pending.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(pending.vertex);
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        pending.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(pending.fragment);
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        if(!geometryPath.empty())
         {
             const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            pending.geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(pending.geometry, 1, &gShaderCode, NULL);
+            glCompileShader(pending.geometry);
         }
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
+        pending.program = glCreateProgram();
+        glAttachShader(pending.program, pending.vertex);
+        glAttachShader(pending.program, pending.fragment);
+        if(pending.geometry != 0)
+            glAttachShader(pending.program, pending.geometry);
+        PrepareProgramBinary(pending.program);
+        glLinkProgram(pending.program);
+    }
 
+    // finishes the build started by Build() once the driver is done with it. Without wait this never blocks
+    // when KHR_parallel_shader_compile is available. Returns true when a new program was swapped in.
+    // ------------------------------------------------------------------------
+    bool Poll(bool wait = false)
+    {
+        if (pending.program == 0)
+            return false;
+        if (!wait && !pending.fromCache && glExtensions().parallelShaderCompile)
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+        bool linked = true;
+        if (!pending.fromCache)
+        {
+            // check every stage so all the errors get printed
+            linked &= checkCompileErrors(pending.vertex, "VERTEX");
+            linked &= checkCompileErrors(pending.fragment, "FRAGMENT");
+            if (pending.geometry != 0)
+                linked &= checkCompileErrors(pending.geometry, "GEOMETRY");
+            linked &= checkCompileErrors(pending.program, "PROGRAM");
+            if (linked)
+                SaveProgramBinary(pending.program, pending.cacheKey);
+        }
+        unsigned int program = pending.program;
+        pending.program = 0;
+        discardPending();
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            return false;
+        }
+        if (ID != 0)
+            glDeleteProgram(ID);
+        ID = program;
+        reflectUniforms();
+        bindUniformBlocks();
+        if (onLinked)
+        {
+            use();
+            onLinked(*this);
+        }
+        return true;
     }
+
+    // the program can be used, it may be an older one while a rebuild is pending
+    bool Ready() const
+    {
+        return ID != 0;
+    }
+
+    bool Pending() const
+    {
+        return pending.program != 0;
+    }
+
+    // whether the program is built from this file, paths are compared as they were passed in
+    bool UsesFile(const std::string &path) const
+    {
+        return path == vertexPath || path == fragmentPath || path == geometryPath;
+    }
+
+    // run on every program that links (sampler units and other constants), right away if one already has
+    void OnLinked(std::function<void(Shader &)> callback)
+    {
+        onLinked = std::move(callback);
+        if (onLinked && Ready())
+        {
+            use();
+            onLinked(*this);
+        }
+    }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
         glUseProgram(ID); 
     }
-    // utility uniform functions
+    // resolves a uniform to a handle that can be kept for the per-frame path
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    Uniform uniform(UniformName name) const
+    {
+        Uniform handle;
+        handle.location = location(name);
+        return handle;
+    }
+    Uniform uniform(const std::string &name) const
+    {
+        return uniform(UniformName{HashUniformName(name.data(), name.size())});
+    }
+    // utility uniform functions, names can be a std::string, a "name"_u or a Uniform handle.
+    // locations come from the table built at link time, so none of them query the driver.
+    // ------------------------------------------------------------------------
+    template<typename Name>
+    void setBool(const Name &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setInt(name, (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    template<typename Name>
+    void setInt(const Name &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        int loc = location(name);
+        if (changed(loc, &value, sizeof(value)))
+            glUniform1i(loc, value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    template<typename Name>
+    void setFloat(const Name &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        int loc = location(name);
+        if (changed(loc, &value, sizeof(value)))
+            glUniform1f(loc, value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    template<typename Name>
+    void setVec2(const Name &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        int loc = location(name);
+        if (changed(loc, &value, sizeof(value)))
+            glUniform2fv(loc, 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    template<typename Name>
+    void setVec2(const Name &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(name, glm::vec2(x, y)); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    template<typename Name>
+    void setVec3(const Name &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        int loc = location(name);
+        if (changed(loc, &value, sizeof(value)))
+            glUniform3fv(loc, 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    template<typename Name>
+    void setVec3(const Name &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(name, glm::vec3(x, y, z)); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    template<typename Name>
+    void setVec4(const Name &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        int loc = location(name);
+        if (changed(loc, &value, sizeof(value)))
+            glUniform4fv(loc, 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    template<typename Name>
+    void setVec4(const Name &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(name, glm::vec4(x, y, z, w)); 
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    template<typename Name>
+    void setMat2(const Name &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        int loc = location(name);
+        if (changed(loc, &mat, sizeof(mat)))
+            glUniformMatrix2fv(loc, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    template<typename Name>
+    void setMat3(const Name &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        int loc = location(name);
+        if (changed(loc, &mat, sizeof(mat)))
+            glUniformMatrix3fv(loc, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    template<typename Name>
+    void setMat4(const Name &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        int loc = location(name);
+        if (changed(loc, &mat, sizeof(mat)))
+            glUniformMatrix4fv(loc, 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // location lookup in the reflected table, -1 (ignored by glUniform*) if the program has no such uniform
+    // ------------------------------------------------------------------------
+    int location(UniformName name) const
+    {
+        if (uniforms.empty())
+            return -1;
+        size_t mask = uniforms.size() - 1;
+        for (size_t i = name.hash & mask; ; i = (i + 1) & mask) {
+            if (uniforms[i].location == EMPTY_SLOT)
+                return -1;
+            if (uniforms[i].hash == name.hash)
+                return uniforms[i].location;
+        }
+    }
+    int location(Uniform handle) const
+    {
+        return handle.location;
+    }
+    int location(const std::string &name) const
+    {
+        return location(UniformName{HashUniformName(name.data(), name.size())});
+    }
+    int location(const char *name) const
+    {
+        return location(UniformName{HashUniformName(name, strlen(name))});
     }
 
 private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string geometryPath;
+    std::string defines;
+    std::function<void(Shader &)> onLinked;
+
+    // a program the driver is still compiling
+    struct PendingBuild {
+        unsigned int program = 0;
+        unsigned int vertex = 0;
+        unsigned int fragment = 0;
+        unsigned int geometry = 0;
+        uint64_t cacheKey = 0;
+        bool fromCache = false;
+    };
+    PendingBuild pending;
+
+    void discardPending()
+    {
+        if (pending.vertex != 0)
+            glDeleteShader(pending.vertex);
+        if (pending.fragment != 0)
+            glDeleteShader(pending.fragment);
+        if (pending.geometry != 0)
+            glDeleteShader(pending.geometry);
+        if (pending.program != 0)
+            glDeleteProgram(pending.program);
+        pending = PendingBuild();
+    }
+
+    // flat open addressing table of every active uniform, filled once after linking
+    struct UniformSlot {
+        uint64_t hash;
+        int location;
+    };
+    static const int EMPTY_SLOT = -2;
+    std::vector<UniformSlot> uniforms;
+
+    // last value sent to each uniform location of this program, big enough for a mat4
+    struct UniformShadow {
+        bool valid = false;
+        unsigned char bytes[sizeof(glm::mat4)];
+    };
+    mutable std::vector<UniformShadow> shadow;
+
+    // compares a value against the shadow copy of its location and updates the copy,
+    // false means the program already has this value and the glUniform call can be skipped
+    bool changed(int location, const void *value, size_t size) const
+    {
+        if (location < 0 || location >= (int) shadow.size()) {
+            CurrentUniformStats().missing++;
+            return false;
+        }
+        UniformShadow &copy = shadow[location];
+        if (copy.valid && memcmp(copy.bytes, value, size) == 0) {
+            CurrentUniformStats().skipped++;
+            return false;
+        }
+        memcpy(copy.bytes, value, size);
+        copy.valid = true;
+        CurrentUniformStats().issued++;
+        return true;
+    }
+
+    void insertUniform(const std::string &name, int location)
+    {
+        uint64_t hash = HashUniformName(name.data(), name.size());
+        size_t mask = uniforms.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            if (uniforms[i].location == EMPTY_SLOT) {
+                uniforms[i].hash = hash;
+                uniforms[i].location = location;
+                return;
+            }
+            if (uniforms[i].hash == hash) {
+                std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << name << std::endl;
+                return;
+            }
+        }
+    }
+
+    // reflects all active uniforms with glGetActiveUniform. Arrays are stored both by their
+    // base name and per element ("lightPos", "lightPos[0]", "lightPos[1]", ...).
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<std::pair<std::string, int>> found;
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint) i, (GLsizei) buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            int location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue; // member of a uniform block
+
+            size_t bracket = name.size() > 3 ? name.rfind("[0]") : std::string::npos;
+            if (bracket != std::string::npos && bracket == name.size() - 3) {
+                std::string base = name.substr(0, bracket);
+                found.emplace_back(base, location);
+                for (GLint element = 0; element < size; element++) {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    found.emplace_back(elementName, glGetUniformLocation(ID, elementName.c_str()));
+                }
+            } else {
+                found.emplace_back(name, location);
+            }
+        }
+
+        size_t capacity = 16;
+        while (capacity < found.size() * 2)
+            capacity *= 2;
+        uniforms.assign(capacity, UniformSlot{0, EMPTY_SLOT});
+        int maxLocation = -1;
+        for (auto &uniform : found) {
+            insertUniform(uniform.first, uniform.second);
+            maxLocation = std::max(maxLocation, uniform.second);
+        }
+        // a freshly linked program starts with nothing known about its values
+        shadow.assign(maxLocation + 1, UniformShadow());
+    }
+
+    // GLSL requires #version to come first, so the defines go right after it
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string &source, const std::string &defines)
+    {
+        if (defines.empty())
+            return source;
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+
+    // attaches the shared uniform blocks the program uses to their binding points
+    // ------------------------------------------------------------------------
+    void bindUniformBlocks()
+    {
+        static const std::pair<const char *, GLuint> blocks[] = {
+                {"FrameData", FRAME_DATA_BINDING},
+                {"Lights",    LIGHTS_BINDING},
+                {"Shadows",   SHADOWS_BINDING},
+        };
+        for (auto &block : blocks) {
+            GLuint index = glGetUniformBlockIndex(ID, block.first);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, block.second);
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -193,6 +576,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
     }
 };
 #endif
@@ -0,0 +1,76 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/asset_watcher.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Keeps track of every program the app uses. All of them are submitted to the driver up front and
+// finished in Update() as they link, so with KHR_parallel_shader_compile startup compiles them all at
+// once instead of one after another. Shader files that change on disk are rebuilt the same way, the old
+// program stays in use until the new one has linked.
+class ShaderManager
+{
+public:
+    ShaderManager(AssetWatcher &watcher)
+    {
+        watcher.Listen([this](const std::string &path) { fileChanged(path); });
+    }
+
+    ShaderManager(const ShaderManager &) = delete;
+    ShaderManager &operator=(const ShaderManager &) = delete;
+
+    void Add(Shader &shader)
+    {
+        shaders.push_back(&shader);
+    }
+
+    void Add(ShaderVariants &variants)
+    {
+        variantSets.push_back(&variants);
+    }
+
+    // call once per frame, never waits for the driver
+    void Update()
+    {
+        for (Shader *shader : shaders)
+            shader->Poll();
+        for (ShaderVariants *variants : variantSets)
+            variants->Poll();
+    }
+
+    // every program has linked at least once (or failed to), the scene can be drawn
+    bool Ready() const
+    {
+        for (Shader *shader : shaders)
+            if (!shader->Ready() && shader->Pending())
+                return false;
+        for (ShaderVariants *variants : variantSets)
+            if (variants->Pending())
+                return false;
+        return true;
+    }
+
+private:
+    std::vector<Shader *> shaders;
+    std::vector<ShaderVariants *> variantSets;
+
+    void fileChanged(const std::string &path)
+    {
+        for (Shader *shader : shaders) {
+            if (shader->UsesFile(path)) {
+                std::cout << "Reloading shader " << path << std::endl;
+                shader->Build();
+            }
+        }
+        for (ShaderVariants *variants : variantSets)
+            if (variants->Reload(path))
+                std::cout << "Reloading shader variants " << path << std::endl;
+    }
+};
+
+#endif
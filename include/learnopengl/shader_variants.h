@@ -0,0 +1,156 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <learnopengl/shader.h>
+#include <learnopengl/uniform_blocks.h>
+
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+
+// material features a mesh can have, each one is a #define in the lighting shaders
+enum MaterialFeature {
+    HAS_SPECULAR_MAP = 1 << 0,
+    HAS_NORMAL_MAP = 1 << 1,
+    // the last active point light reads the specular map as .rgr instead of .rrr
+    ALT_SPECULAR_SWIZZLE = 1 << 2,
+    // the grayscale specular map is in the alpha channel of the diffuse texture, see PackSpecularImage
+    PACKED_SPECULAR = 1 << 3,
+    // lights come from the cluster lists of ClusteredLights instead of the Lights block
+    CLUSTERED_LIGHTING = 1 << 4,
+    // lights with a shadowMap are shadowed by the maps of ShadowMaps
+    SHADOWS = 1 << 5,
+    // the static lights come from the layers of a baked lightmap, see LightmapBaker
+    LIGHTMAPPED = 1 << 6,
+    // the baked lamps' ambient and bounced light come from the probes of an IrradianceVolume
+    IRRADIANCE_VOLUME = 1 << 7
+};
+
+// selects one permutation of a lighting shader: how many of the packed lights in the Lights block
+// are active and which material features are compiled in
+struct ShaderVariantKey {
+    unsigned int pointLights = NR_POINT_LIGHTS;
+    unsigned int spotLights = NR_SPOT_LIGHTS;
+    unsigned int features = HAS_SPECULAR_MAP | HAS_NORMAL_MAP;
+
+    ShaderVariantKey With(unsigned int materialFeatures) const
+    {
+        ShaderVariantKey key = *this;
+        key.features = (features & (ALT_SPECULAR_SWIZZLE | CLUSTERED_LIGHTING | SHADOWS | LIGHTMAPPED
+                                    | IRRADIANCE_VOLUME)) | materialFeatures;
+        return key;
+    }
+
+    uint32_t Packed() const
+    {
+        return pointLights | spotLights << 4 | features << 8;
+    }
+
+    std::string Defines() const
+    {
+        return "#define NR_POINT_LIGHTS " + std::to_string(pointLights) + "\n"
+               "#define NR_SPOT_LIGHTS " + std::to_string(spotLights) + "\n"
+               "#define HAS_SPECULAR_MAP " + std::to_string((features & HAS_SPECULAR_MAP) ? 1 : 0) + "\n"
+               "#define HAS_NORMAL_MAP " + std::to_string((features & HAS_NORMAL_MAP) ? 1 : 0) + "\n"
+               "#define ALT_SPECULAR_SWIZZLE " + std::to_string((features & ALT_SPECULAR_SWIZZLE) ? 1 : 0) + "\n"
+               "#define PACKED_SPECULAR " + std::to_string((features & PACKED_SPECULAR) ? 1 : 0) + "\n"
+               "#define CLUSTERED_LIGHTING " + std::to_string((features & CLUSTERED_LIGHTING) ? 1 : 0) + "\n"
+               "#define SHADOWS " + std::to_string((features & SHADOWS) ? 1 : 0) + "\n"
+               "#define LIGHTMAPPED " + std::to_string((features & LIGHTMAPPED) ? 1 : 0) + "\n"
+               "#define IRRADIANCE_VOLUME " + std::to_string((features & IRRADIANCE_VOLUME) ? 1 : 0) + "\n";
+    }
+};
+
+// Every permutation of one vertex/fragment shader pair. A variant is submitted to the driver the first
+// time it is asked for and kept, setup is run on each program that links (sampler units and other
+// constants). Until a variant has linked the full one is returned in its place: it has every feature the
+// shader supports and loops over all light slots, the unused ones are zeroed so they add nothing.
+class ShaderVariants
+{
+public:
+    ShaderVariants(std::string vertexPath, std::string fragmentPath, unsigned int supportedFeatures,
+                   std::function<void(Shader &)> setup = nullptr)
+            : vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath)),
+              supportedFeatures(supportedFeatures), setup(std::move(setup))
+    {
+        // a packed variant would read the specular of unpacked meshes from their diffuse alpha, the full
+        // variant lights from the Lights block, which always holds the first lights of the clustered ones, and
+        // leaves shadows and baked light out until their variants are ready. It has no alternate swizzle either:
+        // PackLights puts that light after the active ones, not in the last of all the slots the full variant
+        // loops over, so every light is read as .rrr until the variant is ready.
+        fullKey.features = supportedFeatures & ~(ALT_SPECULAR_SWIZZLE | PACKED_SPECULAR | CLUSTERED_LIGHTING
+                                                 | SHADOWS | LIGHTMAPPED | IRRADIANCE_VOLUME);
+        variant(fullKey);
+    }
+
+    Shader &Get(ShaderVariantKey key)
+    {
+        // features the shader does not implement would only produce identical programs
+        key.features &= supportedFeatures;
+        Shader &shader = variant(key);
+        shader.Poll();
+        if (shader.Ready())
+            return shader;
+        Shader &full = variant(fullKey);
+        if (!full.Ready())
+            full.Poll(true);
+        return full;
+    }
+
+    Shader &Use(ShaderVariantKey key)
+    {
+        Shader &shader = Get(key);
+        shader.use();
+        return shader;
+    }
+
+    // finishes the variants the driver is done with, call once per frame
+    void Poll()
+    {
+        for (auto &variant : variants)
+            variant.second->Poll();
+    }
+
+    // rebuilds every variant that is compiled from this file, each keeps its old program until the new one links
+    bool Reload(const std::string &path)
+    {
+        if (path != vertexPath && path != fragmentPath)
+            return false;
+        for (auto &variant : variants)
+            variant.second->Build();
+        return true;
+    }
+
+    // the full variant is still compiling, nothing can be drawn with this set yet
+    bool Pending() const
+    {
+        auto it = variants.find(fullKey.Packed());
+        return it != variants.end() && !it->second->Ready() && it->second->Pending();
+    }
+
+    size_t Count() const
+    {
+        return variants.size();
+    }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    unsigned int supportedFeatures;
+    std::function<void(Shader &)> setup;
+    ShaderVariantKey fullKey;
+    std::map<uint32_t, std::unique_ptr<Shader>> variants;
+
+    Shader &variant(const ShaderVariantKey &key)
+    {
+        std::unique_ptr<Shader> &variant = variants[key.Packed()];
+        if (!variant) {
+            variant.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, key.Defines(), true));
+            variant->OnLinked(setup);
+        }
+        return *variant;
+    }
+};
+
+#endif
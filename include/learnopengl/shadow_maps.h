@@ -0,0 +1,476 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/uniform_buffer.h>
+#include <learnopengl/light_radius.h>
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+
+// texture units of the map arrays, sampled as sampler2DArrayShadow
+const GLuint DIR_SHADOW_UNIT = 13;
+const GLuint SPOT_SHADOW_UNIT = 14;
+const GLuint POINT_SHADOW_UNIT = 15;
+
+// a point light's map is a cube drawn as six layers: +X, -X, +Y, -Y, +Z, -Z, the shaders pick one by the major axis
+const unsigned int POINT_SHADOW_FACES = 6;
+
+const float SHADOW_NEAR_PLANE = 0.05f;
+
+struct ShadowSettings {
+    int directionalResolution = 2048;
+    int spotResolution = 1024;
+    int pointResolution = 512;
+    int updateBudget = 4;   // maps drawn again per frame at most, the six faces of a point light count as one
+    int pointLights = 4;    // point lights that cast shadows, the ones with the largest radius of influence
+};
+
+// Shadow maps for the directional light, the spot lights and the point lights. Drawing every map every frame would
+// cost a scene draw per map and face, so each map is cached: it is drawn again only when its light space matrices
+// change (the light moved) or InvalidateStatic() is called (a caster moved), and no more than the budget is drawn
+// in one frame. A light whose map is out of date keeps its old map together with the matrices it was drawn with
+// until its turn comes. Only static casters go into the cached maps. When there are dynamic casters every map in
+// use is copied to a second layer each frame and they are drawn on top of the copy, the shaders read those layers.
+class ShadowMaps
+{
+public:
+    struct Stats {
+        unsigned int maps = 0;       // lights that are shadowed this frame
+        unsigned int rendered = 0;   // maps whose static casters were drawn this frame
+        unsigned int waiting = 0;    // maps out of date that did not fit in the budget
+    };
+
+    ShadowMaps(GLuint binding) : shadows(binding)
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glGenFramebuffers(1, &copyFramebuffer);
+        arrays[DIRECTIONAL_MAPS].unit = DIR_SHADOW_UNIT;
+        arrays[SPOT_MAPS].unit = SPOT_SHADOW_UNIT;
+        arrays[POINT_MAPS].unit = POINT_SHADOW_UNIT;
+        arrays[POINT_MAPS].faces = POINT_SHADOW_FACES;
+        // the shaders may be linked before the first frame with shadows, they need a texture of the right kind
+        allocate();
+    }
+
+    ~ShadowMaps()
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteFramebuffers(1, &copyFramebuffer);
+        for (MapArray &maps : arrays)
+            glDeleteTextures(1, &maps.texture);
+    }
+
+    ShadowMaps(const ShadowMaps &) = delete;
+    ShadowMaps &operator=(const ShadowMaps &) = delete;
+
+    // changing a resolution or the number of shadowed point lights reallocates the maps, they are all drawn again
+    void SetSettings(const ShadowSettings &newSettings)
+    {
+        bool reallocate = newSettings.directionalResolution != settings.directionalResolution
+                          || newSettings.spotResolution != settings.spotResolution
+                          || newSettings.pointResolution != settings.pointResolution
+                          || newSettings.pointLights != settings.pointLights;
+        settings = newSettings;
+        if (reallocate)
+            allocate();
+    }
+
+    // the sphere around everything that casts or receives shadows, the directional map covers it
+    void SetSceneBounds(const glm::vec3 &center, float radius)
+    {
+        sceneCenter = center;
+        sceneRadius = radius;
+    }
+
+    // the static casters changed, every cached map is out of date
+    void InvalidateStatic()
+    {
+        staticVersion++;
+    }
+
+    // Gives each light the map it is shadowed with this frame and decides which maps are drawn in Render().
+    // Call once the lights of the frame are final and before they are packed or uploaded.
+    void Assign(DirLightData &dirLight, std::vector<PointLightData> &pointLights,
+                std::vector<SpotLightData> &spotLights)
+    {
+        stats = Stats();
+        for (std::vector<Request> &typeRequests : requests)
+            typeRequests.clear();
+        dirLight.shadowMap = 0.0f;
+        for (SpotLightData &light : spotLights)
+            light.shadowMap = 0.0f;
+        for (PointLightData &light : pointLights)
+            light.shadowMap = 0.0f;
+
+        // a directional light that only adds ambient light has nothing to shadow
+        if (MaxChannel(dirLight.diffuse) + MaxChannel(dirLight.specular) > 0.0f)
+            directionalMatrices(dirLight, addRequest(DIRECTIONAL_MAPS, 0).matrices);
+        for (size_t i = 0; i < spotLights.size() && i < arrays[SPOT_MAPS].slots.size(); i++)
+            spotMatrices(spotLights[i], addRequest(SPOT_MAPS, (int) i).matrices);
+
+        // the point lights that reach furthest, usually the room's own lamps rather than small decorative lights
+        order.clear();
+        for (size_t i = 0; i < pointLights.size(); i++)
+            order.push_back(i);
+        size_t shadowed = std::min(order.size(), arrays[POINT_MAPS].slots.size());
+        std::partial_sort(order.begin(), order.begin() + shadowed, order.end(), [&](size_t a, size_t b) {
+            return InfluenceRadius(pointLights[a]) > InfluenceRadius(pointLights[b]);
+        });
+        for (size_t i = 0; i < shadowed; i++)
+            pointMatrices(pointLights[order[i]], addRequest(POINT_MAPS, (int) order[i]).matrices);
+
+        for (int type = 0; type < MAP_TYPES; type++)
+            assignSlots(arrays[type], requests[type]);
+        schedule();
+
+        for (int type = 0; type < MAP_TYPES; type++) {
+            for (const Request &request : requests[type]) {
+                if (request.slot < 0)
+                    continue;
+                float shadowMap = (float) (request.slot + 1);
+                if (type == DIRECTIONAL_MAPS)
+                    dirLight.shadowMap = shadowMap;
+                else if (type == SPOT_MAPS)
+                    spotLights[request.light].shadowMap = shadowMap;
+                else
+                    pointLights[request.light].shadowMap = shadowMap;
+                stats.maps++;
+            }
+        }
+    }
+
+    // Draws the maps Assign() scheduled and the dynamic casters of every map in use, then uploads the Shadows block
+    // and binds the maps. drawCasters draws the static or the dynamic casters with the given shader, which takes
+    // the objectIndex and a lightViewProjection matrix. The viewport is restored, the framebuffer is left unbound.
+    void Render(Shader &depthShader, const std::function<void(Shader &, bool dynamic)> &drawCasters,
+                bool dynamicCasters)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        // casters are drawn from both sides, the offset keeps lit surfaces from shadowing themselves
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        depthShader.use();
+
+        for (int type = 0; type < MAP_TYPES; type++) {
+            MapArray &maps = arrays[type];
+            glViewport(0, 0, maps.resolution, maps.resolution);
+            for (size_t i = 0; i < maps.slots.size(); i++) {
+                Slot &slot = maps.slots[i];
+                if (!slot.scheduled)
+                    continue;
+                for (unsigned int face = 0; face < maps.faces; face++) {
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps.texture, 0,
+                                              (GLint) (i * maps.faces + face));
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    matrix(type, i, face) = slot.pending[face];
+                    depthShader.setMat4("lightViewProjection"_u, slot.pending[face]);
+                    drawCasters(depthShader, false);
+                }
+                slot.signature = slot.pendingSignature;
+                slot.rendered = true;
+                slot.scheduled = false;
+                stats.rendered++;
+            }
+        }
+
+        // the static layers stay as they are, each map in use gets a live copy with the dynamic casters added
+        if (dynamicCasters) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+            for (int type = 0; type < MAP_TYPES; type++) {
+                MapArray &maps = arrays[type];
+                GLint live = (GLint) (maps.slots.size() * maps.faces);
+                glViewport(0, 0, maps.resolution, maps.resolution);
+                for (size_t i = 0; i < maps.slots.size(); i++) {
+                    if (!maps.slots[i].inUse)
+                        continue;
+                    for (unsigned int face = 0; face < maps.faces; face++) {
+                        GLint layer = (GLint) (i * maps.faces + face);
+                        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps.texture, 0, layer);
+                        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps.texture, 0,
+                                                  live + layer);
+                        glBlitFramebuffer(0, 0, maps.resolution, maps.resolution, 0, 0, maps.resolution,
+                                          maps.resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                        depthShader.setMat4("lightViewProjection"_u, matrix(type, i, face));
+                        drawCasters(depthShader, true);
+                    }
+                }
+            }
+        }
+        shadows.data.shadowLayerOffsets = glm::vec4(0.0f);
+        if (dynamicCasters) {
+            shadows.data.shadowLayerOffsets = glm::vec4(
+                    (float) arrays[DIRECTIONAL_MAPS].slots.size() * arrays[DIRECTIONAL_MAPS].faces,
+                    (float) arrays[SPOT_MAPS].slots.size() * arrays[SPOT_MAPS].faces,
+                    (float) arrays[POINT_MAPS].slots.size() * arrays[POINT_MAPS].faces, 0.0f);
+        }
+        shadows.Upload();
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        if (cullFace)
+            glEnable(GL_CULL_FACE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        bindTextures();
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    enum MapType {
+        DIRECTIONAL_MAPS,
+        SPOT_MAPS,
+        POINT_MAPS,
+        MAP_TYPES
+    };
+
+    // one light's map: its faces in the static half of the array and their live copies in the other half
+    struct Slot {
+        uint64_t signature = 0;          // what the map was drawn with
+        uint64_t pendingSignature = 0;   // what the light needs this frame
+        glm::mat4 pending[POINT_SHADOW_FACES];
+        int owner = -1;                  // index of the light in its list when the map was last assigned
+        bool rendered = false;           // holds a map of the owner, maybe an old one
+        bool scheduled = false;          // drawn in this frame's Render()
+        bool inUse = false;              // read by a light this frame
+    };
+
+    struct MapArray {
+        GLuint texture = 0;
+        GLuint unit = 0;
+        int resolution = 0;
+        unsigned int faces = 1;
+        std::vector<Slot> slots;
+    };
+
+    struct Request {
+        int light = 0;
+        uint64_t signature = 0;
+        glm::mat4 matrices[POINT_SHADOW_FACES];
+        int slot = -1;
+    };
+
+    ShadowSettings settings;
+    UniformBuffer<ShadowsData> shadows;
+    GLuint framebuffer = 0;
+    GLuint copyFramebuffer = 0;
+    MapArray arrays[MAP_TYPES];
+    std::vector<Request> requests[MAP_TYPES];
+    std::vector<size_t> order;
+    std::vector<std::pair<bool, Slot *>> due;
+    glm::vec3 sceneCenter = glm::vec3(0.0f);
+    float sceneRadius = 10.0f;
+    uint64_t staticVersion = 0;
+    Stats stats;
+
+    void allocate()
+    {
+        const int resolutions[MAP_TYPES] = {settings.directionalResolution, settings.spotResolution,
+                                            settings.pointResolution};
+        const int slots[MAP_TYPES] = {1, (int) NR_SPOT_LIGHTS,
+                                      std::max(0, std::min(settings.pointLights, (int) NR_POINT_LIGHTS))};
+        for (int type = 0; type < MAP_TYPES; type++) {
+            MapArray &maps = arrays[type];
+            maps.resolution = resolutions[type];
+            maps.slots.assign(slots[type], Slot());
+            if (maps.texture == 0)
+                glGenTextures(1, &maps.texture);
+            glActiveTexture(GL_TEXTURE0 + maps.unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, maps.texture);
+            // the static layers, then as many for the live copies. An empty array still needs a layer to be valid.
+            GLsizei layers = std::max(1, 2 * slots[type] * (int) maps.faces);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, maps.resolution, maps.resolution, layers, 0,
+                         GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            // linear filtering with comparison blends four depth tests, a 2x2 PCF for free
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, arrays[DIRECTIONAL_MAPS].texture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SHADOW_MAPS:: Framebuffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, copyFramebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void bindTextures()
+    {
+        for (MapArray &maps : arrays) {
+            glActiveTexture(GL_TEXTURE0 + maps.unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, maps.texture);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    glm::mat4 &matrix(int type, size_t slot, unsigned int face)
+    {
+        if (type == DIRECTIONAL_MAPS)
+            return shadows.data.dirShadowMatrix;
+        if (type == SPOT_MAPS)
+            return shadows.data.spotShadowMatrices[slot];
+        return shadows.data.pointShadowMatrices[slot * POINT_SHADOW_FACES + face];
+    }
+
+    // the light space matrices are filled in by the caller
+    Request &addRequest(int type, int light)
+    {
+        requests[type].emplace_back();
+        Request &request = requests[type].back();
+        request.light = light;
+        return request;
+    }
+
+    // A light keeps the slot that holds its current map, failing that the one it had before (its old map is
+    // better than none while it waits), failing that any free one. The matrices identify a map: a light that
+    // moves or turns gets different ones.
+    void assignSlots(MapArray &maps, std::vector<Request> &lightRequests)
+    {
+        for (Slot &slot : maps.slots) {
+            slot.inUse = false;
+            slot.scheduled = false;
+        }
+        for (Request &request : lightRequests) {
+            request.signature = HashBytes((const char *) request.matrices, maps.faces * sizeof(glm::mat4),
+                                          HashBytes((const char *) &staticVersion, sizeof(staticVersion)));
+            for (size_t i = 0; i < maps.slots.size(); i++) {
+                Slot &slot = maps.slots[i];
+                if (!slot.inUse && slot.rendered && slot.signature == request.signature) {
+                    // lights before it in the list may have been switched off, the map follows it to its new index
+                    request.slot = (int) i;
+                    slot.owner = request.light;
+                    slot.inUse = true;
+                    slot.pendingSignature = request.signature;
+                    break;
+                }
+            }
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            for (Request &request : lightRequests) {
+                if (request.slot >= 0)
+                    continue;
+                for (size_t i = 0; i < maps.slots.size(); i++) {
+                    Slot &slot = maps.slots[i];
+                    if (slot.inUse || (pass == 0 && slot.owner != request.light))
+                        continue;
+                    if (slot.owner != request.light) {
+                        slot.owner = request.light;
+                        slot.rendered = false;
+                    }
+                    request.slot = (int) i;
+                    slot.inUse = true;
+                    slot.pendingSignature = request.signature;
+                    std::copy(request.matrices, request.matrices + maps.faces, slot.pending);
+                    break;
+                }
+            }
+        }
+    }
+
+    // the maps out of date within the budget, empty ones before old ones. A light whose slot is empty and not
+    // scheduled goes without shadows this frame.
+    void schedule()
+    {
+        due.clear();
+        for (MapArray &maps : arrays)
+            for (Slot &slot : maps.slots)
+                if (slot.inUse && (!slot.rendered || slot.signature != slot.pendingSignature))
+                    due.push_back(std::make_pair(slot.rendered, &slot));
+        std::stable_sort(due.begin(), due.end(),
+                         [](const std::pair<bool, Slot *> &a, const std::pair<bool, Slot *> &b) {
+                             return !a.first && b.first;
+                         });
+        size_t budget = (size_t) std::max(settings.updateBudget, 0);
+        for (size_t i = 0; i < due.size(); i++) {
+            if (i < budget)
+                due[i].second->scheduled = true;
+            else
+                stats.waiting++;
+        }
+
+        for (int type = 0; type < MAP_TYPES; type++) {
+            for (Request &request : requests[type]) {
+                if (request.slot < 0)
+                    continue;
+                Slot &slot = arrays[type].slots[request.slot];
+                if (!slot.rendered && !slot.scheduled) {
+                    slot.inUse = false;
+                    request.slot = -1;
+                }
+            }
+        }
+    }
+
+    // an orthographic box around the scene bounds, looking down the light direction
+    void directionalMatrices(const DirLightData &light, glm::mat4 *matrices) const
+    {
+        glm::vec3 direction = glm::normalize(light.direction);
+        glm::mat4 view = glm::lookAt(sceneCenter - direction * sceneRadius, sceneCenter, upVector(direction));
+        matrices[0] = glm::ortho(-sceneRadius, sceneRadius, -sceneRadius, sceneRadius, 0.0f, 2.0f * sceneRadius) * view;
+    }
+
+    // a square frustum around the outer cone, no further than the light reaches or the scene goes
+    void spotMatrices(const SpotLightData &light, glm::mat4 *matrices) const
+    {
+        glm::vec3 direction = glm::normalize(light.direction);
+        float fov = std::min(2.0f * std::acos(light.outerCutOff) + glm::radians(2.0f), glm::radians(170.0f));
+        glm::mat4 view = glm::lookAt(light.position, light.position + direction, upVector(direction));
+        matrices[0] = glm::perspective(fov, 1.0f, SHADOW_NEAR_PLANE, farPlane(light.position, InfluenceRadius(light)))
+                      * view;
+    }
+
+    void pointMatrices(const PointLightData &light, glm::mat4 *matrices) const
+    {
+        static const glm::vec3 directions[POINT_SHADOW_FACES] = {
+                glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+        static const glm::vec3 ups[POINT_SHADOW_FACES] = {
+                glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)};
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE,
+                                                farPlane(light.position, InfluenceRadius(light)));
+        for (unsigned int face = 0; face < POINT_SHADOW_FACES; face++)
+            matrices[face] = projection * glm::lookAt(light.position, light.position + directions[face], ups[face]);
+    }
+
+    float farPlane(const glm::vec3 &position, float radius) const
+    {
+        float sceneFar = glm::distance(position, sceneCenter) + sceneRadius;
+        return std::max(std::min(radius, sceneFar), 2.0f * SHADOW_NEAR_PLANE);
+    }
+
+    static glm::vec3 upVector(const glm::vec3 &direction)
+    {
+        return std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+};
+
+#endif
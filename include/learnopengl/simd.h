@@ -0,0 +1,11 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE is there on every x86-64 target and on 32 bit ones built for it. LEARNOPENGL_SSE is defined when it can be
+// used, the code that uses it keeps a scalar path for the other targets.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LEARNOPENGL_SSE 1
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glm/glm.hpp>
+
+// CPU mirrors of the std140 uniform blocks declared in the shaders.
+// Every vec3 is followed by a float so that members land on the std140 offsets.
+
+const unsigned int NR_POINT_LIGHTS = 6;
+const unsigned int NR_SPOT_LIGHTS = 3;
+// baked light groups a lightmap can hold, see LightmapBaker
+const unsigned int MAX_LIGHTMAP_LAYERS = 8;
+
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float pad0;
+    // pixels per cluster and the constants of slice = log(depth) * scale + bias, see ClusteredLights
+    glm::vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    // how much of each lightmap layer is added, 0 or 1 as the lamps of the layer are switched
+    glm::vec4 lightmapWeights[MAX_LIGHTMAP_LAYERS / 4];
+};
+
+struct DirLightData {
+    glm::vec3 direction;
+    float shadowMap;            // 1 + the slot of the light's map in ShadowMaps, 0 for none
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct PointLightData {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float altSpecularSwizzle;   // 1 marks the light that reads the specular map as .rgr
+    float inverseRadius;        // see SetLightRadius, 0 for no limit
+    float shadowMap;            // as in DirLightData
+    float pad1;
+    float pad2;
+};
+
+struct SpotLightData {
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+    float inverseRadius;
+    float shadowMap;
+    float pad1;
+    float pad2;
+};
+
+struct LightsData {
+    DirLightData dirLight;
+    PointLightData pointLights[NR_POINT_LIGHTS];
+    SpotLightData spotLights[NR_SPOT_LIGHTS];
+};
+
+// light space matrices of the shadow maps, see ShadowMaps. A point light's map is six faces in a row.
+struct ShadowsData {
+    glm::mat4 dirShadowMatrix;
+    glm::mat4 spotShadowMatrices[NR_SPOT_LIGHTS];
+    glm::mat4 pointShadowMatrices[NR_POINT_LIGHTS * 6];
+    // added to the layer of every map, x directional, y spot and z point: selects the static or the live copies
+    glm::vec4 shadowLayerOffsets;
+};
+
+static_assert(sizeof(FrameData) == 192, "FrameData does not match the std140 layout");
+static_assert(sizeof(DirLightData) == 64, "DirLight does not match the std140 layout");
+static_assert(sizeof(PointLightData) == 80, "PointLight does not match the std140 layout");
+static_assert(sizeof(SpotLightData) == 96, "SpotLight does not match the std140 layout");
+static_assert(sizeof(ShadowsData) == 40 * 64 + 16, "Shadows does not match the std140 layout");
+
+#endif
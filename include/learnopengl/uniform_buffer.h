@@ -0,0 +1,61 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// A uniform buffer holding one std140 struct, attached to a fixed binding point.
+// Edit data and call Upload(), the buffer is only written when data changed since the last upload.
+template<typename T>
+class UniformBuffer
+{
+public:
+    T data;
+
+    UniformBuffer(GLuint binding) : binding(binding)
+    {
+        memset(static_cast<void *>(&data), 0, sizeof(T));
+        memset(static_cast<void *>(&uploaded), 0, sizeof(T));
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // attaches the buffer to its binding point again, after something else was bound there
+    void Bind()
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    ~UniformBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+
+    UniformBuffer(const UniformBuffer &) = delete;
+    UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+    // returns true if the buffer had to be written
+    bool Upload()
+    {
+        if (!first && memcmp(&data, &uploaded, sizeof(T)) == 0)
+            return false;
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        memcpy(static_cast<void *>(&uploaded), &data, sizeof(T));
+        first = false;
+        return true;
+    }
+
+private:
+    GLuint ID;
+    GLuint binding;
+    T uploaded;
+    bool first = true;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+// A fixed set of threads for work that is split the same way every frame. Run(job) calls job(share) once for every
+// share from 0 to Threads() - 1, share 0 on the calling thread and the others on threads that wait between jobs, and
+// returns when all of them are done. A job takes the items share, share + Threads(), ... of its work.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned int threads) : threadCount(std::max(1u, threads))
+    {
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    unsigned int Threads() const
+    {
+        return threadCount;
+    }
+
+    void Run(const std::function<void(unsigned int share)> &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->job = &job;
+            generation++;
+            pending = (unsigned int) workers.size();
+        }
+        jobReady.notify_all();
+        job(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [this] { return pending == 0; });
+        this->job = nullptr;
+    }
+
+private:
+    unsigned int threadCount;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    const std::function<void(unsigned int)> *job = nullptr;
+    unsigned int generation = 0;
+    unsigned int pending = 0;
+    bool stopping = false;
+
+    void workerLoop(unsigned int share)
+    {
+        unsigned int seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            jobReady.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            const std::function<void(unsigned int)> &current = *job;
+            lock.unlock();
+            current(share);
+            lock.lock();
+            if (--pending == 0)
+                jobDone.notify_one();
+        }
+    }
+};
+
+#endif
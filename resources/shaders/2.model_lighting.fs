@@ -4,11 +4,14 @@ layout (location = 0) out vec4 FragColor;
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
+    sampler2D texture_normal1;
     float shininess;
 };
 
+// std140 layouts, mirrored by the structs in learnopengl/uniform_blocks.h
 struct DirLight {
     vec3 direction;
+    float shadowMap;
 
     vec3 ambient;
     vec3 diffuse;
@@ -17,71 +20,333 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
+    float altSpecularSwizzle;
+    float inverseRadius;
+    float shadowMap;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
+    float inverseRadius;
+    float shadowMap;
 };
 
-#define NR_POINT_LIGHTS 6
-#define NR_SPOT_LIGHTS 3
+// the Lights block always holds MAX_* lights, packed so that the active ones come first.
+// ShaderVariants injects the active counts and the material features, the defaults below
+// are the full shader.
+#define MAX_POINT_LIGHTS 6
+#define MAX_SPOT_LIGHTS 3
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS MAX_POINT_LIGHTS
+#endif
+#ifndef NR_SPOT_LIGHTS
+#define NR_SPOT_LIGHTS MAX_SPOT_LIGHTS
+#endif
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+#ifndef ALT_SPECULAR_SWIZZLE
+#define ALT_SPECULAR_SWIZZLE 0
+#endif
+#ifndef PACKED_SPECULAR
+#define PACKED_SPECULAR 0
+#endif
+#ifndef CLUSTERED_LIGHTING
+#define CLUSTERED_LIGHTING 0
+#endif
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+#ifndef LIGHTMAPPED
+#define LIGHTMAPPED 0
+#endif
+#ifndef IRRADIANCE_VOLUME
+#define IRRADIANCE_VOLUME 0
+#endif
 
 in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+#if HAS_NORMAL_MAP
+    vec3 Tangent;
+#endif
+#if LIGHTMAPPED
+    vec2 LightmapCoords;
+#endif
 } fs_in;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    SpotLight spotLights[MAX_SPOT_LIGHTS];
+};
+
 uniform Material material;
 
+#if CLUSTERED_LIGHTING
+// clustered forward lighting, the lists are built by learnopengl/clustered_lights.h
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+uniform samplerBuffer clusterLightData;      // PointLight and SpotLight structs, 5 and 6 texels each
+uniform usamplerBuffer clusterRecords;       // per cluster: offset into the index list, point count, spot count
+uniform usamplerBuffer clusterLightIndices;  // first texel of each light in clusterLightData
+
+PointLight FetchPointLight(int texel)
+{
+    vec4 t0 = texelFetch(clusterLightData, texel);
+    vec4 t1 = texelFetch(clusterLightData, texel + 1);
+    vec4 t2 = texelFetch(clusterLightData, texel + 2);
+    vec4 t3 = texelFetch(clusterLightData, texel + 3);
+    vec4 t4 = texelFetch(clusterLightData, texel + 4);
+    return PointLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.x, t4.y);
+}
+
+SpotLight FetchSpotLight(int texel)
+{
+    vec4 t0 = texelFetch(clusterLightData, texel);
+    vec4 t1 = texelFetch(clusterLightData, texel + 1);
+    vec4 t2 = texelFetch(clusterLightData, texel + 2);
+    vec4 t3 = texelFetch(clusterLightData, texel + 3);
+    vec4 t4 = texelFetch(clusterLightData, texel + 4);
+    vec4 t5 = texelFetch(clusterLightData, texel + 5);
+    return SpotLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.xyz, t4.w, t5.x, t5.y);
+}
+#endif
+
+#if SHADOWS
+// the maps of learnopengl/shadow_maps.h, a light's shadowMap is 1 + the slot of its map, 0 for none
+layout (std140) uniform Shadows {
+    mat4 dirShadowMatrix;
+    mat4 spotShadowMatrices[MAX_SPOT_LIGHTS];
+    mat4 pointShadowMatrices[MAX_POINT_LIGHTS * 6];
+    vec4 shadowLayerOffsets;
+};
+uniform sampler2DArrayShadow dirShadowMap;
+uniform sampler2DArrayShadow spotShadowMaps;
+uniform sampler2DArrayShadow pointShadowMaps;
+
+// the lookup point is pushed off the surface a little, along with the depth offset the maps are drawn with
+#define SHADOW_NORMAL_OFFSET 0.03
+
+// how much of the light reaches the point, four filtered depth tests spread over a 2x2 texel square
+float SampleShadow(sampler2DArrayShadow maps, mat4 lightMatrix, float layer, vec3 position)
+{
+    vec4 clip = lightMatrix * vec4(position, 1.0);
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    vec2 texel = 0.5 / vec2(textureSize(maps, 0).xy);
+    float depth = min(coords.z, 1.0);
+    float lit = texture(maps, vec4(coords.xy + vec2(-texel.x, -texel.y), layer, depth))
+              + texture(maps, vec4(coords.xy + vec2( texel.x, -texel.y), layer, depth))
+              + texture(maps, vec4(coords.xy + vec2(-texel.x,  texel.y), layer, depth))
+              + texture(maps, vec4(coords.xy + vec2( texel.x,  texel.y), layer, depth));
+    return lit * 0.25;
+}
+
+float DirShadow(DirLight light, vec3 position)
+{
+    if (light.shadowMap == 0.0)
+        return 1.0;
+    return SampleShadow(dirShadowMap, dirShadowMatrix, shadowLayerOffsets.x, position);
+}
+
+float SpotShadow(SpotLight light, vec3 position)
+{
+    if (light.shadowMap == 0.0)
+        return 1.0;
+    int slot = int(light.shadowMap) - 1;
+    return SampleShadow(spotShadowMaps, spotShadowMatrices[slot], float(slot) + shadowLayerOffsets.y, position);
+}
+
+// the face of the cube is the one the major axis of the light to point direction goes through
+float PointShadow(PointLight light, vec3 position)
+{
+    if (light.shadowMap == 0.0)
+        return 1.0;
+    vec3 d = position - light.position;
+    vec3 a = abs(d);
+    int face = a.x >= a.y && a.x >= a.z ? (d.x >= 0.0 ? 0 : 1) : a.y >= a.z ? (d.y >= 0.0 ? 2 : 3) : (d.z >= 0.0 ? 4 : 5);
+    int layer = (int(light.shadowMap) - 1) * 6 + face;
+    return SampleShadow(pointShadowMaps, pointShadowMatrices[layer], float(layer) + shadowLayerOffsets.z, position);
+}
+#endif
+
+#if LIGHTMAPPED
+// the static lights baked by learnopengl/lightmap_baker.h, one layer per group of lights switched together. A layer
+// holds the light falling on the surface, diffuse and ambient of every bounce, and is added as lightmapWeights says.
+uniform sampler2DArray lightmap;
+
+vec3 BakedLight(vec2 coords)
+{
+    vec3 light = vec3(0.0);
+    int layers = textureSize(lightmap, 0).z;
+    for(int i = 0; i < layers; i++)
+    {
+        float weight = lightmapWeights[i / 4][i % 4];
+        if (weight != 0.0)
+            light += weight * texture(lightmap, vec3(coords, float(i))).rgb;
+    }
+    return light;
+}
+#endif
+
+#if IRRADIANCE_VOLUME
+// the probe grid of learnopengl/irradiance_volume.h over the box from probeGridMin to probeGridMin + probeGridSize.
+// A probe holds the L2 spherical harmonics of the irradiance of the baked lamps that are on, bounced light and
+// their ambient terms, in 7 texels stacked along z.
+uniform sampler3D irradianceVolume;
+uniform vec3 probeGridMin;
+uniform vec3 probeGridSize;
+
+vec3 ProbeIrradiance(vec3 position, vec3 n)
+{
+    ivec3 size = textureSize(irradianceVolume, 0);
+    vec3 count = vec3(size.xy, size.z / 7);
+    // between the probe centers, clamped so filtering never mixes two slabs
+    vec3 cell = clamp((position - probeGridMin) / probeGridSize * count, vec3(0.5), count - 0.5);
+    vec2 xy = cell.xy / count.xy;
+    vec4 c[7];
+    for(int i = 0; i < 7; i++)
+        c[i] = texture(irradianceVolume, vec3(xy, (cell.z + float(i) * count.z) / float(size.z)));
+    vec3 irradiance = c[0].rgb * 0.282095
+                    + vec3(c[0].a, c[1].rg) * 0.488603 * n.y
+                    + vec3(c[1].ba, c[2].r) * 0.488603 * n.z
+                    + c[2].gba * 0.488603 * n.x
+                    + c[3].rgb * 1.092548 * n.x * n.y
+                    + vec3(c[3].a, c[4].rg) * 1.092548 * n.y * n.z
+                    + vec3(c[4].ba, c[5].r) * 0.315392 * (3.0 * n.z * n.z - 1.0)
+                    + c[5].gba * 1.092548 * n.x * n.z
+                    + c[6].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(irradiance, vec3(0.0));
+}
+#endif
+
+// material textures, sampled once per fragment and shared by every light
+struct MaterialSample {
+    vec3 diffuse;
+    vec3 specular;      // .rrr of the specular map
+    vec3 specularAlt;   // .rgr, read by the last point light with ALT_SPECULAR_SWIZZLE
+};
+
+MaterialSample SampleMaterial(vec2 texCoords)
+{
+    MaterialSample m;
+    vec4 diffuseMap = texture(material.texture_diffuse1, texCoords);
+    m.diffuse = diffuseMap.rgb;
+#if PACKED_SPECULAR
+    // grayscale specular map packed into the diffuse alpha at import, both swizzles read the same value
+    m.specular = vec3(diffuseMap.a);
+    m.specularAlt = m.specular;
+#elif HAS_SPECULAR_MAP
+    vec3 specularMap = texture(material.texture_specular1, texCoords).rgb;
+    m.specular = specularMap.rrr;
+    m.specularAlt = specularMap.rgr;
+#else
+    m.specular = vec3(0.0);
+    m.specularAlt = vec3(0.0);
+#endif
+    return m;
+}
+
+// the attenuation fades to exactly zero at the light's radius of influence, see learnopengl/light_radius.h
+float Window(float distance, float inverseRadius)
+{
+    float x = distance * inverseRadius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
 // function prototypes
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, int i);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcDirLight(DirLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool altSwizzle);
+vec3 CalcSpotLight(SpotLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {
     // properties
+#if HAS_NORMAL_MAP
+    // normal mapping in world space: the TBN is rebuilt per fragment, so the lights stay in world space
+    vec3 N = normalize(fs_in.Normal);
+    vec3 T = normalize(fs_in.Tangent - dot(fs_in.Tangent, N) * N);
+    vec3 B = cross(N, T);
+    vec3 norm = mat3(T, B, N) * normalize(texture(material.texture_normal1, fs_in.TexCoords).rgb * 2.0 - 1.0);
+#else
     vec3 norm = normalize(fs_in.Normal);
+#endif
     vec3 viewDir = normalize(viewPos - fs_in.FragPos);
 
+    MaterialSample m = SampleMaterial(fs_in.TexCoords);
+
     // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, fs_in.FragPos, viewDir, i);
+    vec3 result = CalcDirLight(dirLight, m, norm, fs_in.FragPos, viewDir);
+#if CLUSTERED_LIGHTING
+    // phase 2 and 3: only the lights assigned to this fragment's cluster
+    float depth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(floor(log(depth) * clusterSliceScale + clusterSliceBias)));
+    cluster = clamp(cluster, ivec3(0), ivec3(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1, CLUSTER_SLICES - 1));
+    uvec4 record = texelFetch(clusterRecords, cluster.x + CLUSTER_TILES_X * (cluster.y + CLUSTER_TILES_Y * cluster.z));
+    int index = int(record.x);
+    for(uint i = 0u; i < record.y; i++, index++)
+    {
+        PointLight light = FetchPointLight(int(texelFetch(clusterLightIndices, index).r));
+        result += CalcPointLight(light, m, norm, fs_in.FragPos, viewDir, light.altSpecularSwizzle != 0.0);
+    }
+    for(uint i = 0u; i < record.z; i++, index++)
+        result += CalcSpotLight(FetchSpotLight(int(texelFetch(clusterLightIndices, index).r)), m, norm, fs_in.FragPos, viewDir);
+#else
+    // phase 2: point lights, with ALT_SPECULAR_SWIZZLE the last one reads the specular map as .rgr
+    for(int i = 0; i < NR_POINT_LIGHTS - ALT_SPECULAR_SWIZZLE; i++)
+        result += CalcPointLight(pointLights[i], m, norm, fs_in.FragPos, viewDir, false);
+#if ALT_SPECULAR_SWIZZLE
+    result += CalcPointLight(pointLights[NR_POINT_LIGHTS - 1], m, norm, fs_in.FragPos, viewDir, true);
+#endif
     // phase 3: spot lights
     for(int i = 0; i < NR_SPOT_LIGHTS; i++)
-        result += CalcSpotLight(spotLights[i], norm, fs_in.FragPos, viewDir);
+        result += CalcSpotLight(spotLights[i], m, norm, fs_in.FragPos, viewDir);
+#endif
+#if LIGHTMAPPED
+    // phase 4: the baked lights, the loops above then only cover the lights that are not baked
+    result += BakedLight(fs_in.LightmapCoords) * m.diffuse;
+#endif
+#if IRRADIANCE_VOLUME
+    // phase 5: the baked lamps' indirect light, in place of the ambient terms of their lights
+    result += ProbeIrradiance(fs_in.FragPos, norm) * m.diffuse;
+#endif
 
     FragColor = vec4(result, 1.0);
 }
 
 // calculates the color when using a directional light.
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(DirLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -90,14 +355,23 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rrr);
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+#if HAS_SPECULAR_MAP
+    vec3 specular = light.specular * spec * m.specular;
+#else
+    vec3 specular = vec3(0.0);
+#endif
+#if SHADOWS
+    float shadow = DirShadow(light, fragPos + normal * SHADOW_NORMAL_OFFSET);
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
     return (ambient + diffuse + specular);
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, int i)
+vec3 CalcPointLight(PointLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool altSwizzle)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -108,22 +382,31 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, i
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= Window(distance, light.inverseRadius);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
+#if IRRADIANCE_VOLUME
+    vec3 ambient = vec3(0.0);
+#else
+    vec3 ambient = light.ambient * m.diffuse;
+#endif
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
     vec3 specular = vec3(0.0f);
-    if(i == 5)
-        specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rgr);
-    else
-        specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rrr);
+#if HAS_SPECULAR_MAP
+    specular = light.specular * spec * (altSwizzle ? m.specularAlt : m.specular);
+#endif
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
+#if SHADOWS
+    float shadow = PointShadow(light, fragPos + normal * SHADOW_NORMAL_OFFSET);
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
     return (ambient + diffuse + specular);
 }
 
 // calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcSpotLight(SpotLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -134,16 +417,30 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= Window(distance, light.inverseRadius);
     // spotlight intensity
     float theta = dot(lightDir, normalize(-light.direction));
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rrr);
+#if IRRADIANCE_VOLUME
+    vec3 ambient = vec3(0.0);
+#else
+    vec3 ambient = light.ambient * m.diffuse;
+#endif
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+#if HAS_SPECULAR_MAP
+    vec3 specular = light.specular * spec * m.specular;
+#else
+    vec3 specular = vec3(0.0);
+#endif
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
+#if SHADOWS
+    float shadow = SpotShadow(light, fragPos + normal * SHADOW_NORMAL_OFFSET);
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
     return (ambient + diffuse + specular);
 }
\ No newline at end of file
@@ -2,21 +2,77 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 5) in vec2 aLightmapCoords;
+
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+#ifndef LIGHTMAPPED
+#define LIGHTMAPPED 0
+#endif
 
 out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+#if HAS_NORMAL_MAP
+    // compact TBN, the bitangent is rebuilt in the fragment shader. Unlike 4.normal_mapping.vs nothing here
+    // depends on the number of lights.
+    vec3 Tangent;
+#endif
+#if LIGHTMAPPED
+    vec2 LightmapCoords;
+#endif
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+// per-object transforms, see learnopengl/object_transforms.h
+#define OBJECT_TEXELS 11
+uniform samplerBuffer objectTransforms;
+uniform int objectIndex;
+// the object of each instance when a draw of the render queue is instanced, objectIndex is -1 then
+layout (location = 6) in int aInstanceObject;
+
+int drawnObject()
+{
+    return objectIndex >= 0 ? objectIndex : aInstanceObject;
+}
+
+mat4 objectMat4(int texel)
+{
+    int base = drawnObject() * OBJECT_TEXELS + texel;
+    return mat4(texelFetch(objectTransforms, base), texelFetch(objectTransforms, base + 1),
+                texelFetch(objectTransforms, base + 2), texelFetch(objectTransforms, base + 3));
+}
+
+mat3 objectNormalMatrix()
+{
+    int base = drawnObject() * OBJECT_TEXELS + 4;
+    return mat3(texelFetch(objectTransforms, base).xyz, texelFetch(objectTransforms, base + 1).xyz,
+                texelFetch(objectTransforms, base + 2).xyz);
+}
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.Normal = mat3(transpose(inverse(model))) * aNormal;
+    vs_out.FragPos = vec3(objectMat4(0) * vec4(aPos, 1.0));
+    mat3 normalMatrix = objectNormalMatrix();
+    vs_out.Normal = normalMatrix * aNormal;
+#if HAS_NORMAL_MAP
+    vs_out.Tangent = normalMatrix * aTangent;
+#endif
     vs_out.TexCoords = aTexCoords;
-    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+#if LIGHTMAPPED
+    vs_out.LightmapCoords = aLightmapCoords;
+#endif
+    gl_Position = objectMat4(7) * vec4(aPos, 1.0);
 }
\ No newline at end of file
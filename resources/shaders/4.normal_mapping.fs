@@ -1,13 +1,36 @@
 #version 330 core
 out vec4 FragColor;
 
-#define NR_POINT_LIGHTS 6
-#define NR_SPOT_LIGHTS 3
+// the Lights block always holds MAX_* lights, packed so that the active ones come first.
+// ShaderVariants injects the active counts and the material features, the defaults below
+// are the full shader.
+#define MAX_POINT_LIGHTS 6
+#define MAX_SPOT_LIGHTS 3
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS MAX_POINT_LIGHTS
+#endif
+#ifndef NR_SPOT_LIGHTS
+#define NR_SPOT_LIGHTS MAX_SPOT_LIGHTS
+#endif
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 1
+#endif
+#ifndef ALT_SPECULAR_SWIZZLE
+#define ALT_SPECULAR_SWIZZLE 0
+#endif
+#ifndef PACKED_SPECULAR
+#define PACKED_SPECULAR 0
+#endif
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#if NR_POINT_LIGHTS > 0
     vec3 TangentLightPos[NR_POINT_LIGHTS];
+#endif
     vec3 TangentViewPos;
     vec3 TangentFragPos;
 } fs_in;
@@ -19,8 +42,10 @@ struct Material {
     float shininess;
 };
 
+// std140 layouts, mirrored by the structs in learnopengl/uniform_blocks.h
 struct DirLight {
     vec3 direction;
+    float shadowMap;
 
     vec3 ambient;
     vec3 diffuse;
@@ -29,65 +54,121 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
+    float altSpecularSwizzle;
+    float inverseRadius;
+    float shadowMap;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
+    float inverseRadius;
+    float shadowMap;
+};
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    SpotLight spotLights[MAX_SPOT_LIGHTS];
 };
 
-uniform vec3 viewPos;
-uniform vec3 lightPos[NR_POINT_LIGHTS];
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
 uniform Material material;
 
+// material textures, sampled once per fragment and shared by every light
+struct MaterialSample {
+    vec3 diffuse;
+    vec3 specular;      // .rrr of the specular map
+    vec3 specularAlt;   // .rgr, read by the last point light with ALT_SPECULAR_SWIZZLE
+};
+
+MaterialSample SampleMaterial(vec2 texCoords)
+{
+    MaterialSample m;
+    vec4 diffuseMap = texture(material.texture_diffuse1, texCoords);
+    m.diffuse = diffuseMap.rgb;
+#if PACKED_SPECULAR
+    // grayscale specular map packed into the diffuse alpha at import, both swizzles read the same value
+    m.specular = vec3(diffuseMap.a);
+    m.specularAlt = m.specular;
+#elif HAS_SPECULAR_MAP
+    vec3 specularMap = texture(material.texture_specular1, texCoords).rgb;
+    m.specular = specularMap.rrr;
+    m.specularAlt = specularMap.rgr;
+#else
+    m.specular = vec3(0.0);
+    m.specularAlt = vec3(0.0);
+#endif
+    return m;
+}
+
+// the attenuation fades to exactly zero at the light's radius of influence, see learnopengl/light_radius.h
+float Window(float distance, float inverseRadius)
+{
+    float x = distance * inverseRadius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
 // function prototypes
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, int i, vec3 position);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcDirLight(DirLight light, MaterialSample m, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool altSwizzle, vec3 position);
+vec3 CalcSpotLight(SpotLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {           
+#if HAS_NORMAL_MAP
     // obtain normal from normal map in range [0,1]
     vec3 norm = texture(material.texture_normal1, fs_in.TexCoords).rgb;
     // transform normal vector to range [-1,1]
     norm = normalize(norm * 2.0 - 1.0);  // this normal is in tangent space
+#else
+    vec3 norm = vec3(0.0, 0.0, 1.0);
+#endif
 
     vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
 
+    MaterialSample m = SampleMaterial(fs_in.TexCoords);
+
     // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, fs_in.TangentFragPos, viewDir, i, fs_in.TangentLightPos[i]);
+    vec3 result = CalcDirLight(dirLight, m, norm, viewDir);
+    // phase 2: point lights, with ALT_SPECULAR_SWIZZLE the last one reads the specular map as .rgr
+    for(int i = 0; i < NR_POINT_LIGHTS - ALT_SPECULAR_SWIZZLE; i++)
+        result += CalcPointLight(pointLights[i], m, norm, fs_in.TangentFragPos, viewDir, false, fs_in.TangentLightPos[i]);
+#if ALT_SPECULAR_SWIZZLE
+    result += CalcPointLight(pointLights[NR_POINT_LIGHTS - 1], m, norm, fs_in.TangentFragPos, viewDir, true, fs_in.TangentLightPos[NR_POINT_LIGHTS - 1]);
+#endif
     // phase 3: spot lights
     for(int i = 0; i < NR_SPOT_LIGHTS; i++)
-            result += CalcSpotLight(spotLights[i], norm, fs_in.FragPos, viewDir);
+            result += CalcSpotLight(spotLights[i], m, norm, fs_in.FragPos, viewDir);
     FragColor = vec4(result, 1.0);
 }
 
 // calculates the color when using a directional light.
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+vec3 CalcDirLight(DirLight light, MaterialSample m, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -96,14 +177,18 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rrr);
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+#if HAS_SPECULAR_MAP
+    vec3 specular = light.specular * spec * m.specular;
+#else
+    vec3 specular = vec3(0.0);
+#endif
     return (ambient + diffuse + specular);
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, int i, vec3 position)
+vec3 CalcPointLight(PointLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool altSwizzle, vec3 position)
 {
     vec3 lightDir = normalize(position - fragPos);
     // diffuse shading
@@ -114,14 +199,14 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, i
     // attenuation
     float distance = length(position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= Window(distance, light.inverseRadius);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
     vec3 specular = vec3(0.0f);
-    if(i == 5)
-        specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rgr);
-    else
-        specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rrr);
+#if HAS_SPECULAR_MAP
+    specular = light.specular * spec * (altSwizzle ? m.specularAlt : m.specular);
+#endif
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -129,7 +214,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, i
 }
 
 // calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcSpotLight(SpotLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -140,14 +225,19 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= Window(distance, light.inverseRadius);
     // spotlight intensity
     float theta = dot(lightDir, normalize(-light.direction));
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords).rgb);
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords).rrr);
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+#if HAS_SPECULAR_MAP
+    vec3 specular = light.specular * spec * m.specular;
+#else
+    vec3 specular = vec3(0.0);
+#endif
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -5,39 +5,120 @@ layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
 
-#define NR_POINT_LIGHTS 6
+#define MAX_POINT_LIGHTS 6
+#define MAX_SPOT_LIGHTS 3
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS MAX_POINT_LIGHTS
+#endif
 
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#if NR_POINT_LIGHTS > 0
     vec3 TangentLightPos[NR_POINT_LIGHTS];
+#endif
     vec3 TangentViewPos;
     vec3 TangentFragPos;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+// std140 layouts, mirrored by the structs in learnopengl/uniform_blocks.h
+struct DirLight {
+    vec3 direction;
+    float shadowMap;
 
-uniform vec3 lightPos[NR_POINT_LIGHTS];
-uniform vec3 viewPos;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float altSpecularSwizzle;
+    float inverseRadius;
+    float shadowMap;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    float inverseRadius;
+    float shadowMap;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    SpotLight spotLights[MAX_SPOT_LIGHTS];
+};
+
+// per-object transforms, see learnopengl/object_transforms.h
+#define OBJECT_TEXELS 11
+uniform samplerBuffer objectTransforms;
+uniform int objectIndex;
+// the object of each instance when a draw of the render queue is instanced, objectIndex is -1 then
+layout (location = 6) in int aInstanceObject;
+
+int drawnObject()
+{
+    return objectIndex >= 0 ? objectIndex : aInstanceObject;
+}
+
+mat4 objectMat4(int texel)
+{
+    int base = drawnObject() * OBJECT_TEXELS + texel;
+    return mat4(texelFetch(objectTransforms, base), texelFetch(objectTransforms, base + 1),
+                texelFetch(objectTransforms, base + 2), texelFetch(objectTransforms, base + 3));
+}
+
+mat3 objectNormalMatrix()
+{
+    int base = drawnObject() * OBJECT_TEXELS + 4;
+    return mat3(texelFetch(objectTransforms, base).xyz, texelFetch(objectTransforms, base + 1).xyz,
+                texelFetch(objectTransforms, base + 2).xyz);
+}
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));   
+    vs_out.FragPos = vec3(objectMat4(0) * vec4(aPos, 1.0));
     vs_out.TexCoords = aTexCoords;
     
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    mat3 normalMatrix = objectNormalMatrix();
     vec3 T = normalize(normalMatrix * aTangent);
     vec3 N = normalize(normalMatrix * aNormal);
     T = normalize(T - dot(T, N) * N);
     vec3 B = cross(N, T);
     
     mat3 TBN = transpose(mat3(T, B, N));
+#if NR_POINT_LIGHTS > 0
     for(int i=0; i<NR_POINT_LIGHTS; i++)
-        vs_out.TangentLightPos[i] = TBN * lightPos[i];
+        vs_out.TangentLightPos[i] = TBN * pointLights[i].position;
+#endif
     vs_out.TangentViewPos  = TBN * viewPos;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
         
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = objectMat4(7) * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,491 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+
+// the lighting pass of learnopengl/deferred_renderer.h, one instance per light added up over the G-buffer.
+// The light math is the one of 2.model_lighting.fs.
+
+#ifndef HALF_RESOLUTION
+#define HALF_RESOLUTION 0
+#endif
+
+#if HALF_RESOLUTION
+// at half resolution only the light reaching the surface is added up, deferred_upsample.fs applies the maps:
+// FragColor is the diffuse and ambient light, Specular.rgb the specular light read with .rrr and Specular.a the one
+// of the .rgr light, whose specular color is gray
+layout (location = 1) out vec4 Specular;
+#endif
+
+#ifndef STOCHASTIC
+#define STOCHASTIC 0
+#endif
+
+#if STOCHASTIC
+// many lights sampled with weighted reservoir resampling as a single full screen directional instance. A reservoir
+// is (alias table entry or -1, weight sum, candidates seen M, contribution weight W). STOCHASTIC 1 writes a
+// reservoir per pixel from fresh candidates and last frame's reservoir there, STOCHASTIC 2 merges the reservoirs of
+// neighbours and shades the directional light plus the one light chosen. The cost per pixel does not depend on the
+// number of lights.
+#define CANDIDATES 8
+#define NEIGHBOURS 4
+#define NEIGHBOUR_RADIUS 16.0
+#define MAX_HISTORY 20.0
+#define EMPTY_RESERVOIR vec4(-1.0, 0.0, 0.0, 0.0)
+// last frame's reservoir is reused where the surface is the same, as in temporal_reproject.fs
+#define POSITION_TOLERANCE 0.01
+#define NORMAL_TOLERANCE 0.95
+
+// the alias table of learnopengl/alias_table.h after the lights in lightData, one texel per point or spot light:
+// probability of keeping the slot, alias slot, light texel * 4 + DeferredLightType, probability of the entry
+uniform int aliasTable;
+uniform int lightCount;
+uniform int frame;
+uniform sampler2D reservoirs;   // last frame's for STOCHASTIC 1, this frame's for STOCHASTIC 2
+#if STOCHASTIC == 1
+uniform bool temporalReuse;     // last frame's reservoirs were made with the same lights
+uniform sampler2D historyNormal;
+uniform sampler2D historyDepth;
+uniform mat4 previousViewProjection;
+uniform mat4 previousInverseViewProjection;
+#else
+layout (location = 1) out vec4 Reservoir;
+#endif
+
+// PCG hash, one sequence per pixel, frame and pass
+uint Hash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint Seed(ivec2 pixel, uint stage)
+{
+    return Hash(uint(pixel.x) + Hash(uint(pixel.y) + Hash(uint(frame) * 2u + stage)));
+}
+
+float Random(inout uint seed)
+{
+    seed = Hash(seed);
+    return float(seed >> 8) * (1.0 / 16777216.0);
+}
+#endif
+
+struct DirLight {
+    vec3 direction;
+    float shadowMap;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float altSpecularSwizzle;
+    float inverseRadius;
+    float shadowMap;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    float inverseRadius;
+    float shadowMap;
+};
+
+struct MaterialSample {
+    vec3 diffuse;
+    vec3 specular;
+    vec3 specularAlt;
+};
+
+// what a light adds, kept apart for the half resolution pass
+struct LightTerms {
+    vec3 diffuse;     // ambient included
+    vec3 specular;
+};
+
+// DeferredLightType
+#define DIRECTIONAL 0
+#define POINT_LIGHT 1
+#define SPOT_LIGHT 2
+
+flat in ivec2 Light;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform samplerBuffer lightData;   // DirLight, PointLight and SpotLight structs, 4, 5 and 6 texels each
+uniform mat4 inverseViewProjection;
+uniform vec3 background;
+uniform float shininess;
+
+// the maps of learnopengl/shadow_maps.h, a light's shadowMap is 1 + the slot of its map, 0 for none
+layout (std140) uniform Shadows {
+    mat4 dirShadowMatrix;
+    mat4 spotShadowMatrices[3];
+    mat4 pointShadowMatrices[6 * 6];
+    vec4 shadowLayerOffsets;
+};
+uniform sampler2DArrayShadow dirShadowMap;
+uniform sampler2DArrayShadow spotShadowMaps;
+uniform sampler2DArrayShadow pointShadowMaps;
+
+// the lookup point is pushed off the surface a little, along with the depth offset the maps are drawn with
+#define SHADOW_NORMAL_OFFSET 0.03
+
+// how much of the light reaches the point, four filtered depth tests spread over a 2x2 texel square
+float SampleShadow(sampler2DArrayShadow maps, mat4 lightMatrix, float layer, vec3 position)
+{
+    vec4 clip = lightMatrix * vec4(position, 1.0);
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    vec2 texel = 0.5 / vec2(textureSize(maps, 0).xy);
+    float depth = min(coords.z, 1.0);
+    float lit = texture(maps, vec4(coords.xy + vec2(-texel.x, -texel.y), layer, depth))
+              + texture(maps, vec4(coords.xy + vec2( texel.x, -texel.y), layer, depth))
+              + texture(maps, vec4(coords.xy + vec2(-texel.x,  texel.y), layer, depth))
+              + texture(maps, vec4(coords.xy + vec2( texel.x,  texel.y), layer, depth));
+    return lit * 0.25;
+}
+
+float DirShadow(DirLight light, vec3 position)
+{
+    if (light.shadowMap == 0.0)
+        return 1.0;
+    return SampleShadow(dirShadowMap, dirShadowMatrix, shadowLayerOffsets.x, position);
+}
+
+float SpotShadow(SpotLight light, vec3 position)
+{
+    if (light.shadowMap == 0.0)
+        return 1.0;
+    int slot = int(light.shadowMap) - 1;
+    return SampleShadow(spotShadowMaps, spotShadowMatrices[slot], float(slot) + shadowLayerOffsets.y, position);
+}
+
+// the face of the cube is the one the major axis of the light to point direction goes through
+float PointShadow(PointLight light, vec3 position)
+{
+    if (light.shadowMap == 0.0)
+        return 1.0;
+    vec3 d = position - light.position;
+    vec3 a = abs(d);
+    int face = a.x >= a.y && a.x >= a.z ? (d.x >= 0.0 ? 0 : 1) : a.y >= a.z ? (d.y >= 0.0 ? 2 : 3) : (d.z >= 0.0 ? 4 : 5);
+    int layer = (int(light.shadowMap) - 1) * 6 + face;
+    return SampleShadow(pointShadowMaps, pointShadowMatrices[layer], float(layer) + shadowLayerOffsets.z, position);
+}
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// the attenuation fades to exactly zero at the light's radius of influence, see learnopengl/light_radius.h
+float Window(float distance, float inverseRadius)
+{
+    float x = distance * inverseRadius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
+LightTerms CalcDirLight(DirLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir);
+LightTerms CalcPointLight(PointLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool altSwizzle);
+LightTerms CalcSpotLight(SpotLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir);
+
+// the light of type DeferredLightType whose structure starts at texel of lightData, left unshadowed on request
+LightTerms CalcLight(int texel, int type, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool shadowed,
+                     out bool altSwizzle)
+{
+    vec4 t0 = texelFetch(lightData, texel);
+    vec4 t1 = texelFetch(lightData, texel + 1);
+    vec4 t2 = texelFetch(lightData, texel + 2);
+    vec4 t3 = texelFetch(lightData, texel + 3);
+    vec4 t4 = texelFetch(lightData, texel + 4);
+    altSwizzle = false;
+    if (type == DIRECTIONAL) {
+        DirLight light = DirLight(t0.xyz, t0.w, t1.xyz, t2.xyz, t3.xyz);
+        light.shadowMap = shadowed ? light.shadowMap : 0.0;
+        return CalcDirLight(light, m, normal, fragPos, viewDir);
+    } else if (type == POINT_LIGHT) {
+        PointLight light = PointLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.x, t4.y);
+        light.shadowMap = shadowed ? light.shadowMap : 0.0;
+        altSwizzle = light.altSpecularSwizzle != 0.0;
+        return CalcPointLight(light, m, normal, fragPos, viewDir, altSwizzle);
+    }
+    vec4 t5 = texelFetch(lightData, texel + 5);
+    SpotLight light = SpotLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w, t4.xyz, t4.w, t5.x, t5.y);
+    light.shadowMap = shadowed ? light.shadowMap : 0.0;
+    return CalcSpotLight(light, m, normal, fragPos, viewDir);
+}
+
+#if STOCHASTIC
+// the light of an alias table entry, its shadow is left out where it only ranks the candidates
+LightTerms CalcEntry(int entry, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool shadowed)
+{
+    int light = int(texelFetch(lightData, aliasTable + entry).z);
+    bool altSwizzle;
+    return CalcLight(light >> 2, light & 3, m, normal, fragPos, viewDir, shadowed, altSwizzle);
+}
+
+// how much a light is worth to the pixel, the target the reservoirs resample towards
+float Target(int entry, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    if (entry < 0 || entry >= lightCount)
+        return 0.0;
+    LightTerms terms = CalcEntry(entry, m, normal, fragPos, viewDir, false);
+    return dot(terms.diffuse + terms.specular, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// streams reservoir r = (entry, weight sum, M, W) found at another pixel or frame into s, rated at this pixel
+void Merge(inout vec4 s, inout float chosenTarget, vec4 r, float target, inout uint seed)
+{
+    float weight = target * r.w * r.z;
+    s.y += weight;
+    s.z += r.z;
+    if (Random(seed) * s.y < weight) {
+        s.x = r.x;
+        chosenTarget = target;
+    }
+}
+
+// the unbiased contribution weight of the light the reservoir holds
+vec4 Finish(vec4 s, float chosenTarget)
+{
+    s.w = chosenTarget > 0.0 ? s.y / (s.z * chosenTarget) : 0.0;
+    return s;
+}
+#endif
+
+void main()
+{
+#if HALF_RESOLUTION
+    // each half resolution pixel is lit at the top left one of the four it covers
+    ivec2 pixel = ivec2(gl_FragCoord.xy) * 2;
+#else
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+#endif
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0) {
+#if HALF_RESOLUTION
+        // the upsampling writes the background
+        discard;
+#elif STOCHASTIC == 1
+        FragColor = EMPTY_RESERVOIR;
+        return;
+#else
+        // nothing was drawn here, the directional pass covers every pixel and writes the background once
+        if (Light.y != DIRECTIONAL)
+            discard;
+        FragColor = vec4(background, 1.0);
+#if STOCHASTIC == 2
+        Reservoir = EMPTY_RESERVOIR;
+#endif
+        return;
+#endif
+    }
+
+    vec4 normalSpecular = texelFetch(gNormal, pixel, 0);
+    MaterialSample m;
+#if HALF_RESOLUTION
+    m.diffuse = vec3(1.0);
+    m.specular = vec3(1.0);
+    m.specularAlt = vec3(1.0);
+#else
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    m.diffuse = albedoSpecular.rgb;
+    m.specular = vec3(albedoSpecular.a);
+    m.specularAlt = vec3(albedoSpecular.a, normalSpecular.z, albedoSpecular.a);
+#endif
+    vec3 norm = OctDecode(normalSpecular.xy);
+
+    vec2 size = vec2(textureSize(gDepth, 0));
+    vec4 ndc = vec4((vec2(pixel) + 0.5) / size, depth, 1.0) * 2.0 - 1.0;
+    vec4 world = inverseViewProjection * ndc;
+    vec3 fragPos = world.xyz / world.w;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+#if STOCHASTIC == 1
+    // candidates drawn in proportion to the lights' power, kept in proportion to what they bring to the pixel
+    uint seed = Seed(pixel, 0u);
+    vec4 s = EMPTY_RESERVOIR;
+    float chosenTarget = 0.0;
+    for(int i = 0; i < CANDIDATES && lightCount > 0; i++)
+    {
+        int slot = min(int(Random(seed) * float(lightCount)), lightCount - 1);
+        vec4 entry = texelFetch(lightData, aliasTable + slot);
+        int candidate = Random(seed) < entry.x ? slot : int(entry.y);
+        float pdf = texelFetch(lightData, aliasTable + candidate).w;
+        float target = Target(candidate, m, norm, fragPos, viewDir);
+        float weight = pdf > 0.0 ? target / pdf : 0.0;
+        s.y += weight;
+        s.z += 1.0;
+        if (Random(seed) * s.y < weight) {
+            s.x = float(candidate);
+            chosenTarget = target;
+        }
+    }
+    s = Finish(s, chosenTarget);
+
+    // last frame's reservoir of the same surface, its history capped so the lights can change
+    vec4 clip = previousViewProjection * vec4(fragPos, 1.0);
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (temporalReuse && clip.w > 0.0 && all(greaterThanEqual(uv, vec2(0.0))) && all(lessThan(uv, vec2(1.0)))) {
+        ivec2 previous = ivec2(uv * size);
+        vec4 prevNdc = vec4((vec2(previous) + 0.5) / size, texelFetch(historyDepth, previous, 0).r, 1.0) * 2.0 - 1.0;
+        vec4 prevWorld = previousInverseViewProjection * prevNdc;
+        vec3 previousNormal = OctDecode(texelFetch(historyNormal, previous, 0).xy);
+        if (distance(prevWorld.xyz / prevWorld.w, fragPos) < POSITION_TOLERANCE * distance(fragPos, viewPos)
+            && dot(previousNormal, norm) > NORMAL_TOLERANCE) {
+            vec4 r = texelFetch(reservoirs, previous, 0);
+            r.z = min(r.z, MAX_HISTORY * float(CANDIDATES));
+            Merge(s, chosenTarget, r, Target(int(r.x), m, norm, fragPos, viewDir), seed);
+            s = Finish(s, chosenTarget);
+        }
+    }
+    FragColor = s;
+#elif STOCHASTIC == 2
+    // neighbours on the same surface share their choices
+    uint seed = Seed(pixel, 1u);
+    vec4 s = texelFetch(reservoirs, pixel, 0);
+    float chosenTarget = Target(int(s.x), m, norm, fragPos, viewDir);
+    float viewDepth = distance(fragPos, viewPos);
+    for(int i = 0; i < NEIGHBOURS; i++)
+    {
+        float angle = 6.2831853 * Random(seed);
+        vec2 offset = vec2(cos(angle), sin(angle)) * NEIGHBOUR_RADIUS * sqrt(Random(seed));
+        ivec2 neighbour = clamp(pixel + ivec2(offset), ivec2(0), ivec2(size) - 1);
+        float neighbourDepth = texelFetch(gDepth, neighbour, 0).r;
+        vec4 neighbourWorld = inverseViewProjection * (vec4((vec2(neighbour) + 0.5) / size, neighbourDepth, 1.0) * 2.0 - 1.0);
+        vec3 neighbourNormal = OctDecode(texelFetch(gNormal, neighbour, 0).xy);
+        if (neighbourDepth == 1.0 || abs(distance(neighbourWorld.xyz / neighbourWorld.w, viewPos) - viewDepth) > 0.05 * viewDepth
+            || dot(neighbourNormal, norm) < 0.9)
+            continue;
+        vec4 r = texelFetch(reservoirs, neighbour, 0);
+        Merge(s, chosenTarget, r, Target(int(r.x), m, norm, fragPos, viewDir), seed);
+    }
+    s = Finish(s, chosenTarget);
+    s.z = min(s.z, MAX_HISTORY * float(CANDIDATES));
+    Reservoir = s;
+
+    // the directional light exactly, the chosen light shadowed and weighted for all the others
+    bool altSwizzle;
+    LightTerms dir = CalcLight(Light.x, DIRECTIONAL, m, norm, fragPos, viewDir, true, altSwizzle);
+    vec3 color = dir.diffuse + dir.specular;
+    if (s.x >= 0.0 && s.w > 0.0) {
+        LightTerms chosen = CalcEntry(int(s.x), m, norm, fragPos, viewDir, true);
+        color += (chosen.diffuse + chosen.specular) * s.w;
+    }
+    FragColor = vec4(color, 1.0);
+#else
+    bool altSwizzle;
+    LightTerms result = CalcLight(Light.x, Light.y, m, norm, fragPos, viewDir, true, altSwizzle);
+#if HALF_RESOLUTION
+    FragColor = vec4(result.diffuse, 1.0);
+    Specular = altSwizzle ? vec4(0.0, 0.0, 0.0, result.specular.r) : vec4(result.specular, 0.0);
+#else
+    FragColor = vec4(result.diffuse + result.specular, 1.0);
+#endif
+#endif
+}
+
+// calculates the color when using a directional light.
+LightTerms CalcDirLight(DirLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // combine results
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+    vec3 specular = light.specular * spec * m.specular;
+    float shadow = DirShadow(light, fragPos + normal * SHADOW_NORMAL_OFFSET);
+    diffuse *= shadow;
+    specular *= shadow;
+    return LightTerms(ambient + diffuse, specular);
+}
+
+// calculates the color when using a point light.
+LightTerms CalcPointLight(PointLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir, bool altSwizzle)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= Window(distance, light.inverseRadius);
+    // combine results
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+    vec3 specular = light.specular * spec * (altSwizzle ? m.specularAlt : m.specular);
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    float shadow = PointShadow(light, fragPos + normal * SHADOW_NORMAL_OFFSET);
+    diffuse *= shadow;
+    specular *= shadow;
+    return LightTerms(ambient + diffuse, specular);
+}
+
+// calculates the color when using a spot light.
+LightTerms CalcSpotLight(SpotLight light, MaterialSample m, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    attenuation *= Window(distance, light.inverseRadius);
+    // spotlight intensity
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // combine results
+    vec3 ambient = light.ambient * m.diffuse;
+    vec3 diffuse = light.diffuse * diff * m.diffuse;
+    vec3 specular = light.specular * spec * m.specular;
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    float shadow = SpotShadow(light, fragPos + normal * SHADOW_NORMAL_OFFSET);
+    diffuse *= shadow;
+    specular *= shadow;
+    return LightTerms(ambient + diffuse, specular);
+}
\ No newline at end of file
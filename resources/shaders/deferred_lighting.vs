@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in vec4 aRect;     // per light: NDC rectangle its attenuation reaches
+layout (location = 2) in ivec2 aLight;   // per light: first texel in lightData, DeferredLightType
+
+flat out ivec2 Light;
+
+void main()
+{
+    Light = aLight;
+    gl_Position = vec4(mix(aRect.xy, aRect.zw, aCorner), 0.0, 1.0);
+}
\ No newline at end of file
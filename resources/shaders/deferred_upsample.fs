@@ -0,0 +1,93 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+
+// brings the half resolution lighting of deferred_lighting.fs back to full resolution in
+// learnopengl/deferred_renderer.h. The four half resolution pixels around a pixel are blended by their distance to
+// it like bilinear filtering, weighted down where the surface they were lit at is farther away or faces another way
+// (joint bilateral upsampling), so light does not bleed across edges. The full resolution maps are applied after.
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform sampler2D halfDiffuse;
+uniform sampler2D halfSpecular;
+uniform vec2 depthParameters;   // projection[3][2], projection[2][2]
+uniform vec3 background;
+
+// how fast the weight falls with the depth difference, relative to the depth
+#define DEPTH_SIGMA 0.02
+#define NORMAL_POWER 16.0
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// distance in front of the camera of a depth buffer value
+float ViewDepth(float depth)
+{
+    return depthParameters.x / (depth * 2.0 - 1.0 + depthParameters.y);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0) {
+        FragColor = vec4(background, 1.0);
+        return;
+    }
+    float z = ViewDepth(depth);
+    vec4 normalSpecular = texelFetch(gNormal, pixel, 0);
+    vec3 normal = OctDecode(normalSpecular.xy);
+
+    // half resolution pixel i was lit at pixel 2i
+    ivec2 lowSize = textureSize(halfDiffuse, 0);
+    ivec2 fullSize = textureSize(gDepth, 0);
+    vec2 position = vec2(pixel) * 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    vec4 diffuse = vec4(0.0), specular = vec4(0.0);
+    float total = 0.0;
+    float bestMatch = -1.0;
+    vec4 bestDiffuse = vec4(0.0), bestSpecular = vec4(0.0);
+    for(int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 low = min(base + offset, lowSize - 1);
+        ivec2 lit = min(low * 2, fullSize - 1);
+        float litDepth = texelFetch(gDepth, lit, 0).r;
+        float depthWeight = litDepth == 1.0 ? 0.0 : exp(-abs(ViewDepth(litDepth) - z) / (DEPTH_SIGMA * z));
+        float normalWeight = pow(max(dot(normal, OctDecode(texelFetch(gNormal, lit, 0).xy)), 0.0), NORMAL_POWER);
+        float match = depthWeight * normalWeight;
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y * match;
+        vec4 d = texelFetch(halfDiffuse, low, 0);
+        vec4 s = texelFetch(halfSpecular, low, 0);
+        diffuse += d * weight;
+        specular += s * weight;
+        total += weight;
+        if (match > bestMatch) {
+            bestMatch = match;
+            bestDiffuse = d;
+            bestSpecular = s;
+        }
+    }
+    // none of the bilinear neighbours lies on this surface, the closest match is better than nothing
+    if (total > 1e-4) {
+        diffuse /= total;
+        specular /= total;
+    } else {
+        diffuse = bestDiffuse;
+        specular = bestSpecular;
+    }
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 specularAlt = vec3(albedoSpecular.a, normalSpecular.z, albedoSpecular.a);
+    vec3 color = albedoSpecular.rgb * diffuse.rgb + albedoSpecular.a * specular.rgb + specularAlt * specular.a;
+    FragColor = vec4(color, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormal;
+
+// the geometry pass of learnopengl/deferred_renderer.h, drawn with 2.model_lighting.vs. Writes the material
+// and the normal, the lights are added later in deferred_lighting.fs.
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+    sampler2D texture_normal1;
+    float shininess;
+};
+
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
+#ifndef HAS_NORMAL_MAP
+#define HAS_NORMAL_MAP 0
+#endif
+#ifndef PACKED_SPECULAR
+#define PACKED_SPECULAR 0
+#endif
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+#if HAS_NORMAL_MAP
+    vec3 Tangent;
+#endif
+} fs_in;
+
+uniform Material material;
+
+// unit vector to the octahedron folded onto the [-1, 1] square
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
+
+void main()
+{
+#if HAS_NORMAL_MAP
+    vec3 N = normalize(fs_in.Normal);
+    vec3 T = normalize(fs_in.Tangent - dot(fs_in.Tangent, N) * N);
+    vec3 B = cross(N, T);
+    vec3 norm = mat3(T, B, N) * normalize(texture(material.texture_normal1, fs_in.TexCoords).rgb * 2.0 - 1.0);
+#else
+    vec3 norm = normalize(fs_in.Normal);
+#endif
+
+    vec4 diffuseMap = texture(material.texture_diffuse1, fs_in.TexCoords);
+#if PACKED_SPECULAR
+    vec2 specular = vec2(diffuseMap.a);
+#elif HAS_SPECULAR_MAP
+    vec2 specular = texture(material.texture_specular1, fs_in.TexCoords).rg;
+#else
+    vec2 specular = vec2(0.0);
+#endif
+
+    gAlbedoSpecular = vec4(diffuseMap.rgb, specular.r);
+    gNormal = vec4(OctEncode(norm), specular.g, 0.0);
+}
\ No newline at end of file
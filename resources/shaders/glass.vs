@@ -4,12 +4,37 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+// per-object transforms, see learnopengl/object_transforms.h
+#define OBJECT_TEXELS 11
+uniform samplerBuffer objectTransforms;
+uniform int objectIndex;
+// the object of each instance when a draw of the render queue is instanced, objectIndex is -1 then
+layout (location = 6) in int aInstanceObject;
+
+int drawnObject()
+{
+    return objectIndex >= 0 ? objectIndex : aInstanceObject;
+}
+
+mat4 objectMat4(int texel)
+{
+    int base = drawnObject() * OBJECT_TEXELS + texel;
+    return mat4(texelFetch(objectTransforms, base), texelFetch(objectTransforms, base + 1),
+                texelFetch(objectTransforms, base + 2), texelFetch(objectTransforms, base + 3));
+}
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = objectMat4(7) * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -9,14 +9,46 @@ out VS_OUT {
     vec2 TexCoords;
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+// per-object transforms, see learnopengl/object_transforms.h
+#define OBJECT_TEXELS 11
+uniform samplerBuffer objectTransforms;
+uniform int objectIndex;
+// the object of each instance when a draw of the render queue is instanced, objectIndex is -1 then
+layout (location = 6) in int aInstanceObject;
+
+int drawnObject()
+{
+    return objectIndex >= 0 ? objectIndex : aInstanceObject;
+}
+
+mat4 objectMat4(int texel)
+{
+    int base = drawnObject() * OBJECT_TEXELS + texel;
+    return mat4(texelFetch(objectTransforms, base), texelFetch(objectTransforms, base + 1),
+                texelFetch(objectTransforms, base + 2), texelFetch(objectTransforms, base + 3));
+}
+
+mat3 objectNormalMatrix()
+{
+    int base = drawnObject() * OBJECT_TEXELS + 4;
+    return mat3(texelFetch(objectTransforms, base).xyz, texelFetch(objectTransforms, base + 1).xyz,
+                texelFetch(objectTransforms, base + 2).xyz);
+}
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.Normal = mat3(transpose(inverse(model))) * aNormal;
+    vs_out.FragPos = vec3(objectMat4(0) * vec4(aPos, 1.0));
+    vs_out.Normal = objectNormalMatrix() * aNormal;
     vs_out.TexCoords = aTexCoords;
-    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+    gl_Position = objectMat4(7) * vec4(aPos, 1.0);
 }
\ No newline at end of file
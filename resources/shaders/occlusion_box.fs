@@ -0,0 +1,6 @@
+#version 330 core
+
+// only the samples that pass the depth test are counted, nothing is written
+void main()
+{
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;   // a corner of the unit cube
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec2 clusterTileSize;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    vec4 lightmapWeights[2];
+};
+
+// the world space box of an object, see learnopengl/occlusion_queries.h
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main()
+{
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
\ No newline at end of file
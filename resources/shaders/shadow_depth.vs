@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// the casters of learnopengl/shadow_maps.h as seen from a light, only depth is written
+
+// per-object transforms, see learnopengl/object_transforms.h
+#define OBJECT_TEXELS 11
+uniform samplerBuffer objectTransforms;
+uniform int objectIndex;
+uniform mat4 lightViewProjection;
+
+mat4 objectMat4(int texel)
+{
+    int base = objectIndex * OBJECT_TEXELS + texel;
+    return mat4(texelFetch(objectTransforms, base), texelFetch(objectTransforms, base + 1),
+                texelFetch(objectTransforms, base + 2), texelFetch(objectTransforms, base + 3));
+}
+
+void main()
+{
+    gl_Position = lightViewProjection * objectMat4(0) * vec4(aPos, 1.0);
+}
\ No newline at end of file
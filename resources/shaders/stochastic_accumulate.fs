@@ -0,0 +1,80 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 Accumulation;
+
+// the last pass of the stochastic lighting of learnopengl/deferred_renderer.h. The noisy image of this frame is
+// blended into the average the same surface had last frame, each frame weighing 1 / n of it for n frames up to
+// maxFrames. Where the surface was hidden or has changed the average starts over.
+
+uniform sampler2D shaded;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform sampler2D previousAccumulation;   // rgb the average, a the frames in it
+uniform sampler2D historyNormal;
+uniform sampler2D historyDepth;
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+uniform mat4 previousInverseViewProjection;
+uniform vec3 viewPos;
+uniform float maxFrames;
+
+// as in temporal_reproject.fs
+#define POSITION_TOLERANCE 0.01
+#define NORMAL_TOLERANCE 0.95
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+vec3 WorldPosition(mat4 inverseMatrix, vec2 uv, float depth)
+{
+    vec4 world = inverseMatrix * (vec4(uv, depth, 1.0) * 2.0 - 1.0);
+    return world.xyz / world.w;
+}
+
+// the average of the surface last frame, a = 0 where there is none
+vec4 History(ivec2 pixel, float depth)
+{
+    vec2 size = vec2(textureSize(gDepth, 0));
+    vec3 position = WorldPosition(inverseViewProjection, gl_FragCoord.xy / size, depth);
+    vec4 clip = previousViewProjection * vec4(position, 1.0);
+    if (clip.w <= 0.0)
+        return vec4(0.0);
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0))))
+        return vec4(0.0);
+
+    ivec2 previous = ivec2(uv * size);
+    float previousDepth = texelFetch(historyDepth, previous, 0).r;
+    vec3 previousPosition = WorldPosition(previousInverseViewProjection, (vec2(previous) + 0.5) / size, previousDepth);
+    if (distance(previousPosition, position) > POSITION_TOLERANCE * distance(position, viewPos))
+        return vec4(0.0);
+    vec3 normal = OctDecode(texelFetch(gNormal, pixel, 0).xy);
+    vec3 previousNormal = OctDecode(texelFetch(historyNormal, previous, 0).xy);
+    if (dot(normal, previousNormal) < NORMAL_TOLERANCE)
+        return vec4(0.0);
+    return texelFetch(previousAccumulation, previous, 0);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 current = texelFetch(shaded, pixel, 0).rgb;
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // the background is not averaged
+    if (depth == 1.0) {
+        FragColor = vec4(current, 1.0);
+        Accumulation = vec4(0.0);
+        return;
+    }
+
+    vec4 history = History(pixel, depth);
+    float frames = min(history.a + 1.0, maxFrames);
+    vec3 average = mix(history.rgb, current, 1.0 / frames);
+    FragColor = vec4(average, 1.0);
+    Accumulation = vec4(average, frames);
+}
\ No newline at end of file
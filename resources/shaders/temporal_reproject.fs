@@ -0,0 +1,69 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+
+// the temporal cache of learnopengl/deferred_renderer.h. A pixel whose surface was on screen last frame takes the
+// lit color it had then, and the stencil this pass leaves behind keeps the light volumes off it. Pixels whose
+// surface was hidden or has changed, and the ones whose turn it is to be refreshed, are discarded and lit again.
+
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform sampler2D historyColor;
+uniform sampler2D historyNormal;
+uniform sampler2D historyDepth;
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+uniform mat4 previousInverseViewProjection;
+uniform vec3 viewPos;
+uniform int refreshPeriod;
+uniform int refreshPhase;
+
+// the surface is the same one when it lies within this fraction of its distance to the camera of where it was
+#define POSITION_TOLERANCE 0.01
+// and its normal turned less than about 18 degrees
+#define NORMAL_TOLERANCE 0.95
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+vec3 WorldPosition(mat4 inverseMatrix, vec2 uv, float depth)
+{
+    vec4 world = inverseMatrix * (vec4(uv, depth, 1.0) * 2.0 - 1.0);
+    return world.xyz / world.w;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    // every pixel is lit from scratch once in refreshPeriod frames, so the cache cannot drift for long
+    if ((pixel.x + 3 * pixel.y) % refreshPeriod == refreshPhase)
+        discard;
+    // the background is written by the directional pass
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;
+
+    vec2 size = vec2(textureSize(gDepth, 0));
+    vec3 position = WorldPosition(inverseViewProjection, gl_FragCoord.xy / size, depth);
+    vec4 clip = previousViewProjection * vec4(position, 1.0);
+    if (clip.w <= 0.0)
+        discard;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0))))
+        discard;
+
+    ivec2 previous = ivec2(uv * size);
+    float previousDepth = texelFetch(historyDepth, previous, 0).r;
+    vec3 previousPosition = WorldPosition(previousInverseViewProjection, (vec2(previous) + 0.5) / size, previousDepth);
+    if (distance(previousPosition, position) > POSITION_TOLERANCE * distance(position, viewPos))
+        discard;
+    vec3 normal = OctDecode(texelFetch(gNormal, pixel, 0).xy);
+    vec3 previousNormal = OctDecode(texelFetch(historyNormal, previous, 0).xy);
+    if (dot(normal, previousNormal) < NORMAL_TOLERANCE)
+        discard;
+    FragColor = vec4(texelFetch(historyColor, previous, 0).rgb, 1.0);
+}
\ No newline at end of file
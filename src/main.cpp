@@ -10,14 +10,33 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <learnopengl/filesystem.h>
+#include <learnopengl/gl_extensions.h>
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/asset_watcher.h>
+#include <learnopengl/uniform_buffer.h>
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/shader_manager.h>
+#include <learnopengl/object_transforms.h>
+#include <learnopengl/scene.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/frustum_culler.h>
+#include <learnopengl/occlusion_culler.h>
+#include <learnopengl/occlusion_queries.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/deferred_renderer.h>
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/object_lights.h>
+#include <learnopengl/shadow_maps.h>
+#include <learnopengl/lightmap_baker.h>
+#include <learnopengl/irradiance_volume.h>
 
 #include <iostream>
 
-void renderQuad(float tex);
-void renderGlass();
+unsigned int quadVertexArray(float tex);
+unsigned int glassVertexArray();
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
@@ -49,6 +68,34 @@ struct ProgramState {
     bool light3 = false;
     bool light4 = false;
     bool light5 = false;
+    // walls light in world space with a compact TBN instead of the tangent space shader
+    bool worldSpaceNormalMapping = false;
+    // lights are assigned to clusters of the view frustum, the walls then use the world space shaders
+    bool clusteredLighting = false;
+    int extraLights = 0;
+    // the opaque scene goes through a G-buffer and the lights are drawn as screen space volumes
+    bool deferredShading = false;
+    // deferred lighting reuses last frame's lit pixels wherever the same surface is still on screen
+    bool temporalCache = false;
+    // deferred lighting is added up at half resolution and upsampled along the edges of the G-buffer
+    bool halfResolutionLighting = false;
+    // deferred lighting samples a few lights per pixel by their power and averages the result over the frames
+    bool stochasticLighting = false;
+    // every object is lit only by the lights whose radius reaches its bounds
+    bool objectLightLists = true;
+    // lights are shadowed by cached shadow maps, the walls then use the world space shaders
+    bool shadows = false;
+    ShadowSettings shadowSettings;
+    // the lamps' lights come from baked lightmaps on the walls, the floor and the ceiling
+    bool bakedLighting = false;
+    // the furniture takes the lamps' ambient and bounced light from baked irradiance probes
+    bool irradianceVolume = false;
+    // only the objects whose boxes reach into the view frustum are drawn
+    bool frustumCulling = true;
+    // objects hidden behind the walls, the desk or the couch in a small depth buffer drawn on the CPU are not drawn
+    bool occlusionCulling = false;
+    // objects are drawn under conditional rendering on occlusion queries of their boxes from the frame before
+    bool occlusionQueries = false;
     bool CameraMouseMovementUpdateEnabled = true;
 
     ProgramState()
@@ -75,7 +122,26 @@ void ProgramState::SaveToFile(std::string filename) {
         << light2_2 << '\n'
         << light3 << '\n'
         << light4 << '\n'
-        << light5 << '\n';
+        << light5 << '\n'
+        << worldSpaceNormalMapping << '\n'
+        << clusteredLighting << '\n'
+        << extraLights << '\n'
+        << deferredShading << '\n'
+        << objectLightLists << '\n'
+        << shadows << '\n'
+        << shadowSettings.directionalResolution << '\n'
+        << shadowSettings.spotResolution << '\n'
+        << shadowSettings.pointResolution << '\n'
+        << shadowSettings.updateBudget << '\n'
+        << shadowSettings.pointLights << '\n'
+        << bakedLighting << '\n'
+        << irradianceVolume << '\n'
+        << temporalCache << '\n'
+        << halfResolutionLighting << '\n'
+        << stochasticLighting << '\n'
+        << frustumCulling << '\n'
+        << occlusionCulling << '\n'
+        << occlusionQueries << '\n';
 }
 
 void ProgramState::LoadFromFile(std::string filename) {
@@ -95,13 +161,87 @@ void ProgramState::LoadFromFile(std::string filename) {
            >> light2_2
            >> light3
            >> light4
-           >> light5;
+           >> light5
+           >> worldSpaceNormalMapping
+           >> clusteredLighting
+           >> extraLights
+           >> deferredShading
+           >> objectLightLists
+           >> shadows
+           >> shadowSettings.directionalResolution
+           >> shadowSettings.spotResolution
+           >> shadowSettings.pointResolution
+           >> shadowSettings.updateBudget
+           >> shadowSettings.pointLights;
+        // a file saved before the shadow settings existed would leave them zeroed
+        if (!in)
+            shadowSettings = ShadowSettings();
+        in >> bakedLighting
+           >> irradianceVolume
+           >> temporalCache
+           >> halfResolutionLighting
+           >> stochasticLighting
+           >> frustumCulling
+           >> occlusionCulling
+           >> occlusionQueries;
     }
 }
 
 ProgramState *programState;
 
-void DrawImGui(ProgramState *programState);
+// the lights of the room, each one switched by a flag of ProgramState
+struct PointLightSource {
+    glm::vec3 position;
+    float linear, quadratic, specular;
+    bool ProgramState::*enabled;
+    bool altSpecularSwizzle;
+};
+const PointLightSource pointLightSources[NR_POINT_LIGHTS] = {
+        {glm::vec3(-0.25f, 10.3f, 0.0f),   0.01f, 0.001f, 0.5f, &ProgramState::light1, false},
+        {glm::vec3(-2.075f, 10.3f, 0.0f),  0.01f, 0.001f, 0.5f, &ProgramState::light1, false},
+        {glm::vec3(1.535f, 10.3f, 0.0f),   0.01f, 0.001f, 0.5f, &ProgramState::light1, false},
+        {glm::vec3(2.55f, 5.75f, -5.6f),   0.03f, 0.016f, 0.6f, &ProgramState::light2_1, false},
+        {glm::vec3(-3.05f, 5.75f, -5.6f),  0.03f, 0.016f, 0.6f, &ProgramState::light2_2, false},
+        // the lamp next to the plant reads the specular map as .rgr
+        {glm::vec3(-5.425f, 2.76f, -0.46f), 0.03f, 0.016f, 0.6f, &ProgramState::light5, true},
+};
+
+struct SpotLightSource {
+    glm::vec3 position, direction;
+    float cutOff, outerCutOff;
+    bool ProgramState::*enabled;
+};
+const SpotLightSource spotLightSources[NR_SPOT_LIGHTS] = {
+        // the first one follows the camera, position and direction are filled in by UpdateLights
+        {glm::vec3(0.0f),                 glm::vec3(0.0f),              12.5f, 15.0f, &ProgramState::slight},
+        {glm::vec3(-0.575f, 5.25f, -4.45f), glm::vec3(0.3f, -0.9f, 0.09f), 22.5f, 30.0f, &ProgramState::light3},
+        {glm::vec3(3.56f, 4.25f, 0.85f),   glm::vec3(-0.3f, -0.9f, 0.0f),  40.5f, 60.0f, &ProgramState::light4},
+};
+
+// the lamp switches whose lights are baked into the lightmaps, layer i holds the lights of the i-th one.
+// The camera's spot light moves and the directional light is not a lamp, both stay dynamic.
+bool ProgramState::*const bakedSwitches[] = {&ProgramState::light1, &ProgramState::light2_1, &ProgramState::light2_2,
+                                            &ProgramState::light3, &ProgramState::light4, &ProgramState::light5};
+const unsigned int BAKED_LAYERS = sizeof(bakedSwitches) / sizeof(bakedSwitches[0]);
+static_assert(BAKED_LAYERS <= MAX_LIGHTMAP_LAYERS, "too many lightmap layers");
+
+// the irradiance probes fill the room, about one and a half units apart
+const glm::vec3 PROBE_GRID_MIN(-6.0f, 0.0f, -6.0f);
+const glm::vec3 PROBE_GRID_MAX(6.0f, 12.0f, 6.0f);
+const glm::ivec3 PROBE_GRID_COUNT(8, 8, 8);
+
+PointLightData MakePointLight(const PointLightSource &source);
+SpotLightData MakeSpotLight(const SpotLightSource &source);
+
+void DrawImGui(ProgramState *programState, const ClusteredLights &clusteredLights, const ObjectLights &objectLights,
+               const DeferredRenderer &deferredRenderer, const ShadowMaps &shadowMaps,
+               const LightmapBaker &lightmapBaker, const Scene &scene, const RenderQueue &renderQueue,
+               const FrustumCuller &frustumCuller, const OcclusionCuller &occlusionCuller,
+               const OcclusionQueries &occlusionQueries, const GpuProfiler &profiler);
+ShaderVariantKey UpdateLights(LightsData &lights, ClusteredLights &clustered, ShadowMaps &shadowMaps,
+                              const ProgramState *programState);
+// sets up the scene and runs the render loop until the window closes
+void RunScene(GLFWwindow *window);
 
 int main() {
     // glfw: initialize and configure
@@ -137,6 +277,7 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    LoadGLExtensions((GLADloadproc) glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
@@ -164,6 +305,21 @@ int main() {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // everything that owns GL objects lives in RunScene and is gone before the context is
+    RunScene(window);
+
+    programState->SaveToFile("resources/program_state.txt");
+    delete programState;
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return 0;
+}
+
+void RunScene(GLFWwindow *window) {
     float quadVertices[] = {
             // positions   // texCoords
             -1.0f,  1.0f,  0.0f, 1.0f,
@@ -209,38 +365,184 @@ int main() {
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
 
+    // hot reload of changed textures, models and shaders
+    AssetWatcher assetWatcher("resources");
+
     // shaders
     // -------------------------
-    Shader ourShader("resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs");
-    Shader wallShader("resources/shaders/4.normal_mapping.vs", "resources/shaders/4.normal_mapping.fs");
-    Shader glassShader("resources/shaders/glass.vs", "resources/shaders/glass.fs");
-    Shader lightShader("resources/shaders/light.vs", "resources/shaders/light.fs");
-    Shader screenShader("resources/shaders/screen.vs", "resources/shaders/screen.fs");
+    // every program is compiled in the background while the models load, see ShaderManager.
+    // the lighting shaders are compiled per active light count and material, see ShaderVariants
+    ShaderVariants ourShaders("resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs",
+                              HAS_SPECULAR_MAP | ALT_SPECULAR_SWIZZLE | PACKED_SPECULAR | CLUSTERED_LIGHTING | SHADOWS
+                              | LIGHTMAPPED | IRRADIANCE_VOLUME, [](Shader &shader) {
+        shader.setInt("material.texture_diffuse1"_u, 0);
+        shader.setInt("material.texture_specular1"_u, 1);
+        shader.setFloat("material.shininess"_u, 128.0f);
+        shader.setInt("objectTransforms"_u, OBJECT_TRANSFORMS_UNIT);
+        shader.setInt("clusterLightData"_u, CLUSTER_LIGHT_DATA_UNIT);
+        shader.setInt("clusterRecords"_u, CLUSTER_RECORDS_UNIT);
+        shader.setInt("clusterLightIndices"_u, CLUSTER_INDICES_UNIT);
+        shader.setInt("dirShadowMap"_u, DIR_SHADOW_UNIT);
+        shader.setInt("spotShadowMaps"_u, SPOT_SHADOW_UNIT);
+        shader.setInt("pointShadowMaps"_u, POINT_SHADOW_UNIT);
+        shader.setInt("lightmap"_u, LIGHTMAP_UNIT);
+        shader.setInt("irradianceVolume"_u, IRRADIANCE_VOLUME_UNIT);
+        shader.setVec3("probeGridMin"_u, PROBE_GRID_MIN);
+        shader.setVec3("probeGridSize"_u, PROBE_GRID_MAX - PROBE_GRID_MIN);
+    });
+    auto wallSetup = [](Shader &shader) {
+        shader.setInt("material.texture_diffuse1"_u, 0);
+        shader.setInt("material.texture_specular1"_u, 1);
+        shader.setInt("material.texture_normal1"_u, 2);
+        shader.setFloat("material.shininess"_u, 128.0f);
+        shader.setInt("objectTransforms"_u, OBJECT_TRANSFORMS_UNIT);
+        shader.setInt("clusterLightData"_u, CLUSTER_LIGHT_DATA_UNIT);
+        shader.setInt("clusterRecords"_u, CLUSTER_RECORDS_UNIT);
+        shader.setInt("clusterLightIndices"_u, CLUSTER_INDICES_UNIT);
+        shader.setInt("dirShadowMap"_u, DIR_SHADOW_UNIT);
+        shader.setInt("spotShadowMaps"_u, SPOT_SHADOW_UNIT);
+        shader.setInt("pointShadowMaps"_u, POINT_SHADOW_UNIT);
+        shader.setInt("lightmap"_u, LIGHTMAP_UNIT);
+    };
+    ShaderVariants wallShaders("resources/shaders/4.normal_mapping.vs", "resources/shaders/4.normal_mapping.fs",
+                               HAS_SPECULAR_MAP | HAS_NORMAL_MAP | ALT_SPECULAR_SWIZZLE | PACKED_SPECULAR, wallSetup);
+    // the same walls lit in world space, the varyings do not grow with the number of lights
+    ShaderVariants worldWallShaders("resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs",
+                                    HAS_SPECULAR_MAP | HAS_NORMAL_MAP | ALT_SPECULAR_SWIZZLE | PACKED_SPECULAR | CLUSTERED_LIGHTING
+                                    | SHADOWS | LIGHTMAPPED, wallSetup);
+    // deferred shading writes the same materials into the G-buffer, the light counts do not matter to it
+    ShaderVariants gbufferShaders("resources/shaders/2.model_lighting.vs", "resources/shaders/gbuffer.fs",
+                                  HAS_SPECULAR_MAP | PACKED_SPECULAR, [](Shader &shader) {
+        shader.setInt("material.texture_diffuse1"_u, 0);
+        shader.setInt("material.texture_specular1"_u, 1);
+        shader.setInt("objectTransforms"_u, OBJECT_TRANSFORMS_UNIT);
+    });
+    ShaderVariants gbufferWallShaders("resources/shaders/2.model_lighting.vs", "resources/shaders/gbuffer.fs",
+                                      HAS_SPECULAR_MAP | HAS_NORMAL_MAP | PACKED_SPECULAR, wallSetup);
+    Shader deferredLightingShader("resources/shaders/deferred_lighting.vs", "resources/shaders/deferred_lighting.fs",
+                                  nullptr, "", true);
+    auto deferredLightingSetup = [](Shader &shader) {
+        shader.setInt("gAlbedoSpecular"_u, 0);
+        shader.setInt("gNormal"_u, 1);
+        shader.setInt("gDepth"_u, 2);
+        shader.setInt("lightData"_u, DEFERRED_LIGHT_DATA_UNIT);
+        shader.setInt("dirShadowMap"_u, DIR_SHADOW_UNIT);
+        shader.setInt("spotShadowMaps"_u, SPOT_SHADOW_UNIT);
+        shader.setInt("pointShadowMaps"_u, POINT_SHADOW_UNIT);
+        shader.setFloat("shininess"_u, 128.0f);
+    };
+    deferredLightingShader.OnLinked(deferredLightingSetup);
+    Shader halfLightingShader("resources/shaders/deferred_lighting.vs", "resources/shaders/deferred_lighting.fs",
+                              nullptr, "#define HALF_RESOLUTION 1\n", true);
+    halfLightingShader.OnLinked(deferredLightingSetup);
+    // the two passes of the stochastic lighting share the light buffer and the G-buffer units with the others
+    Shader stochasticSampleShader("resources/shaders/deferred_lighting.vs", "resources/shaders/deferred_lighting.fs",
+                                  nullptr, "#define STOCHASTIC 1\n", true);
+    stochasticSampleShader.OnLinked([&deferredLightingSetup](Shader &shader) {
+        deferredLightingSetup(shader);
+        shader.setInt("reservoirs"_u, STOCHASTIC_UNIT);
+        shader.setInt("historyNormal"_u, TEMPORAL_HISTORY_UNIT + 1);
+        shader.setInt("historyDepth"_u, TEMPORAL_HISTORY_UNIT + 2);
+    });
+    Shader stochasticShadeShader("resources/shaders/deferred_lighting.vs", "resources/shaders/deferred_lighting.fs",
+                                 nullptr, "#define STOCHASTIC 2\n", true);
+    stochasticShadeShader.OnLinked([&deferredLightingSetup](Shader &shader) {
+        deferredLightingSetup(shader);
+        shader.setInt("reservoirs"_u, STOCHASTIC_UNIT);
+    });
+    Shader accumulateShader("resources/shaders/fullscreen.vs", "resources/shaders/stochastic_accumulate.fs", nullptr,
+                            "", true);
+    accumulateShader.OnLinked([](Shader &shader) {
+        shader.setInt("shaded"_u, 0);
+        shader.setInt("gNormal"_u, 1);
+        shader.setInt("gDepth"_u, 2);
+        shader.setInt("previousAccumulation"_u, STOCHASTIC_UNIT);
+        shader.setInt("historyNormal"_u, TEMPORAL_HISTORY_UNIT + 1);
+        shader.setInt("historyDepth"_u, TEMPORAL_HISTORY_UNIT + 2);
+    });
+    Shader upsampleShader("resources/shaders/fullscreen.vs", "resources/shaders/deferred_upsample.fs", nullptr, "",
+                          true);
+    upsampleShader.OnLinked([](Shader &shader) {
+        shader.setInt("gAlbedoSpecular"_u, 0);
+        shader.setInt("gNormal"_u, 1);
+        shader.setInt("gDepth"_u, 2);
+        shader.setInt("halfDiffuse"_u, HALF_LIGHTING_UNIT);
+        shader.setInt("halfSpecular"_u, HALF_LIGHTING_UNIT + 1);
+    });
+    Shader temporalShader("resources/shaders/fullscreen.vs", "resources/shaders/temporal_reproject.fs", nullptr, "",
+                          true);
+    temporalShader.OnLinked([](Shader &shader) {
+        shader.setInt("gNormal"_u, 1);
+        shader.setInt("gDepth"_u, 2);
+        shader.setInt("historyColor"_u, TEMPORAL_HISTORY_UNIT);
+        shader.setInt("historyNormal"_u, TEMPORAL_HISTORY_UNIT + 1);
+        shader.setInt("historyDepth"_u, TEMPORAL_HISTORY_UNIT + 2);
+    });
+    Shader shadowShader("resources/shaders/shadow_depth.vs", "resources/shaders/shadow_depth.fs", nullptr, "", true);
+    shadowShader.OnLinked([](Shader &shader) {
+        shader.setInt("objectTransforms"_u, OBJECT_TRANSFORMS_UNIT);
+    });
+    Shader glassShader("resources/shaders/glass.vs", "resources/shaders/glass.fs", nullptr, "", true);
+    Shader occlusionBoxShader("resources/shaders/occlusion_box.vs", "resources/shaders/occlusion_box.fs", nullptr,
+                              "", true);
+    Shader lightShader("resources/shaders/light.vs", "resources/shaders/light.fs", nullptr, "", true);
+    Shader screenShader("resources/shaders/screen.vs", "resources/shaders/screen.fs", nullptr, "", true);
+    glassShader.OnLinked([](Shader &shader) {
+        shader.setInt("texture1"_u, 0);
+        shader.setInt("objectTransforms"_u, OBJECT_TRANSFORMS_UNIT);
+    });
+    lightShader.OnLinked([](Shader &shader) {
+        shader.setInt("texture_diffuse1"_u, 0);
+        shader.setInt("objectTransforms"_u, OBJECT_TRANSFORMS_UNIT);
+    });
+    screenShader.OnLinked([](Shader &shader) {
+        shader.setInt("screenTexture"_u, 0);
+    });
+    ShaderManager shaderManager(assetWatcher);
+    shaderManager.Add(ourShaders);
+    shaderManager.Add(wallShaders);
+    shaderManager.Add(worldWallShaders);
+    shaderManager.Add(gbufferShaders);
+    shaderManager.Add(gbufferWallShaders);
+    shaderManager.Add(deferredLightingShader);
+    shaderManager.Add(halfLightingShader);
+    shaderManager.Add(upsampleShader);
+    shaderManager.Add(stochasticSampleShader);
+    shaderManager.Add(stochasticShadeShader);
+    shaderManager.Add(accumulateShader);
+    shaderManager.Add(temporalShader);
+    shaderManager.Add(shadowShader);
+    shaderManager.Add(glassShader);
+    shaderManager.Add(occlusionBoxShader);
+    shaderManager.Add(lightShader);
+    shaderManager.Add(screenShader);
 
     // models
     // -----------
     stbi_set_flip_vertically_on_load(false);
-    Model desk("resources/objects/desk/desk.obj");
+    // furniture reads grayscale specular maps from the diffuse alpha, the lamps and the glass are drawn
+    // with shaders that use the diffuse alpha itself
+    Model desk("resources/objects/desk/desk.obj", false, true);
     desk.SetShaderTextureNamePrefix("material.");
     Model glass("resources/objects/glass/glass.obj");
     glass.SetShaderTextureNamePrefix("material.");
-    Model chair("resources/objects/chair/Patchwork chair.obj");
+    Model chair("resources/objects/chair/Patchwork chair.obj", false, true);
     chair.SetShaderTextureNamePrefix("material.");
-    Model table("resources/objects/table/table.obj");
+    Model table("resources/objects/table/table.obj", false, true);
     table.SetShaderTextureNamePrefix("material.");
-    Model table1("resources/objects/table1/table1.obj");
+    Model table1("resources/objects/table1/table1.obj", false, true);
     table1.SetShaderTextureNamePrefix("material.");
-    Model couch("resources/objects/couch/couch.obj");
+    Model couch("resources/objects/couch/couch.obj", false, true);
     couch.SetShaderTextureNamePrefix("material.");
-    Model laptop("resources/objects/laptop/laptop.obj");
+    Model laptop("resources/objects/laptop/laptop.obj", false, true);
     laptop.SetShaderTextureNamePrefix("material.");
-    Model plant("resources/objects/plant/plant.obj");
+    Model plant("resources/objects/plant/plant.obj", false, true);
     plant.SetShaderTextureNamePrefix("material.");
-    Model plant1("resources/objects/plant1/plant1.obj");
+    Model plant1("resources/objects/plant1/plant1.obj", false, true);
     plant1.SetShaderTextureNamePrefix("material.");
-    Model apples("resources/objects/apples/apples.obj");
+    Model apples("resources/objects/apples/apples.obj", false, true);
     apples.SetShaderTextureNamePrefix("material.");
-    Model bowl("resources/objects/bowl/bowl.obj");
+    Model bowl("resources/objects/bowl/bowl.obj", false, true);
     bowl.SetShaderTextureNamePrefix("material.");
     Model light1("resources/objects/light/light1.obj");
     light1.SetShaderTextureNamePrefix("material.");
@@ -264,20 +566,200 @@ int main() {
     unsigned int specularMapBottom = TextureFromFile("w_s.png", "resources/textures");
     unsigned int normalMapBottom = TextureFromFile("w_n.png", "resources/textures");
     unsigned int glassTexture = TextureFromFile("glass.png", "resources/textures");
-    ourShader.use();
-    ourShader.setInt("material.texture_diffuse1", 0);
-    ourShader.setInt("material.texture_specular1", 1);
-    wallShader.use();
-    wallShader.setInt("material.texture_diffuse1", 0);
-    wallShader.setInt("material.texture_specular1", 1);
-    wallShader.setInt("material.texture_normal1", 2);
-    glassShader.use();
-    glassShader.setInt("texture1", 0);
-    lightShader.use();
-    lightShader.setInt("texture_diffuse1", 0);
-    screenShader.use();
-    screenShader.setInt("screenTexture", 0);
+    // walls and ceiling read their grayscale specular maps from the diffuse alpha when the pair can be packed
+    unsigned int wallFeatures = HAS_SPECULAR_MAP | HAS_NORMAL_MAP;
+    unsigned int topFeatures = HAS_SPECULAR_MAP | HAS_NORMAL_MAP;
+    if (unsigned int packed = PackedTextureFromFiles("Stone_d.png", "Stone_s.png", "resources/textures")) {
+        diffuseMapWall = packed;
+        wallFeatures |= PACKED_SPECULAR;
+    }
+    if (unsigned int packed = PackedTextureFromFiles("White_d.png", "White_s.png", "resources/textures")) {
+        diffuseMapTop = packed;
+        topFeatures |= PACKED_SPECULAR;
+    }
+
+    for (Model *model : {&desk, &glass, &chair, &table, &table1, &couch, &laptop, &plant, &plant1, &apples, &bowl,
+                         &light1, &light2, &light3, &light4, &light5})
+        assetWatcher.Watch(*model);
+
+    // camera and lights, shared by every shader through uniform blocks
+    UniformBuffer<FrameData> frameData(FRAME_DATA_BINDING);
+    UniformBuffer<LightsData> lights(LIGHTS_BINDING);
+    ClusteredLights clusteredLights;
+    ObjectLights objectLights(LIGHTS_BINDING);
+    DeferredRenderer deferredRenderer(SCR_WIDTH, SCR_HEIGHT);
+    ShadowMaps shadowMaps(SHADOWS_BINDING);
+    // the room, walls included
+    shadowMaps.SetSceneBounds(glm::vec3(0.0f, 6.0f, 0.0f), 6.0f * std::sqrt(3.0f));
+    // a reloaded model may cast different shadows
+    assetWatcher.ListenModels([&shadowMaps](Model &) { shadowMaps.InvalidateStatic(); });
+    GpuProfiler profiler;
+    RenderQueue renderQueue;
+    std::vector<uint32_t> objectBindings;   // what bindObject binds for each object, see RenderQueue::Submit
+    FrustumCuller frustumCuller;
+    OcclusionQueries occlusionQueries;
+
+    // the room. Nothing in it moves, so every world matrix is computed once as the object is added.
+    ObjectTransforms transforms;
+    Scene scene(transforms);
+    const glm::vec3 X_AXIS(1.0f, 0.0f, 0.0f), Y_AXIS(0.0f, 1.0f, 0.0f), Z_AXIS(0.0f, 0.0f, 1.0f);
+    // the walls, the floor and the ceiling are the unit quad of quadVertexArray, drawn with one of these materials
+    struct QuadMaterial {
+        unsigned int diffuse, specular, normal;
+        unsigned int features;
+        float tiling;
+    };
+    const QuadMaterial quadMaterials[] = {
+            {diffuseMapWall, specularMapWall, normalMapWall, wallFeatures, 2.0f},
+            // the floor reads its specular map from the diffuse one
+            {diffuseMapBottom, diffuseMapBottom, normalMapBottom, HAS_SPECULAR_MAP | HAS_NORMAL_MAP, 5.0f},
+            {diffuseMapTop, specularMapTop, normalMapTop, topFeatures, 1.0f}};
+    std::vector<int> objectQuads;   // material of each object drawn as a quad, -1 for the others
+    auto addQuad = [&](const glm::mat4 &world, uint32_t flags, int material) {
+        unsigned int index = scene.Add(nullptr, world, flags, glm::vec3(0.0f), std::sqrt(2.0f));
+        objectQuads.resize(index + 1, -1);
+        objectQuads[index] = material;
+        return index;
+    };
+    const unsigned int backWallIndex = addQuad(PlaceObject(glm::vec3(0.0f, 6.0f, -6.0f), {}, glm::vec3(6.0f)),
+                                               SCENE_OPAQUE, 0);
+    const unsigned int frontWallIndex = addQuad(PlaceObject(glm::vec3(0.0f, 6.0f, 6.0f), {{180.0f, Y_AXIS}},
+                                                            glm::vec3(6.0f)), SCENE_OPAQUE, 0);
+    const unsigned int leftWallIndex = addQuad(PlaceObject(glm::vec3(-6.0f, 6.0f, 0.0f), {{90.0f, Y_AXIS}},
+                                                           glm::vec3(6.0f)), SCENE_OPAQUE, 0);
+    const unsigned int rightWallIndex = addQuad(PlaceObject(glm::vec3(6.0f, 6.0f, 0.0f),
+                                                            {{90.0f, Y_AXIS}, {180.0f, Y_AXIS}}, glm::vec3(6.0f)),
+                                                SCENE_OPAQUE, 0);
+    const unsigned int bottomIndex = addQuad(PlaceObject(glm::vec3(0.0f), {{90.0f, X_AXIS}, {180.0f, Y_AXIS}},
+                                                         glm::vec3(6.0f)), SCENE_OPAQUE | SCENE_TWO_SIDED, 1);
+    const unsigned int topIndex = addQuad(PlaceObject(glm::vec3(0.0f, 12.0f, 0.0f), {{90.0f, X_AXIS}},
+                                                      glm::vec3(6.0f)), SCENE_OPAQUE | SCENE_TWO_SIDED, 2);
+    // the furniture never moves and is drawn into the cached shadow maps
+    const uint32_t furniture = SCENE_OPAQUE | SCENE_CASTS_SHADOWS;
+    const unsigned int deskIndex = scene.Add(&desk, PlaceObject(glm::vec3(0.0f, 0.965f, -4.6f),
+                                                                {{180.0f, Y_AXIS}, {0.4f, Z_AXIS}}, glm::vec3(5.5f)),
+                                             furniture);
+    scene.Add(&chair, PlaceObject(glm::vec3(-2.5f, -0.235f, -2.0f), {{93.0f, X_AXIS}, {72.8f, Z_AXIS}},
+                                  glm::vec3(0.7f)), furniture);
+    scene.Add(&table, PlaceObject(glm::vec3(-3.65f, 0.01f, -3.8f), {{90.0f, -Y_AXIS}}, glm::vec3(0.8f)), furniture);
+    scene.Add(&table1, PlaceObject(glm::vec3(2.0f, 0.0f, 4.0f), {{70.0f, -Y_AXIS}}, glm::vec3(0.4f)), furniture);
+    const unsigned int couchIndex = scene.Add(&couch, PlaceObject(glm::vec3(3.8f, -0.2f, 0.0f), {{90.0f, -Y_AXIS}},
+                                                                  glm::vec3(0.9f)), furniture);
+    scene.Add(&laptop, PlaceObject(glm::vec3(1.0f, 2.813f, -5.0f), {{75.0f, Y_AXIS}}), furniture);
+    scene.Add(&plant, PlaceObject(glm::vec3(-2.0f, 2.791f, -4.5f), {{15.0f, Y_AXIS}}, glm::vec3(0.45f)), furniture);
+    scene.Add(&plant1, PlaceObject(glm::vec3(-4.8f, 2.454f, 4.2f), {{40.0f, -Y_AXIS}}), furniture);
+    scene.Add(&apples, PlaceObject(glm::vec3(-5.2f, 2.45f, 1.0f), {}, glm::vec3(0.4f)), furniture);
+    scene.Add(&bowl, PlaceObject(glm::vec3(2.5f, 0.92f, 4.6f), {}, glm::vec3(0.1f)), furniture);
+    // lamps glow while they are switched on and are lit like the furniture while they are off. They never move, an
+    // unlit lamp is a static caster and flipping a switch makes the cached maps out of date. The wall lamps are drawn
+    // from both sides.
+    const uint32_t lampFlags = SCENE_OPAQUE | SCENE_CASTS_SHADOWS | SCENE_SWITCHED;
+    struct Lamp {
+        unsigned int index;
+        bool ProgramState::*on;
+    };
+    const Lamp lamps[] = {
+            {scene.Add(&light1, PlaceObject(glm::vec3(0.0f, 11.05f, 0.0f), {{90.0f, Y_AXIS}}, glm::vec3(1.2f)),
+                       lampFlags), &ProgramState::light1},
+            {scene.Add(&light2, PlaceObject(glm::vec3(2.8f, 5.0f, -5.99f), {}), lampFlags | SCENE_TWO_SIDED),
+             &ProgramState::light2_1},
+            {scene.Add(&light2, PlaceObject(glm::vec3(-2.8f, 5.0f, -5.99f), {}), lampFlags | SCENE_TWO_SIDED),
+             &ProgramState::light2_2},
+            {scene.Add(&light3, PlaceObject(glm::vec3(-1.4f, 2.786f, -5.2f), {{145.0f, Y_AXIS}}, glm::vec3(0.04f)),
+                       lampFlags), &ProgramState::light3},
+            {scene.Add(&light4, PlaceObject(glm::vec3(4.2f, 0.0f, -3.5f), {{95.0f, -Y_AXIS}}, glm::vec3(0.07f)),
+                       lampFlags), &ProgramState::light4},
+            {scene.Add(&light5, PlaceObject(glm::vec3(-4.8f, 2.66f, -1.0f), {{55.0f, Y_AXIS}}, glm::vec3(1.4f)),
+                       lampFlags), &ProgramState::light5}};
+    // the glass is drawn last, blended back to front by the render queue. The pane is the quad of glassVertexArray,
+    // which reaches from x = 0 to 1.
+    scene.Add(nullptr, PlaceObject(glm::vec3(-4.325f, 1.665f, 3.235f), {{90.0f, Y_AXIS}}, glm::vec3(1.25f, 1.56f, 0.0f)),
+              SCENE_TWO_SIDED, glm::vec3(0.5f, 0.0f, 0.0f), std::sqrt(0.5f));
+    scene.Add(&glass, PlaceObject(glm::vec3(-1.0f, 2.77f, -4.0f), {}), SCENE_TWO_SIDED);
+    objectQuads.resize(scene.Size(), -1);
+    assetWatcher.ListenModels([&scene](Model &model) { scene.Reload(model); });
+    for (unsigned int i = 0; i < scene.Size(); i++)
+        objectLights.SetBounds(i, scene.LocalCenters()[i], scene.LocalRadii()[i]);
+
+    // what the CPU occlusion culler draws, the quads of the room and the boxes inside the desk and the couch
+    const std::vector<glm::vec3> quadOccluder = {glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(-1.0f, -1.0f, 0.0f),
+                                                 glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f),
+                                                 glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f)};
+    OcclusionCuller occlusionCuller;
+    for (unsigned int index : {backWallIndex, frontWallIndex, leftWallIndex, rightWallIndex, bottomIndex, topIndex})
+        occlusionCuller.AddOccluder(index, &quadOccluder);
+    occlusionCuller.AddOccluder(deskIndex, &desk.occluder);
+    occlusionCuller.AddOccluder(couchIndex, &couch.occluder);
+
+    // shadow casters, the walls only receive shadows as every light is inside the room
+    auto drawShadowCasters = [&](Shader &shader, bool dynamic) {
+        const std::vector<uint32_t> &flags = scene.Flags();
+        const std::vector<Model *> &models = scene.Models();
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            bool caster = (flags[i] & SCENE_CASTS_SHADOWS) && !(flags[i] & SCENE_GLOWING) && models[i];
+            if (caster && dynamic == ((flags[i] & SCENE_DYNAMIC) != 0)) {
+                shader.setInt("objectIndex"_u, i);
+                models[i]->Draw(shader);
+            }
+        }
+    };
 
+    // static lighting. The lamps' lights are baked into lightmaps of the walls, the floor and the ceiling, the
+    // furniture blocks and reflects their light. Furniture is lightmapped too if its file brings a second texture
+    // coordinate set to bake into. The lamps themselves are left out, their lights sit inside them. The same bake
+    // fills a grid of irradiance probes over the room for the furniture without lightmaps.
+    LightmapBaker lightmapBaker;
+    IrradianceVolume irradianceVolume;
+    std::vector<int> objectLightmaps(scene.Size(), -1);   // lightmap surface of each object, -1 for none
+    const std::pair<unsigned int, glm::vec3> bakedRoom[] = {
+            {backWallIndex, glm::vec3(0.45f)}, {frontWallIndex, glm::vec3(0.45f)}, {leftWallIndex, glm::vec3(0.45f)},
+            {rightWallIndex, glm::vec3(0.45f)}, {bottomIndex, glm::vec3(0.4f, 0.3f, 0.2f)},
+            {topIndex, glm::vec3(0.8f)}};
+    auto bakeLightmaps = [&]() {
+        lightmapBaker.Clear();
+        irradianceVolume.Clear();
+        std::fill(objectLightmaps.begin(), objectLightmaps.end(), -1);
+        // the quad of quadVertexArray, its lightmap coordinates are the positions moved into [0, 1]
+        std::vector<Vertex> quad(4, Vertex());
+        const glm::vec2 corners[4] = {glm::vec2(-1.0f, 1.0f), glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, -1.0f),
+                                      glm::vec2(1.0f, 1.0f)};
+        for (int i = 0; i < 4; i++) {
+            quad[i].Position = glm::vec3(corners[i], 0.0f);
+            quad[i].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+            quad[i].LightmapCoords = corners[i] * 0.5f + 0.5f;
+        }
+        const std::vector<unsigned int> quadIndices = {0, 1, 2, 0, 2, 3};
+        for (const std::pair<unsigned int, glm::vec3> &wall : bakedRoom) {
+            objectLightmaps[wall.first] = (int) lightmapBaker.AddSurface(128);
+            lightmapBaker.AddGeometry(quad, quadIndices, scene.Worlds()[wall.first], wall.second,
+                                      objectLightmaps[wall.first]);
+        }
+        const std::vector<uint32_t> &flags = scene.Flags();
+        const std::vector<Model *> &models = scene.Models();
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            // the furniture, the static casters but the lamps
+            if (!models[i] || !(flags[i] & SCENE_CASTS_SHADOWS) || (flags[i] & (SCENE_DYNAMIC | SCENE_SWITCHED)))
+                continue;
+            if (models[i]->HasLightmapCoords())
+                objectLightmaps[i] = (int) lightmapBaker.AddSurface(256);
+            for (const Mesh &mesh : models[i]->meshes)
+                lightmapBaker.AddGeometry(mesh.vertices, mesh.indices, scene.Worlds()[i], glm::vec3(0.4f),
+                                          objectLightmaps[i]);
+        }
+        for (unsigned int layer = 0; layer < BAKED_LAYERS; layer++) {
+            for (const PointLightSource &source : pointLightSources)
+                if (source.enabled == bakedSwitches[layer])
+                    lightmapBaker.AddLight(MakePointLight(source), layer);
+            for (const SpotLightSource &source : spotLightSources)
+                if (source.enabled == bakedSwitches[layer])
+                    lightmapBaker.AddLight(MakeSpotLight(source), layer);
+        }
+        lightmapBaker.SetProbeGrid(PROBE_GRID_MIN, PROBE_GRID_MAX, PROBE_GRID_COUNT);
+        lightmapBaker.Start();
+    };
+    bakeLightmaps();
+    // a reloaded model blocks and reflects the light differently, the old maps are dropped until the new ones are done
+    assetWatcher.ListenModels([&bakeLightmaps](Model &) { bakeLightmaps(); });
 
     // render loop
     // -----------
@@ -291,820 +773,272 @@ int main() {
         // input
         // -----
         processInput(window);
+        assetWatcher.Update();
+        shaderManager.Update();
+        if (lightmapBaker.Update())
+            irradianceVolume.Set(lightmapBaker);
+        if (!shaderManager.Ready()) {
+            // the first programs are still compiling
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
+        }
 
-        float a = glm::distance(glm::vec3(-4.325f, 1.665f, 3.235f), programState->camera.Position);
-        float b = glm::distance(glm::vec3(-1.0f, 2.77f, -4.0f), programState->camera.Position);
-        bool distance = a > b;
         // render
         // ------
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // 1. draw scene as normal in multisampled buffers
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-
+        bool deferred = programState->deferredShading;
 
         // view/projection transformations
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
                                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
-        ourShader.use();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-        ourShader.setVec3("viewPos", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 128.0f);
-        wallShader.use();
-        wallShader.setMat4("projection", projection);
-        wallShader.setMat4("view", view);
-        wallShader.setVec3("viewPos", programState->camera.Position);
-        wallShader.setFloat("material.shininess", 128.0f);
-
-        // directional light
-        if(programState->dlight) {
-            ourShader.use();
-            ourShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-            ourShader.setVec3("dirLight.ambient", 0.12f, 0.12f, 0.12f);
-            ourShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("dirLight.specular", 0.3f, 0.3f, 0.3f);
-            wallShader.use();
-            wallShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-            wallShader.setVec3("dirLight.ambient", 0.12f, 0.12f, 0.12f);
-            wallShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("dirLight.specular", 0.3f, 0.3f, 0.3f);
-        } else {
-            ourShader.use();
-            ourShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-            ourShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("dirLight.specular", 0.0f, 0.0f, 0.0f);
-            wallShader.use();
-            wallShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-            wallShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("dirLight.diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("dirLight.specular", 0.0f, 0.0f, 0.0f);
+        frameData.data.projection = projection;
+        frameData.data.view = view;
+        frameData.data.viewPos = programState->camera.Position;
+        for (const Lamp &lamp : lamps) {
+            // a lamp that glows casts no shadow
+            if (((scene.Flags()[lamp.index] & SCENE_GLOWING) != 0) != programState->*lamp.on)
+                shadowMaps.InvalidateStatic();
+            scene.SetFlag(lamp.index, SCENE_GLOWING, programState->*lamp.on);
         }
-        // point light
-        if (programState->light1) {
-            ourShader.use();
-            ourShader.setVec3("pointLights[0].position", -0.25f, 10.3f, 0.0f);
-            ourShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("pointLights[0].specular", 0.5f, 0.5f, 0.5f);
-            ourShader.setFloat("pointLights[0].constant", 1.0f);
-            ourShader.setFloat("pointLights[0].linear", 0.01f);
-            ourShader.setFloat("pointLights[0].quadratic", 0.001f);
-
-            ourShader.setVec3("pointLights[1].position", -2.075f, 10.3f, 0.0f);
-            ourShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[1].diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("pointLights[1].specular", 0.5f, 0.5f, 0.5f);
-            ourShader.setFloat("pointLights[1].constant", 1.0f);
-            ourShader.setFloat("pointLights[1].linear", 0.01f);
-            ourShader.setFloat("pointLights[1].quadratic", 0.001f);
-
-            ourShader.setVec3("pointLights[2].position", 1.535f, 10.3f, 0.0f);
-            ourShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[2].diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("pointLights[2].specular", 0.5f, 0.5f, 0.5f);
-            ourShader.setFloat("pointLights[2].constant", 1.0f);
-            ourShader.setFloat("pointLights[2].linear", 0.01f);
-            ourShader.setFloat("pointLights[2].quadratic", 0.001f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[0]", -0.25f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[0].position", -0.25f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("pointLights[0].diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("pointLights[0].specular", 0.5f, 0.5f, 0.5f);
-            wallShader.setFloat("pointLights[0].constant", 1.0f);
-            wallShader.setFloat("pointLights[0].linear", 0.01f);
-            wallShader.setFloat("pointLights[0].quadratic", 0.001f);
-
-            wallShader.setVec3("lightPos[1]", -2.075f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[1].position", -2.075f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("pointLights[1].diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("pointLights[1].specular", 0.5f, 0.5f, 0.5f);
-            wallShader.setFloat("pointLights[1].constant", 1.0f);
-            wallShader.setFloat("pointLights[1].linear", 0.01f);
-            wallShader.setFloat("pointLights[1].quadratic", 0.001f);
-
-            wallShader.setVec3("lightPos[2]", 1.535f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[2].position", 1.535f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("pointLights[2].diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("pointLights[2].specular", 0.5f, 0.5f, 0.5f);
-            wallShader.setFloat("pointLights[2].constant", 1.0f);
-            wallShader.setFloat("pointLights[2].linear", 0.01f);
-            wallShader.setFloat("pointLights[2].quadratic", 0.001f);
-
-        } else {
-            ourShader.use();
-            ourShader.setVec3("pointLights[0].position", -0.25f, 10.3f, 0.0f);
-            ourShader.setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("pointLights[0].constant", 1.0f);
-            ourShader.setFloat("pointLights[0].linear", 0.01f);
-            ourShader.setFloat("pointLights[0].quadratic", 0.001f);
-
-            ourShader.setVec3("pointLights[1].position", -2.075f, 10.3f, 0.0f);
-            ourShader.setVec3("pointLights[1].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[1].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[1].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("pointLights[1].constant", 1.0f);
-            ourShader.setFloat("pointLights[1].linear", 0.01f);
-            ourShader.setFloat("pointLights[1].quadratic", 0.001f);
-
-            ourShader.setVec3("pointLights[2].position", 1.535f, 10.3f, 0.0f);
-            ourShader.setVec3("pointLights[2].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[2].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[2].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("pointLights[2].constant", 1.0f);
-            ourShader.setFloat("pointLights[2].linear", 0.01f);
-            ourShader.setFloat("pointLights[2].quadratic", 0.001f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[0]", -0.25f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[0].position", -0.25f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[0].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("pointLights[0].constant", 1.0f);
-            wallShader.setFloat("pointLights[0].linear", 0.01f);
-            wallShader.setFloat("pointLights[0].quadratic", 0.001f);
-
-            wallShader.setVec3("lightPos[1]", -2.075f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[1].position", -2.075f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[1].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[1].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[1].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("pointLights[1].constant", 1.0f);
-            wallShader.setFloat("pointLights[1].linear", 0.01f);
-            wallShader.setFloat("pointLights[1].quadratic", 0.001f);
-
-            wallShader.setVec3("lightPos[2]", 1.535f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[2].position", 1.535f, 10.3f, 0.0f);
-            wallShader.setVec3("pointLights[2].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[2].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[2].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("pointLights[2].constant", 1.0f);
-            wallShader.setFloat("pointLights[2].linear", 0.01f);
-            wallShader.setFloat("pointLights[2].quadratic", 0.001f);
+        scene.Update();
+        transforms.Update(projection * view);
+        // the objects that are drawn, null for all of them
+        const std::vector<uint8_t> *visible = nullptr;
+        frustumCuller.Update(scene);
+        if (programState->frustumCulling) {
+            frustumCuller.Cull(projection * view);
+            visible = &frustumCuller.Visible();
         }
-
-        if (programState->light2_1) {
-            ourShader.use();
-            ourShader.setVec3("pointLights[3].position", 2.55f, 5.75f, -5.6f);
-            ourShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[3].diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("pointLights[3].specular", 0.6f, 0.6f, 0.6f);
-            ourShader.setFloat("pointLights[3].constant", 1.0f);
-            ourShader.setFloat("pointLights[3].linear", 0.03f);
-            ourShader.setFloat("pointLights[3].quadratic", 0.016f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[3]", 2.55f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[3].position", 2.55f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("pointLights[3].diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("pointLights[3].specular", 0.5f, 0.5f, 0.5f);
-            wallShader.setFloat("pointLights[3].constant", 1.0f);
-            wallShader.setFloat("pointLights[3].linear", 0.03f);
-            wallShader.setFloat("pointLights[3].quadratic", 0.016f);
-        } else {
-            ourShader.use();
-            ourShader.setVec3("pointLights[3].position", 2.55f, 5.75f, -5.6f);
-            ourShader.setVec3("pointLights[3].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[3].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[3].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("pointLights[3].constant", 1.0f);
-            ourShader.setFloat("pointLights[3].linear", 0.03f);
-            ourShader.setFloat("pointLights[3].quadratic", 0.016f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[3]", 2.55f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[3].position", 2.55f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[3].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[3].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[3].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("pointLights[3].constant", 1.0f);
-            wallShader.setFloat("pointLights[3].linear", 0.03f);
-            wallShader.setFloat("pointLights[3].quadratic", 0.016f);
-        }
-
-        if (programState->light2_2) {
-            ourShader.use();
-            ourShader.setVec3("pointLights[4].position", -3.05f, 5.75f, -5.6f);
-            ourShader.setVec3("pointLights[4].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[4].diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("pointLights[4].specular", 0.6f, 0.6f, 0.6f);
-            ourShader.setFloat("pointLights[4].constant", 1.0f);
-            ourShader.setFloat("pointLights[4].linear", 0.03f);
-            ourShader.setFloat("pointLights[4].quadratic", 0.016f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[4]", -3.05f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[4].position", -3.05f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[4].ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("pointLights[4].diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("pointLights[4].specular", 0.5f, 0.5f, 0.5f);
-            wallShader.setFloat("pointLights[4].constant", 1.0f);
-            wallShader.setFloat("pointLights[4].linear", 0.03f);
-            wallShader.setFloat("pointLights[4].quadratic", 0.016f);
-        } else {
-            ourShader.use();
-            ourShader.setVec3("pointLights[4].position", -3.05f, 5.75f, -5.6f);
-            ourShader.setVec3("pointLights[4].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[4].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[4].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("pointLights[4].constant", 1.0f);
-            ourShader.setFloat("pointLights[4].linear", 0.03f);
-            ourShader.setFloat("pointLights[4].quadratic", 0.016f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[4]", -3.05f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[4].position", -3.05f, 5.75f, -5.6f);
-            wallShader.setVec3("pointLights[4].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[4].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[4].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("pointLights[4].constant", 1.0f);
-            wallShader.setFloat("pointLights[4].linear", 0.03f);
-            wallShader.setFloat("pointLights[4].quadratic", 0.016f);
+        if (programState->occlusionCulling) {
+            occlusionCuller.Render(projection * view, scene);
+            occlusionCuller.Cull(projection * view, scene, visible);
+            visible = &occlusionCuller.Visible();
         }
-
-        if (programState->light5) {
-            ourShader.use();
-            ourShader.setVec3("pointLights[5].position", -5.425f, 2.76f, -0.46f);
-            ourShader.setVec3("pointLights[5].ambient", 0.05f, 0.05f, 0.05f);
-            ourShader.setVec3("pointLights[5].diffuse", 0.4f, 0.4f, 0.4f);
-            ourShader.setVec3("pointLights[5].specular", 0.6f, 0.6f, 0.6f);
-            ourShader.setFloat("pointLights[5].constant", 1.0f);
-            ourShader.setFloat("pointLights[5].linear", 0.03f);
-            ourShader.setFloat("pointLights[5].quadratic", 0.016f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[5]", -5.425f, 2.76f, -0.46f);
-            wallShader.setVec3("pointLights[5].position", -5.425f, 2.76f, -0.46f);
-            wallShader.setVec3("pointLights[5].ambient", 0.05f, 0.05f, 0.05f);
-            wallShader.setVec3("pointLights[5].diffuse", 0.4f, 0.4f, 0.4f);
-            wallShader.setVec3("pointLights[5].specular", 0.5f, 0.5f, 0.5f);
-            wallShader.setFloat("pointLights[5].constant", 1.0f);
-            wallShader.setFloat("pointLights[5].linear", 0.03f);
-            wallShader.setFloat("pointLights[5].quadratic", 0.016f);
-        } else {
-            ourShader.use();
-            ourShader.setVec3("pointLights[5].position", -5.425f, 2.76f, -0.46f);
-            ourShader.setVec3("pointLights[5].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[5].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("pointLights[5].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("pointLights[5].constant", 1.0f);
-            ourShader.setFloat("pointLights[5].linear", 0.03f);
-            ourShader.setFloat("pointLights[5].quadratic", 0.016f);
-
-            wallShader.use();
-            wallShader.setVec3("lightPos[5]", -5.425f, 2.76f, -0.46f);
-            wallShader.setVec3("pointLights[5].position", -5.425f, 2.76f, -0.46f);
-            wallShader.setVec3("pointLights[5].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[5].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("pointLights[5].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("pointLights[5].constant", 1.0f);
-            wallShader.setFloat("pointLights[5].linear", 0.03f);
-            wallShader.setFloat("pointLights[5].quadratic", 0.016f);
+        // the draws of the objects the queries of the last frame may have found hidden are made under a condition
+        const std::vector<GLuint> *conditions = nullptr;
+        if (programState->occlusionQueries) {
+            occlusionQueries.Begin(scene, projection * view, visible, SCR_WIDTH, SCR_HEIGHT);
+            conditions = &occlusionQueries.Conditions();
         }
 
-
-        // spotLight
-        if(programState->slight) {
-            ourShader.use();
-            ourShader.setVec3("spotLights[0].position", programState->camera.Position);
-            ourShader.setVec3("spotLights[0].direction", programState->camera.Front);
-            ourShader.setVec3("spotLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[0].diffuse", 1.0f, 1.0f, 1.0f);
-            ourShader.setVec3("spotLights[0].specular", 1.0f, 1.0f, 1.0f);
-            ourShader.setFloat("spotLights[0].constant", 1.0f);
-            ourShader.setFloat("spotLights[0].linear", 0.09f);
-            ourShader.setFloat("spotLights[0].quadratic", 0.032f);
-            ourShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(15.0f)));
-
-            wallShader.use();
-            wallShader.setVec3("spotLights[0].position", programState->camera.Position);
-            wallShader.setVec3("spotLights[0].direction", programState->camera.Front);
-            wallShader.setVec3("spotLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[0].diffuse", 1.0f, 1.0f, 1.0f);
-            wallShader.setVec3("spotLights[0].specular", 1.0f, 1.0f, 1.0f);
-            wallShader.setFloat("spotLights[0].constant", 1.0f);
-            wallShader.setFloat("spotLights[0].linear", 0.09f);
-            wallShader.setFloat("spotLights[0].quadratic", 0.032f);
-            wallShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(12.5f)));
-            wallShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(15.0f)));
-        } else {
-            ourShader.use();
-            ourShader.setVec3("spotLights[0].position", programState->camera.Position);
-            ourShader.setVec3("spotLights[0].direction", programState->camera.Front);
-            ourShader.setVec3("spotLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[0].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("spotLights[0].constant", 1.0f);
-            ourShader.setFloat("spotLights[0].linear", 0.09f);
-            ourShader.setFloat("spotLights[0].quadratic", 0.032f);
-            ourShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(12.5f)));
-            ourShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(15.0f)));
-
-            wallShader.use();
-            wallShader.setVec3("spotLights[0].position", programState->camera.Position);
-            wallShader.setVec3("spotLights[0].direction", programState->camera.Front);
-            wallShader.setVec3("spotLights[0].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[0].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("spotLights[0].constant", 1.0f);
-            wallShader.setFloat("spotLights[0].linear", 0.09f);
-            wallShader.setFloat("spotLights[0].quadratic", 0.032f);
-            wallShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(12.5f)));
-            wallShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(15.0f)));
+        // lights, shared by all lighting shaders. The key picks the variants compiled for the active lights.
+        ShaderVariantKey lightKey = UpdateLights(lights.data, clusteredLights, shadowMaps, programState);
+        if (programState->clusteredLighting && !deferred)
+            clusteredLights.Update(view, projection, 0.1f, 100.0f, SCR_WIDTH, SCR_HEIGHT, frameData.data);
+        // the forward renderer takes the lamps' lights from the lightmaps where there are some. The extra lights
+        // are not baked, with any of them on everything is lit by the lights themselves.
+        bool lightmapped = programState->bakedLighting && lightmapBaker.Ready() && !deferred
+                           && !programState->clusteredLighting && programState->extraLights == 0;
+        for (unsigned int layer = 0; layer < MAX_LIGHTMAP_LAYERS; layer++)
+            frameData.data.lightmapWeights[layer / 4][layer % 4] =
+                    layer < BAKED_LAYERS && programState->*bakedSwitches[layer] ? 1.0f : 0.0f;
+        // lightmapped surfaces only loop over the camera's spot light, the first one in the Lights block
+        ShaderVariantKey lightmapKey;
+        lightmapKey.pointLights = 0;
+        lightmapKey.spotLights = programState->slight ? 1 : 0;
+        lightmapKey.features = LIGHTMAPPED | (lightKey.features & SHADOWS);
+        // the probes only hold the lamps that are on, like the lightmaps
+        bool probeLit = programState->irradianceVolume && !deferred;
+        if (probeLit)
+            irradianceVolume.Update(frameData.data.lightmapWeights);
+        unsigned int probeFeatures = probeLit && irradianceVolume.Ready() ? IRRADIANCE_VOLUME : 0;
+        frameData.Upload();
+        lights.Upload();
+        // the per-object light lists point the Lights binding at their own blocks while the scene is drawn
+        lights.Bind();
+        bool perObjectLights = programState->objectLightLists && !programState->clusteredLighting && !deferred;
+        // models are reloaded in place, their bounds can change
+        for (unsigned int i : scene.Changed())
+            objectLights.SetBounds(i, scene.LocalCenters()[i], scene.LocalRadii()[i]);
+        if (perObjectLights) {
+            objectLights.Update(transforms, lights.data.dirLight, clusteredLights.pointLights,
+                                clusteredLights.spotLights);
         }
 
-        if(programState->light3) {
-            ourShader.use();
-            ourShader.setVec3("spotLights[1].position", -0.575f, 5.25f, -4.45f);
-            ourShader.setVec3("spotLights[1].direction", 0.3, -0.9, 0.09);
-            ourShader.setVec3("spotLights[1].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[1].diffuse", 1.0f, 1.0f, 1.0f);
-            ourShader.setVec3("spotLights[1].specular", 1.0f, 1.0f, 1.0f);
-            ourShader.setFloat("spotLights[1].constant", 1.0f);
-            ourShader.setFloat("spotLights[1].linear", 0.09f);
-            ourShader.setFloat("spotLights[1].quadratic", 0.032f);
-            ourShader.setFloat("spotLights[1].cutOff", glm::cos(glm::radians(22.5f)));
-            ourShader.setFloat("spotLights[1].outerCutOff", glm::cos(glm::radians(30.0f)));
-
-            wallShader.use();
-            wallShader.setVec3("spotLights[1].position", -0.575f, 5.25f, -4.45f);
-            wallShader.setVec3("spotLights[1].direction", 0.3, -0.9, 0.09);
-            wallShader.setVec3("spotLights[1].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[1].diffuse", 1.0f, 1.0f, 1.0f);
-            wallShader.setVec3("spotLights[1].specular", 1.0f, 1.0f, 1.0f);
-            wallShader.setFloat("spotLights[1].constant", 1.0f);
-            wallShader.setFloat("spotLights[1].linear", 0.09f);
-            wallShader.setFloat("spotLights[1].quadratic", 0.032f);
-            wallShader.setFloat("spotLights[1].cutOff", glm::cos(glm::radians(22.5f)));
-            wallShader.setFloat("spotLights[1].outerCutOff", glm::cos(glm::radians(30.0f)));
-        } else {
-            ourShader.use();
-            ourShader.setVec3("spotLights[1].position", -0.575f, 5.25f, -4.45f);
-            ourShader.setVec3("spotLights[1].direction", 0.3, -0.9, 0.09);
-            ourShader.setVec3("spotLights[1].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[1].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[1].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("spotLights[1].constant", 1.0f);
-            ourShader.setFloat("spotLights[1].linear", 0.09f);
-            ourShader.setFloat("spotLights[1].quadratic", 0.032f);
-            ourShader.setFloat("spotLights[1].cutOff", glm::cos(glm::radians(22.5f)));
-            ourShader.setFloat("spotLights[1].outerCutOff", glm::cos(glm::radians(30.0f)));
-
-            wallShader.use();
-            wallShader.setVec3("spotLights[1].position", -0.575f, 5.25f, -4.45f);
-            wallShader.setVec3("spotLights[1].direction", 0.3, -0.9, 0.09);
-            wallShader.setVec3("spotLights[1].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[1].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[1].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("spotLights[1].constant", 1.0f);
-            wallShader.setFloat("spotLights[1].linear", 0.09f);
-            wallShader.setFloat("spotLights[1].quadratic", 0.032f);
-            wallShader.setFloat("spotLights[1].cutOff", glm::cos(glm::radians(22.5f)));
-            wallShader.setFloat("spotLights[1].outerCutOff", glm::cos(glm::radians(30.0f)));
+        // 1. shadow maps, only the ones that are out of date are drawn again and the dynamic casters over the rest
+        if (programState->shadows) {
+            profiler.Begin("Shadows");
+            bool dynamicCasters = false;
+            for (uint32_t flags : scene.Flags())
+                dynamicCasters = dynamicCasters || ((flags & SCENE_CASTS_SHADOWS) && !(flags & SCENE_GLOWING)
+                                                    && (flags & SCENE_DYNAMIC));
+            shadowMaps.Render(shadowShader, drawShadowCasters, dynamicCasters);
         }
 
-        if(programState->light4) {
-            ourShader.use();
-            ourShader.setVec3("spotLights[2].position", 3.56f, 4.25f, 0.85f);
-            ourShader.setVec3("spotLights[2].direction", -0.3f, -0.9f, 0.0f);
-            ourShader.setVec3("spotLights[2].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[2].diffuse", 1.0f, 1.0f, 1.0f);
-            ourShader.setVec3("spotLights[2].specular", 1.0f, 1.0f, 1.0f);
-            ourShader.setFloat("spotLights[2].constant", 1.0f);
-            ourShader.setFloat("spotLights[2].linear", 0.09f);
-            ourShader.setFloat("spotLights[2].quadratic", 0.032f);
-            ourShader.setFloat("spotLights[2].cutOff", glm::cos(glm::radians(40.5f)));
-            ourShader.setFloat("spotLights[2].outerCutOff", glm::cos(glm::radians(60.0f)));
-
-            wallShader.use();
-            wallShader.setVec3("spotLights[2].position", 3.56f, 4.25f, 0.85f);
-            wallShader.setVec3("spotLights[2].direction", -0.3f, -0.9f, 0.0f);
-            wallShader.setVec3("spotLights[2].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[2].diffuse", 1.0f, 1.0f, 1.0f);
-            wallShader.setVec3("spotLights[2].specular", 1.0f, 1.0f, 1.0f);
-            wallShader.setFloat("spotLights[2].constant", 1.0f);
-            wallShader.setFloat("spotLights[2].linear", 0.09f);
-            wallShader.setFloat("spotLights[2].quadratic", 0.032f);
-            wallShader.setFloat("spotLights[2].cutOff", glm::cos(glm::radians(40.5f)));
-            wallShader.setFloat("spotLights[2].outerCutOff", glm::cos(glm::radians(60.0f)));
+        // 2. draw scene as normal in multisampled buffers, or its materials into the G-buffer
+        if (deferred) {
+            profiler.Begin("G-buffer");
+            deferredRenderer.BeginGeometry();
         } else {
-            ourShader.use();
-            ourShader.setVec3("spotLights[2].position", 3.56f, 4.25f, 0.85f);
-            ourShader.setVec3("spotLights[2].direction", -0.3f, -0.9f, 0.0f);
-            ourShader.setVec3("spotLights[2].ambient", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[2].diffuse", 0.0f, 0.0f, 0.0f);
-            ourShader.setVec3("spotLights[2].specular", 0.0f, 0.0f, 0.0f);
-            ourShader.setFloat("spotLights[2].constant", 1.0f);
-            ourShader.setFloat("spotLights[2].linear", 0.09f);
-            ourShader.setFloat("spotLights[2].quadratic", 0.032f);
-            ourShader.setFloat("spotLights[2].cutOff", glm::cos(glm::radians(40.5f)));
-            ourShader.setFloat("spotLights[2].outerCutOff", glm::cos(glm::radians(60.0f)));
-
-            wallShader.use();
-            wallShader.setVec3("spotLights[2].position", 3.56f, 4.25f, 0.85f);
-            wallShader.setVec3("spotLights[2].direction", -0.3f, -0.9f, 0.0f);
-            wallShader.setVec3("spotLights[2].ambient", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[2].diffuse", 0.0f, 0.0f, 0.0f);
-            wallShader.setVec3("spotLights[2].specular", 0.0f, 0.0f, 0.0f);
-            wallShader.setFloat("spotLights[2].constant", 1.0f);
-            wallShader.setFloat("spotLights[2].linear", 0.09f);
-            wallShader.setFloat("spotLights[2].quadratic", 0.032f);
-            wallShader.setFloat("spotLights[2].cutOff", glm::cos(glm::radians(40.5f)));
-            wallShader.setFloat("spotLights[2].outerCutOff", glm::cos(glm::radians(60.0f)));
+            profiler.Begin("Opaque");
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glEnable(GL_DEPTH_TEST);
         }
 
-        // render Cube
-        // face culling
-        wallShader.use();
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 6.0f, -6.0f));
-        model = glm::scale(model, glm::vec3(6.0f));
-        wallShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapWall);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMapWall);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalMapWall);
-        renderQuad(2.0f);
-
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 6.0f, 6.0f));
-        model = glm::rotate(model, glm::radians(180.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(6.0f));
-        wallShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapWall);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMapWall);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalMapWall);
-        renderQuad(2.0f);
-
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-6.0f, 6.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(6.0f));
-        wallShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapWall);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMapWall);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalMapWall);
-        renderQuad(2.0f);
-
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(6.0f, 6.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::rotate(model, glm::radians(180.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(6.0f));
-        wallShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapWall);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMapWall);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalMapWall);
-        renderQuad(2.0f);
-        glDisable(GL_CULL_FACE);
-
-        // Bottom
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
-        model = glm::rotate(model, glm::radians(180.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(6.0f));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapBottom);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapBottom);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalMapBottom);
-        wallShader.setMat4("model", model);
-        renderQuad(5.0f);
-
-        // Top
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 12.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
-        model = glm::scale(model, glm::vec3(6.0f));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMapTop);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMapTop);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, normalMapTop);
-        wallShader.setMat4("model", model);
-        renderQuad(1.0f);
-
-        glEnable(GL_CULL_FACE);
-        // desk
-        ourShader.use();
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.965f, -4.6f));
-        model = glm::rotate(model, glm::radians(180.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::rotate(model, glm::radians(0.4f), glm::normalize(glm::vec3(0.0, 0.0, 1.0)));
-        model = glm::scale(model, glm::vec3(5.5f));
-        ourShader.setMat4("model", model);
-        desk.Draw(ourShader);
-
-        // chair
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.5f, -0.235f, -2.0f));
-        model = glm::rotate(model, glm::radians(93.0f), glm::normalize(glm::vec3(1.0, 0.0, 0.0)));
-        model = glm::rotate(model, glm::radians(72.8f), glm::normalize(glm::vec3(0.0, 0.0, 1.0)));
-        model = glm::scale(model, glm::vec3(0.7f));
-        ourShader.setMat4("model", model);
-        chair.Draw(ourShader);
-
-        // table
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-3.65f, 0.01f, -3.8f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, -1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(0.8f));
-        ourShader.setMat4("model", model);
-        table.Draw(ourShader);
-
-        // table1
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 4.0f));
-        model = glm::rotate(model, glm::radians(70.0f), glm::normalize(glm::vec3(0.0, -1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(0.4f));
-        ourShader.setMat4("model", model);
-        table1.Draw(ourShader);
-
-        // couch
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(3.8f, -0.2f, 0.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, -1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(0.9f));
-        ourShader.setMat4("model", model);
-        couch.Draw(ourShader);
-
-        // laptop
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.0f, 2.813f, -5.0f));
-        model = glm::rotate(model, glm::radians(75.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        ourShader.setMat4("model", model);
-        laptop.Draw(ourShader);
-
-        // plant
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.0f, 2.791f, -4.5f));
-        model = glm::rotate(model, glm::radians(15.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-        model = glm::scale(model, glm::vec3(0.45f));
-        ourShader.setMat4("model", model);
-        plant.Draw(ourShader);
-
-        // plant1
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.8f, 2.454, 4.2f));
-        model = glm::rotate(model, glm::radians(40.0f), glm::normalize(glm::vec3(0.0, -1.0, 0.0)));
-        ourShader.setMat4("model", model);
-        plant1.Draw(ourShader);
-
-        // apples
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-5.2f, 2.45f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.4f));
-        ourShader.setMat4("model", model);
-        apples.Draw(ourShader);
-
-        // bowl
-        glCullFace(GL_BACK);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.5f, 0.92f, 4.6f));
-        model = glm::scale(model, glm::vec3(0.1f));
-        ourShader.setMat4("model", model);
-        bowl.Draw(ourShader);
-
-        glEnable(GL_CULL_FACE);
-        // light1
-        lightShader.use();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", view);
-        if (programState->light1) {
-            lightShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.0f, 11.05f, 0.0f));
-            model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(1.2f));
-            lightShader.setMat4("model", model);
-            light1.Draw(lightShader);
-        } else {
-            ourShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.0f, 11.05f, 0.0f));
-            model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(1.2f));
-            ourShader.setMat4("model", model);
-            light1.Draw(ourShader);
-        }
-
-        glDisable(GL_CULL_FACE);
-        // light2_1
-        if(programState->light2_1){
-            lightShader.use();
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(2.8f, 5.0f, -5.99f));
-            lightShader.setMat4("model", model);
-            light2.Draw(lightShader);
-        } else {
-            ourShader.use();
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(2.8f, 5.0f, -5.99f));
-            ourShader.setMat4("model", model);
-            light2.Draw(ourShader);
-        }
-        // light2_1
-        if(programState->light2_2) {
-            lightShader.use();
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-2.8f, 5.0f, -5.99f));
-            lightShader.setMat4("model", model);
-            light2.Draw(lightShader);
-        } else {
-            ourShader.use();
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-2.8f, 5.0f, -5.99f));
-            ourShader.setMat4("model", model);
-            light2.Draw(ourShader);
+        // in deferred mode the same draws only write materials, one variant per material serves every light setup
+        ShaderVariantKey gbufferKey;
+        gbufferKey.features = 0;
+        ShaderVariantKey key = deferred ? gbufferKey : lightKey;
+        ShaderVariants &objects = deferred ? gbufferShaders : ourShaders;
+        auto objectKey = [&](unsigned int index) {
+            if (lightmapped && objectLightmaps[index] >= 0)
+                return lightmapKey;
+            if (!perObjectLights) {
+                ShaderVariantKey probeKey = key;
+                probeKey.features |= probeFeatures;
+                return probeKey;
+            }
+            // the lists pick the light counts, shadows and probes are on or off for the whole frame
+            ShaderVariantKey listKey = objectLights.Key(index);
+            listKey.features |= (key.features & SHADOWS) | probeFeatures;
+            return listKey;
+        };
+        // the bindings the key was picked for, made by the queue when it gets to the object
+        auto bindObject = [&](unsigned int index) {
+            if (lightmapped && objectLightmaps[index] >= 0) {
+                // the lights of the frame's Lights block that are not baked
+                lights.Bind();
+                lightmapBaker.Bind((unsigned int) objectLightmaps[index]);
+            } else if (perObjectLights) {
+                objectLights.Bind(index);
+            }
+        };
+        // objects with the same entry make the same bindings and can share instanced draws: a lightmap is bound for
+        // its own objects, a light list for every object with the same lights
+        objectBindings.assign(scene.Size(), 0);
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            if (lightmapped && objectLightmaps[i] >= 0)
+                objectBindings[i] = 1u << 31 | (uint32_t) objectLightmaps[i];
+            else if (perObjectLights)
+                objectBindings[i] = objectLights.Block(i) + 1;
         }
 
-        glEnable(GL_CULL_FACE);
-        // light3
-        if(programState->light3) {
-            lightShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-1.4f, 2.786f, -5.2f));
-            model = glm::rotate(model, glm::radians(145.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(0.04f));
-            lightShader.setMat4("model", model);
-            light3.Draw(lightShader);
-        } else {
-            ourShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-1.4f, 2.786f, -5.2f));
-            model = glm::rotate(model, glm::radians(145.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(0.04f));
-            ourShader.setMat4("model", model);
-            light3.Draw(ourShader);
+        // every draw of the frame goes into the queue, which sorts them by state. A lamp that is switched off is
+        // lit like the furniture, one that is on glows.
+        // the tangent space shaders only know the Lights block and have no shadows or lightmaps
+        bool worldSpaceWalls = programState->worldSpaceNormalMapping || programState->clusteredLighting
+                               || programState->shadows || lightmapped;
+        ShaderVariants &walls = deferred ? gbufferWallShaders : worldSpaceWalls ? worldWallShaders : wallShaders;
+        renderQueue.Begin(programState->camera.Position, 100.0f);
+        const std::vector<uint32_t> &flags = scene.Flags();
+        const std::vector<Model *> &models = scene.Models();
+        const std::vector<glm::vec3> &centers = scene.Centers();
+        for (unsigned int i = 0; i < scene.Size(); i++) {
+            if (visible && !(*visible)[i])
+                continue;
+            bool twoSided = (flags[i] & SCENE_TWO_SIDED) != 0;
+            if (flags[i] & SCENE_GLOWING) {
+                for (const Mesh &mesh : models[i]->meshes)
+                    renderQueue.Add(RENDER_GLOWING, lightShader, mesh, i, centers[i], twoSided);
+            } else if (flags[i] & SCENE_OPAQUE) {
+                if (models[i]) {
+                    ShaderVariantKey objectVariant = objectKey(i);
+                    for (const Mesh &mesh : models[i]->meshes)
+                        renderQueue.Add(RENDER_OPAQUE, objects.Get(objectVariant.With(mesh.features)), mesh, i,
+                                        centers[i], twoSided);
+                } else {
+                    const QuadMaterial &material = quadMaterials[objectQuads[i]];
+                    renderQueue.Add(RENDER_OPAQUE, walls.Get(objectKey(i).With(material.features)),
+                                    quadVertexArray(material.tiling), 6, {material.diffuse, material.specular, material.normal},
+                                    i, centers[i], twoSided);
+                }
+            } else if (models[i]) {
+                for (const Mesh &mesh : models[i]->meshes)
+                    renderQueue.Add(RENDER_TRANSPARENT, glassShader, mesh, i, centers[i], twoSided);
+            } else {
+                renderQueue.Add(RENDER_TRANSPARENT, glassShader, glassVertexArray(), 6, {glassTexture}, i,
+                                centers[i], twoSided);
+            }
         }
-
-        // light4
-        if(programState->light4) {
-            lightShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(4.2f, 0.0f, -3.5f));
-            model = glm::rotate(model, glm::radians(95.0f), glm::normalize(glm::vec3(0.0, -1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(0.07f));
-            lightShader.setMat4("model", model);
-            light4.Draw(lightShader);
-        } else {
-            ourShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(4.2f, 0.0f, -3.5f));
-            model = glm::rotate(model, glm::radians(95.0f), glm::normalize(glm::vec3(0.0, -1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(0.07f));
-            ourShader.setMat4("model", model);
-            light4.Draw(ourShader);
+        glCullFace(GL_BACK);
+        renderQueue.Submit(RENDER_OPAQUE, bindObject, conditions, &objectBindings);
+        // the boxes are tested against the finished depth of the opaque pass
+        if (programState->occlusionQueries) {
+            profiler.Begin("Queries");
+            occlusionQueries.Issue(scene, occlusionBoxShader);
         }
 
-        // light5
-        if(programState->light5) {
-            lightShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-4.8f, 2.66f, -1.0f));
-            model = glm::rotate(model, glm::radians(55.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(1.4f));
-            lightShader.setMat4("model", model);
-            light5.Draw(lightShader);
-        } else {
-            ourShader.use();
-            glCullFace(GL_BACK);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-4.8f, 2.66f, -1.0f));
-            model = glm::rotate(model, glm::radians(55.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(1.4f));
-            ourShader.setMat4("model", model);
-            light5.Draw(ourShader);
+        // 3. deferred mode adds up the lights over the G-buffer, glass and glowing lamps are drawn on top
+        if (deferred) {
+            // the two resolutions are timed apart so the overlay shows both
+            profiler.Begin(programState->stochasticLighting ? "Lighting RIS"
+                           : programState->halfResolutionLighting ? "Lighting 1/2" : "Lighting");
+            DeferredLightingPasses passes;
+            if (programState->temporalCache)
+                passes.temporal = &temporalShader;
+            if (programState->halfResolutionLighting) {
+                passes.halfResolution = &halfLightingShader;
+                passes.upsample = &upsampleShader;
+            }
+            if (programState->stochasticLighting) {
+                passes.stochasticSample = &stochasticSampleShader;
+                passes.stochasticShade = &stochasticShadeShader;
+                passes.stochasticAccumulate = &accumulateShader;
+            }
+            deferredRenderer.Light(deferredLightingShader, view, projection, 0.1f, lights.data.dirLight,
+                                   clusteredLights.pointLights, clusteredLights.spotLights,
+                                   glm::vec3(0.05f, 0.05f, 0.05f), passes);
+            deferredRenderer.BeginForward();
         }
+        profiler.Begin("Glass and lamps");
 
-        glDisable(GL_CULL_FACE);
-        // glass
-        // blending
+        // lamps that are switched on glow, they are not lit
+        renderQueue.Submit(RENDER_GLOWING, nullptr, conditions);
+        // glass, blended back to front
         glassShader.use();
-        glassShader.setBool("light", (programState->dlight || programState->light1 || programState->light2_1 || programState->light2_2 || programState->light3 || programState->light5));
-        glassShader.setMat4("projection", projection);
-        glassShader.setMat4("view", view);
-
-        if (distance) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-4.325f, 1.665f, 3.235f));
-            model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(1.25f, 1.56f, 0.0f));
-            glBindTexture(GL_TEXTURE_2D, glassTexture);
-            glassShader.setMat4("model", model);
-            renderGlass();
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-1.0f, 2.77f, -4.0f));
-            glassShader.setMat4("model", model);
-            glass.Draw(glassShader);
-        } else {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-1.0f, 2.77f, -4.0f));
-            glassShader.setMat4("model", model);
-            glass.Draw(glassShader);
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-4.325f, 1.665f, 3.235f));
-            model = glm::rotate(model, glm::radians(90.0f), glm::normalize(glm::vec3(0.0, 1.0, 0.0)));
-            model = glm::scale(model, glm::vec3(1.25f, 1.56f, 0.0f));
-            glBindTexture(GL_TEXTURE_2D, glassTexture);
-            glassShader.setMat4("model", model);
-            renderGlass();
-        }
+        glassShader.setBool("light"_u, (programState->dlight || programState->light1 || programState->light2_1 || programState->light2_2 || programState->light3 || programState->light5));
+        renderQueue.Submit(RENDER_TRANSPARENT, nullptr, conditions);
 
         glEnable(GL_CULL_FACE);
         // -----------------------------------------------------------------------------
 
-        // 2. now render quad with scene's visuals as its texture image
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glDisable(GL_DEPTH_TEST);
-
-        // draw Screen quad
-        screenShader.use();
-        glBindVertexArray(quadVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled); // use multisampled texture
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glEnable(GL_DEPTH_TEST);
+        // 4. now render quad with scene's visuals as its texture image
+        profiler.Begin("Resolve");
+        if (deferred) {
+            // the deferred image is single sampled, it is copied as it is
+            deferredRenderer.Present();
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDisable(GL_DEPTH_TEST);
+
+            // draw Screen quad
+            screenShader.use();
+            glBindVertexArray(quadVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled); // use multisampled texture
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glEnable(GL_DEPTH_TEST);
+        }
+        profiler.EndFrame();
 
         if (programState->ImGuiEnabled)
-            DrawImGui(programState);
+            DrawImGui(programState, clusteredLights, objectLights, deferredRenderer, shadowMaps, lightmapBaker, scene,
+                      renderQueue, frustumCuller, occlusionCuller, occlusionQueries, profiler);
+        EndUniformStatsFrame();
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
-
-    programState->SaveToFile("resources/program_state.txt");
-    delete programState;
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
 }
 
 // renders a 1x1 quad in NDC with manually calculated tangent vectors
 // ------------------------------------------------------------------
 unsigned int VAO = 0;
 unsigned int VBO;
-void renderQuad(float tex)
+// the wall quad, made on the first call. The texture coordinates are scaled by the first tex asked for.
+unsigned int quadVertexArray(float tex)
 {
     if (VAO == 0)
     {
@@ -1118,6 +1052,11 @@ void renderQuad(float tex)
         glm::vec2 uv2(0.0f, 0.0f);
         glm::vec2 uv3(tex, 0.0f);
         glm::vec2 uv4(tex, tex);
+        // lightmap coordinates, the whole quad is one lightmap (see LightmapBaker)
+        glm::vec2 lm1(0.0f, 1.0f);
+        glm::vec2 lm2(0.0f, 0.0f);
+        glm::vec2 lm3(1.0f, 0.0f);
+        glm::vec2 lm4(1.0f, 1.0f);
         // normal vector
         glm::vec3 nm(0.0f, 0.0f, 1.0f);
 
@@ -1161,14 +1100,14 @@ void renderQuad(float tex)
 
 
         float quadVertices[] = {
-                // positions            // normal         // texcoords  // tangent                          // bitangent
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
+                // positions            // normal         // texcoords  // tangent                          // bitangent                               // lightmap coords
+                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z, lm1.x, lm1.y,
+                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z, lm2.x, lm2.y,
+                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z, lm3.x, lm3.y,
+
+                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z, lm1.x, lm1.y,
+                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z, lm3.x, lm3.y,
+                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z, lm4.x, lm4.y
         };
         // configure plane VAO
         glGenVertexArrays(1, &VAO);
@@ -1177,26 +1116,26 @@ void renderQuad(float tex)
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(6 * sizeof(float)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(6 * sizeof(float)));
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(8 * sizeof(float)));
         glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(11 * sizeof(float)));
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(14 * sizeof(float)));
     }
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    return VAO;
 }
 
 // render Glass
 // ------------------------------------------------
 unsigned int transparentVAO = 0;
 unsigned int transparentVBO = 0;
-void renderGlass()
+unsigned int glassVertexArray()
 {
     if(transparentVAO == 0)
     {
@@ -1223,9 +1162,7 @@ void renderGlass()
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
         glBindVertexArray(0);
     }
-    glBindVertexArray(transparentVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    return transparentVAO;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -1277,7 +1214,125 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
-void DrawImGui(ProgramState *programState) {
+// fills the Lights block with the lights that are switched on packed at the front of each array,
+// the returned key tells the shader variants how many of them to loop over
+// ---------------------------------------------------------------------------------------------
+ShaderVariantKey UpdateLights(LightsData &lights, ClusteredLights &clustered, ShadowMaps &shadowMaps,
+                              const ProgramState *programState) {
+    float dlight = programState->dlight ? 1.0f : 0.0f;
+    lights.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    lights.dirLight.ambient = glm::vec3(programState->dlight ? 0.12f : 0.05f);
+    lights.dirLight.diffuse = glm::vec3(0.4f * dlight);
+    lights.dirLight.specular = glm::vec3(0.3f * dlight);
+
+    // every active light, clustered lighting uses all of them and the Lights block the first ones
+    std::vector<PointLightData> &points = clustered.pointLights;
+    std::vector<SpotLightData> &spots = clustered.spotLights;
+    points.clear();
+    spots.clear();
+
+    for (const PointLightSource &source : pointLightSources)
+        if (programState->*source.enabled)
+            points.push_back(MakePointLight(source));
+
+    // small colored lights scattered through the room to test how lighting scales, always in the same places
+    for (int i = 0; i < programState->extraLights; i++) {
+        auto random = [i](uint64_t salt) {
+            uint64_t seed[2] = {(uint64_t) i, salt};
+            return (float) (HashBytes((const char *) seed, sizeof(seed)) >> 40) / (float) (1 << 24);
+        };
+        PointLightData light = {};
+        light.position = glm::vec3(-5.5f + 11.0f * random(0), 0.3f + 11.2f * random(1), -5.5f + 11.0f * random(2));
+        glm::vec3 color = glm::vec3(random(3), random(4), random(5));
+        color /= std::max(color.x, std::max(color.y, color.z));
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = 0.15f * color;
+        light.specular = 0.15f * color;
+        light.constant = 1.0f;
+        light.linear = 0.7f;
+        light.quadratic = 1.8f;
+        SetLightRadius(light);
+        points.push_back(light);
+    }
+
+    for (unsigned int i = 0; i < NR_SPOT_LIGHTS; i++) {
+        if (!(programState->*spotLightSources[i].enabled))
+            continue;
+        SpotLightData light = MakeSpotLight(spotLightSources[i]);
+        if (i == 0) {
+            light.position = programState->camera.Position;
+            light.direction = programState->camera.Front;
+        }
+        spots.push_back(light);
+    }
+
+    // the lights learn which shadow map they read before they are copied anywhere
+    if (programState->shadows) {
+        shadowMaps.SetSettings(programState->shadowSettings);
+        shadowMaps.Assign(lights.dirLight, points, spots);
+    }
+
+    // the Lights block holds the first lights, see ObjectLights for the lists of each object
+    ShaderVariantKey key = PackLights(lights, points, spots);
+
+    if (programState->clusteredLighting) {
+        // the light counts do not matter to the clustered shaders, one variant serves them all
+        key.pointLights = 0;
+        key.spotLights = 0;
+        key.features = CLUSTERED_LIGHTING;
+    }
+    if (programState->shadows)
+        key.features |= SHADOWS;
+    return key;
+}
+
+// a light of pointLightSources as the shaders and the lightmap baker take it
+PointLightData MakePointLight(const PointLightSource &source) {
+    PointLightData light = {};
+    light.position = source.position;
+    light.ambient = glm::vec3(0.05f);
+    light.diffuse = glm::vec3(0.4f);
+    light.specular = glm::vec3(source.specular);
+    light.constant = 1.0f;
+    light.linear = source.linear;
+    light.quadratic = source.quadratic;
+    light.altSpecularSwizzle = source.altSpecularSwizzle ? 1.0f : 0.0f;
+    SetLightRadius(light);
+    return light;
+}
+
+SpotLightData MakeSpotLight(const SpotLightSource &source) {
+    SpotLightData light = {};
+    light.position = source.position;
+    light.direction = source.direction;
+    light.ambient = glm::vec3(0.0f);
+    light.diffuse = glm::vec3(1.0f);
+    light.specular = glm::vec3(1.0f);
+    light.constant = 1.0f;
+    light.linear = 0.09f;
+    light.quadratic = 0.032f;
+    light.cutOff = glm::cos(glm::radians(source.cutOff));
+    light.outerCutOff = glm::cos(glm::radians(source.outerCutOff));
+    SetLightRadius(light);
+    return light;
+}
+
+// a power of two shadow map size from 256 to 4096
+bool ShadowMapSizeCombo(const char *label, int *size) {
+    int index = 0;
+    while (index < 4 && (256 << index) < *size)
+        index++;
+    if (!ImGui::Combo(label, &index, "256\0" "512\0" "1024\0" "2048\0" "4096\0"))
+        return false;
+    *size = 256 << index;
+    return true;
+}
+
+void DrawImGui(ProgramState *programState, const ClusteredLights &clusteredLights, const ObjectLights &objectLights,
+               const DeferredRenderer &deferredRenderer, const ShadowMaps &shadowMaps,
+               const LightmapBaker &lightmapBaker, const Scene &scene, const RenderQueue &renderQueue,
+               const FrustumCuller &frustumCuller, const OcclusionCuller &occlusionCuller,
+               const OcclusionQueries &occlusionQueries, const GpuProfiler &profiler) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -1299,6 +1354,130 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Rendering");
+        ImGui::Checkbox("World space normal mapping", &programState->worldSpaceNormalMapping);
+        ImGui::Checkbox("Clustered lighting", &programState->clusteredLighting);
+        ImGui::SliderInt("Extra lights", &programState->extraLights, 0, 512);
+        ImGui::Checkbox("Deferred shading", &programState->deferredShading);
+        if (programState->deferredShading) {
+            ImGui::Checkbox("Temporal cache", &programState->temporalCache);
+            ImGui::Checkbox("Half resolution lighting", &programState->halfResolutionLighting);
+            ImGui::Checkbox("Stochastic lighting", &programState->stochasticLighting);
+        }
+        ImGui::Checkbox("Per-object light lists", &programState->objectLightLists);
+        ImGui::Checkbox("Shadows", &programState->shadows);
+        ImGui::Checkbox("Baked lighting", &programState->bakedLighting);
+        ImGui::Checkbox("Irradiance volume", &programState->irradianceVolume);
+        ImGui::Checkbox("Frustum culling", &programState->frustumCulling);
+        ImGui::Checkbox("Occlusion culling", &programState->occlusionCulling);
+        ImGui::Checkbox("Occlusion queries", &programState->occlusionQueries);
+        if (programState->shadows) {
+            ShadowSettings &shadows = programState->shadowSettings;
+            ShadowMapSizeCombo("Directional shadow map", &shadows.directionalResolution);
+            ShadowMapSizeCombo("Spot shadow maps", &shadows.spotResolution);
+            ShadowMapSizeCombo("Point shadow maps", &shadows.pointResolution);
+            ImGui::SliderInt("Shadowed point lights", &shadows.pointLights, 0, NR_POINT_LIGHTS);
+            ImGui::SliderInt("Shadow maps per frame", &shadows.updateBudget, 1, 16);
+        }
+        ImGui::End();
+    }
+
+    {
+        const UniformStats &stats = LastFrameUniformStats();
+        ImGui::Begin("Stats");
+        ImGui::Text("Uniform calls issued: %u", stats.issued);
+        ImGui::Text("Uniform calls skipped: %u, %u to uniforms the program lacks", stats.skipped, stats.missing);
+        const Scene::Stats &objects = scene.GetStats();
+        ImGui::Text("Scene objects: %u, %u dynamic, %u moved", objects.objects, objects.dynamic, objects.moved);
+        if (programState->frustumCulling) {
+            const FrustumCuller::Stats &culling = frustumCuller.GetStats();
+            ImGui::Text("Frustum culling: %u visible, %u culled, %u nodes", culling.visible, culling.culled,
+                        culling.nodes);
+            ImGui::Text("Culling: %.3f ms, last refit %.3f ms", culling.cullMs, culling.updateMs);
+        }
+        if (programState->occlusionCulling) {
+            const OcclusionCuller::Stats &occlusion = occlusionCuller.GetStats();
+            ImGui::Text("Occlusion culling: %u of %u hidden, %u occluder triangles", occlusion.occluded,
+                        occlusion.tested, occlusion.triangles);
+            ImGui::Text("Occluders: %.3f ms, tests %.3f ms", occlusion.rasterMs, occlusion.testMs);
+        }
+        if (programState->occlusionQueries) {
+            const OcclusionQueries::Stats &queries = occlusionQueries.GetStats();
+            ImGui::Text("Occlusion queries: %u issued, %u conditional draws, %u hidden", queries.queries,
+                        queries.conditional, queries.hidden);
+            ImGui::Text("Query pixels: %.0f, hidden object pixels: %.0f", queries.queryPixels, queries.hiddenPixels);
+        }
+        const RenderQueue::Stats &queue = renderQueue.GetStats();
+        ImGui::Text("Queued draws: %u, %u draw calls, %u of them instanced", queue.draws, queue.sorted.drawCalls,
+                    queue.sorted.instanced);
+        ImGui::Text("State changes sorted: %u programs, %u textures, %u VAOs, %u culling", queue.sorted.programs,
+                    queue.sorted.textures, queue.sorted.vertexArrays, queue.sorted.culling);
+        ImGui::Text("State changes unsorted: %u programs, %u textures, %u VAOs, %u culling", queue.unsorted.programs,
+                    queue.unsorted.textures, queue.unsorted.vertexArrays, queue.unsorted.culling);
+        if (programState->deferredShading) {
+            const DeferredRenderer::Stats &deferred = deferredRenderer.GetStats();
+            ImGui::Text("Light volumes: %u, %.2f lights per pixel", deferred.volumes, deferred.coverage);
+            if (programState->stochasticLighting)
+                ImGui::Text("Lights sampled: %u, one shaded per pixel", deferred.sampled);
+            else if (programState->temporalCache)
+                ImGui::Text("Pixels reused from the last frame: %.0f%%", deferred.reused * 100.0f);
+        } else if (programState->clusteredLighting) {
+            const ClusteredLights::Stats &clusters = clusteredLights.GetStats();
+            ImGui::Text("Clustered lights: %u, %u cluster entries", clusters.lights, clusters.references);
+            ImGui::Text("Busiest cluster: %u lights", clusters.busiestCluster);
+            ImGui::Text("Light assignment: %.3f ms", clusters.assignMs);
+        } else if (programState->objectLightLists) {
+            const ObjectLights::Stats &lists = objectLights.GetStats();
+            ImGui::Text("Lights per object: %.2f, %u different lists", lists.objects ? (float) lists.references / lists.objects : 0.0f,
+                        lists.blocks);
+            ImGui::Text("Lights dropped from full lists: %u", lists.dropped);
+        }
+        if (programState->shadows) {
+            const ShadowMaps::Stats &shadows = shadowMaps.GetStats();
+            ImGui::Text("Shadow maps: %u, %u drawn, %u waiting", shadows.maps, shadows.rendered, shadows.waiting);
+        }
+        if (programState->bakedLighting || programState->irradianceVolume) {
+            LightmapBaker::Stats baked = lightmapBaker.GetStats();
+            ImGui::Text("Lightmaps: %u surfaces, %u layers, %u texels, %u triangles", baked.surfaces, baked.layers,
+                        baked.texels, baked.triangles);
+            ImGui::Text("Irradiance probes: %u", baked.probes);
+            if (baked.cached)
+                ImGui::Text("Lightmaps loaded from the cache");
+            else if (baked.progress < 1.0f)
+                ImGui::Text("Baking on %u threads: %.0f%%, %.1f s", baked.threads, baked.progress * 100.0f,
+                            baked.seconds);
+            else
+                ImGui::Text("Baked in %.1f s", baked.seconds);
+            if (programState->extraLights > 0)
+                ImGui::Text("Lightmaps unused while extra lights are on");
+        }
+        ImGui::End();
+    }
+
+    {
+        // the last time of the deferred lighting at each resolution, so flipping the toggle shows the difference
+        static float fullLightingMs = 0.0f, halfLightingMs = 0.0f, stochasticLightingMs = 0.0f;
+        ImGui::Begin("Frame profiler");
+        for (const GpuProfiler::Timing &timing : profiler.Timings()) {
+            ImGui::Text("%-12s %7.3f ms", timing.name.c_str(), timing.ms);
+            if (timing.name == "Lighting")
+                fullLightingMs = timing.ms;
+            else if (timing.name == "Lighting 1/2")
+                halfLightingMs = timing.ms;
+            else if (timing.name == "Lighting RIS")
+                stochasticLightingMs = timing.ms;
+        }
+        ImGui::Separator();
+        ImGui::Text("%-12s %7.3f ms", "GPU total", profiler.TotalMs());
+        ImGui::Text("%-12s %7.3f ms", "Frame", ImGui::GetIO().DeltaTime * 1000.0f);
+        if (fullLightingMs > 0.0f && halfLightingMs > 0.0f)
+            ImGui::Text("Half resolution lighting: %+.3f ms", halfLightingMs - fullLightingMs);
+        if (fullLightingMs > 0.0f && stochasticLightingMs > 0.0f)
+            ImGui::Text("Stochastic lighting: %+.3f ms", stochasticLightingMs - fullLightingMs);
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }